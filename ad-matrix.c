@@ -2,9 +2,15 @@
  *  Description:
  *      Generate a matrix of allelic-depths from single-sample VCF files
  *
+ *      Writing the matrices: build_matrix() runs the merge engine of
+ *      engine.c and writes its rows to the output pipes.  main() is in
+ *      main.c.
+ *
  *  History: 
  *  Date        Name        Modification
  *  2021-02-09  Jason Bacon Begin
+ *  2026-10-17  agent       Move main() to main.c and the merge engine
+ *                          to engine.c
  ***************************************************************************/
 
 #include <stdio.h>
@@ -14,96 +20,142 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sys/types.h>
 #include <xtend/dsv.h>
 #include <biolibc/vcf.h>
 #include <biolibc/biostring.h>
 
 #include "ad-matrix.h"
 
-int     main(int argc,char *argv[])
+/***************************************************************************
+ *  Description:
+ *      Convert the numeric argument of a depth option, e.g. --min-dp 10
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+depth_t depth_arg(char *argv[], int arg)
 
 {
-    file_list_t file_list;
-    char        *list_filename = argv[1],
-		*matrix_filename_stem = argv[2];
+    char    *end;
+    depth_t depth;
     
-    if ( argc != 3 )
+    if ( argv[arg] == NULL )
 	usage(argv);
-    open_files(list_filename, &file_list, "r");
-    build_matrix(&file_list, matrix_filename_stem);
-    return EX_OK;
+    depth = parse_depth(argv[arg], &end);
+    if ( (depth == DEPTH_MISSING) || (*end != '\0') )
+    {
+	fprintf(stderr, "ad-matrix: Invalid depth for %s: %s\n",
+		argv[arg - 1], argv[arg]);
+	exit(EX_USAGE);
+    }
+    return depth;
 }
 
 
 /***************************************************************************
  *  Description:
- *      Read a list of VCF files from filename and open all files with
- *      the given fopen() mode
+ *      Add a cohort from a --cohort NAME=LIST argument.  The name becomes
+ *      part of the output filenames, so is limited to letters, digits,
+ *      '.', '_', and '-'.
  *
  *  History: 
  *  Date        Name        Modification
- *  2021-02-09  Jason Bacon Begin
+ *  2026-10-17  agent       Begin
  ***************************************************************************/
 
-void    open_files(char *list_filename, file_list_t *file_list, char *mode)
+void    add_cohort(matrix_opts_t *opts, char *arg)
 
 {
-    FILE        *fp;
-    char        *temp_filename;
-    size_t      actual_len,
-		c;
+    cohort_t    *cohort;
+    char        *spec,
+		*p;
+    size_t      k;
     
-    if ( (fp = fopen(list_filename, "r")) == NULL )
+    if ( ((spec = strchr(arg, '=')) == NULL) || (spec == arg) ||
+	 (spec[1] == '\0') )
     {
-	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
-		list_filename, strerror(errno));
-	exit(EX_DATAERR);
+	fprintf(stderr, "ad-matrix: --cohort requires NAME=LIST: %s\n", arg);
+	exit(EX_USAGE);
     }
-    
-    if ( (temp_filename = malloc(PATH_MAX + 1)) == NULL )
+    for (p = arg; p < spec; ++p)
     {
-	fprintf(stderr, "open_files(): Cannot allocate temp filename.\n");
-	exit(EX_UNAVAILABLE);
+	if ( !isalnum((unsigned char)*p) && (strchr("._-", *p) == NULL) )
+	{
+	    fprintf(stderr, "ad-matrix: Invalid cohort name: %.*s\n",
+		    (int)(spec - arg), arg);
+	    exit(EX_USAGE);
+	}
     }
     
-    // Count VCF filenames
-    file_list->count = 0;
-    while ( fgets(temp_filename, PATH_MAX, fp) != NULL )
-	++file_list->count;
-    printf("%zu VCF files.\n", file_list->count);
-    
-    // Allocate list and read VCF filenames
-    file_list->filename = (char **)malloc(file_list->count * sizeof(char *));
-    if ( file_list == NULL )
+    opts->cohorts = (cohort_t *)realloc(opts->cohorts,
+			(opts->cohort_count + 1) * sizeof(cohort_t));
+    if ( opts->cohorts == NULL )
     {
-	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fprintf(stderr, "add_cohort(): Cannot allocate cohorts.\n");
 	exit(EX_UNAVAILABLE);
     }
-    file_list->fp = (FILE **)malloc(file_list->count * sizeof(FILE *));
-    if ( file_list == NULL )
+    cohort = &opts->cohorts[opts->cohort_count];
+    if ( (cohort->name = strndup(arg, spec - arg)) == NULL )
     {
-	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fprintf(stderr, "add_cohort(): Cannot allocate name.\n");
 	exit(EX_UNAVAILABLE);
     }
-    rewind(fp);
-    for (c = 0; c < file_list->count; ++c)
+    for (k = 0; k < opts->cohort_count; ++k)
     {
-	xt_tsv_read_field(fp, temp_filename, PATH_MAX, &actual_len);
-	if ( (file_list->filename[c] = strdup(temp_filename)) == NULL )
-	{
-	    fprintf(stderr,
-		    "open_files(): Error allocating filename[%zu]\n", c);
-	    exit(EX_UNAVAILABLE);
-	}
-	if ( (file_list->fp[c] = fopen(file_list->filename[c], mode)) == NULL )
+	if ( strcmp(opts->cohorts[k].name, cohort->name) == 0 )
 	{
-	    fprintf(stderr, "open_file_list(): Cannot open %s: %s\n",
-		    file_list->filename[c], strerror(errno));
-	    exit(EX_UNAVAILABLE);   // FIXME: Tailor to mode?
+	    fprintf(stderr, "ad-matrix: Duplicate cohort name: %s\n",
+		    cohort->name);
+	    exit(EX_USAGE);
 	}
-    }        
+    }
+    cohort->spec = spec + 1;
+    cohort->count = 0;
+    cohort->column = NULL;
+    ++opts->cohort_count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Record which VCF each matrix column came from, as the 1-based
+ *      index in the VCF list and the filename, one column per line.
+ *      The matrices have no header, and with sample selection the
+ *      columns no longer line up with the list.  Aggregated outputs
+ *      list the group name and number of samples in each column.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_columns(file_list_t *file_list, matrix_out_t *out)
+
+{
+    FILE    *fp;
+    char    filename[PATH_MAX + 1];
+    size_t  c;
+    
+    snprintf(filename, PATH_MAX, "%s-columns.tsv", out->stem);
+    if ( (fp = fopen(filename, "w")) == NULL )
+    {
+	fprintf(stderr, "Cannot open %s: %s\n", filename, strerror(errno));
+	fatal(EX_CANTCREAT);
+    }
+    if ( out->aggregate == AGGREGATE_NONE )
+	for (c = 0; c < out->count; ++c)
+	    fprintf(fp, "%zu\t%s\n", column_index(file_list, out->column[c]),
+		    column_name(file_list, out->column[c]));
+    else
+	for (c = 0; c < out->group_count; ++c)
+	    fprintf(fp, "%s\t%zu\n", out->group_name[c],
+		    out->group_start[c + 1] - out->group_start[c]);
     fclose(fp);
-    puts("All files opened.");
 }
 
 
@@ -114,196 +166,782 @@ void    open_files(char *list_filename, file_list_t *file_list, char *mode)
  *  History: 
  *  Date        Name        Modification
  *  2021-02-09  Jason Bacon Begin
+ *  2026-10-17  agent       Merge with merge_next(), write cohorts, bins,
+ *                          stats, annotations, indexes, checkpoints,
+ *                          and --incremental shards
  ***************************************************************************/
 
-void    build_matrix(file_list_t *file_list, char *matrix_stem)
+void    build_matrix(file_list_t *file_list, char *matrix_stem,
+		     matrix_opts_t *opts)
 
 {
     size_t      c,
-		low_pos,
-		open_count,
+		o,
+		out_count,
+		*column = NULL,
 		rows = 0;
-    bl_vcf_t  *vcf_call;
-    int         chr_cmp;
-    char        *ref_count,
-		*alt_count,
-		*ref_alt_count,
-		*low_chrom,
-		ref_matrix_pipe[PATH_MAX + 1],
-		ref_alt_matrix_pipe[PATH_MAX + 1];
-    FILE        *ref_matrix_fp,
-		*ref_alt_matrix_fp;
-    
-    vcf_call = (bl_vcf_t *)malloc(file_list->count * sizeof(bl_vcf_t));
-    if ( vcf_call == NULL )
-    {
-	fprintf(stderr, "build_matrix(): Could not allocate vcf_call array.\n");
-	fprintf(stderr, "Size = %zu\n", file_list->count * sizeof(bl_vcf_t));
-	exit(EX_UNAVAILABLE);
-    }
+    char        out_stem[PATH_MAX + 1],
+		*ids = NULL;
+    merge_t     merge;
+    row_t       *row = &merge.row;
+    bins_t      bins;
+    annot_t     annot;
+    checkpoint_t    checkpoint;
+    shards_t    shards;
+    bool        binning;
+    matrix_out_t    *outs;
+    
+    merge_open(&merge, file_list, opts);
+    
+    /* Reads the checkpoint's outputs, truncated by checkpoint_restore() */
+    if ( opts->checkpoint || opts->resume )
+	checkpoint_open(&checkpoint, matrix_stem, file_list, merge.sites_fp,
+			opts);
     
     /*
-     *  Use a lower compression level than default 6 so xz can keep up
-     *  No difference in output size between -3 and -4 so might as well
-     *  not waste CPU time and electricity
+     *  One matrix set for the whole file list, or one per cohort, all
+     *  fed from the same merged row stream.
      */
-    snprintf(ref_matrix_pipe, PATH_MAX, "xz -3 - > %s-ref.tsv.xz", matrix_stem);
-    if ( (ref_matrix_fp = popen(ref_matrix_pipe, "w")) == NULL )
+    out_count = opts->cohort_count == 0 ? 1 : opts->cohort_count;
+    if ( (outs = (matrix_out_t *)calloc(out_count, sizeof(matrix_out_t)))
+	 == NULL )
+    {
+	fprintf(stderr, "build_matrix(): Could not allocate outputs.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    if ( opts->replace_sample != NULL )
     {
-	fprintf(stderr, "Cannot open %s: %s\n", ref_matrix_pipe,
-		strerror(errno));
-	exit(EX_CANTCREAT);
+	column = replace_columns(file_list, opts->replace_sample);
+	open_matrix_out(&outs[0], matrix_stem, file_list,
+			file_list->base[0].count, column, opts);
+	free(column);
+    }
+    else if ( file_list->base_count != 0 )
+    {
+	/* Existing columns first, then the new samples */
+	if ( (column = (size_t *)malloc(merge.total * sizeof(size_t))) == NULL )
+	{
+	    fprintf(stderr, "build_matrix(): Could not allocate columns.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+	for (c = 0; c < merge.total; ++c)
+	    column[c] = opts->column_order != NULL ? opts->column_order[c] :
+			(file_list->count + c) % merge.total;
+	open_matrix_out(&outs[0], matrix_stem, file_list, merge.total, column,
+			opts);
+	free(column);
+    }
+    else if ( opts->cohort_count == 0 )
+	open_matrix_out(&outs[0], matrix_stem, file_list, file_list->count,
+			NULL, opts);
+    else
+    {
+	for (o = 0; o < out_count; ++o)
+	{
+	    snprintf(out_stem, PATH_MAX, "%s-%s", matrix_stem,
+		     opts->cohorts[o].name);
+	    open_matrix_out(&outs[o], out_stem, file_list,
+			    opts->cohorts[o].count, opts->cohorts[o].column,
+			    opts);
+	}
+    }
+    if ( opts->annotate_filename != NULL )
+	annot_open(&annot, opts->annotate_filename);
+    if ( (binning = BINNING(opts)) )
+    {
+	bins_open(&bins, opts, outs, out_count);
+	bins.annot = opts->annotate_filename != NULL ? &annot : NULL;
     }
     
-    snprintf(ref_alt_matrix_pipe, PATH_MAX, "xz -3 - > %s-ref+alt.tsv.xz", matrix_stem);
-    if ( (ref_alt_matrix_fp = popen(ref_alt_matrix_pipe, "w")) == NULL )
+    /* Reads the VCFs through, so before the first calls */
+    if ( opts->incremental )
     {
-	fprintf(stderr, "Cannot open %s: %s\n", ref_alt_matrix_pipe,
-		strerror(errno));
-	exit(EX_CANTCREAT);
+	shards_open(&shards, matrix_stem, file_list, outs, out_count, opts);
+	merge.skip_contig = shard_skip;
+	merge.shards = &shards;
+	merge.outs = outs;
+	merge.out_count = out_count;
     }
     
-    /*
-     *  Read a call from each input file, output all those with the lowest
-     *  chromosome/position or a . if the sample does not have a call there.
-     *  Read the next call for each sample that was output and repeat until
-     *  EOF on all files.
-     */
-
-    /* First call from each sample file */
-    puts("Reading first call from each sample...");
-    for (c = 0; c < file_list->count; ++c)
+    if ( opts->resume )
+    {
+	/* Calls at the checkpoint cursors, and the last row merged */
+	rows = checkpoint_restore(&checkpoint, file_list, outs, out_count,
+				  row, merge.sites_fp);
+	if ( opts->annotate_filename != NULL )
+	    annot_query(&annot, row->chrom, row->pos, row->pos);
+	printf("Resuming after %s %" PRId64 ", %zu rows.\n",
+	       row->chrom, row->pos, rows);
+    }
+    else
+	merge_start(&merge);
+    
+    while ( merge_next(&merge) )
     {
-	bl_vcf_init(&vcf_call[c]);
-	if ( bl_vcf_read_ss_call(&vcf_call[c], file_list->fp[c],
-		BL_VCF_FIELD_ALL) == BL_READ_OK )
+	/* Site filters are evaluated separately for each output */
+	if ( binning )
+	    bin_row(&bins, outs, out_count, row, merge.min_calls);
+	else
 	{
+	    if ( opts->annotate_filename != NULL )
+		ids = annot_query(&annot, row->chrom, row->pos, row->pos);
+	    for (o = 0; o < out_count; ++o)
+	    {
+		/*
+		 *  Existing rows are kept even if all new samples are
+		 *  missing, unless a column was replaced.
+		 */
+		if ( (merge.base_row && (opts->replace_sample == NULL)) ||
+		     (row_calls(&outs[o], row) >= merge.min_calls) )
+		{
+		    if ( outs[o].index != NULL )
+			index_row(&outs[o], row);
+		    write_row(&outs[o], row);
+		    if ( outs[o].stats != NULL )
+			stats_row(&outs[o], row);
+		    if ( outs[o].shm != NULL )
+			shm_row(&outs[o], row);
+		    if ( ids != NULL )
+			fprintf(outs[o].annot_fp, "%s\t%" PRId64 "\t%s\n",
+				row->chrom, row->pos, ids);
+		}
+		else
+		    ++outs[o].dropped_rows;
+	    }
+	}
+	
 #ifdef DEBUG
-	    fprintf(ref_matrix_fp, "%zu %s %s %" PRId64 " %s\n",
-		    c, file_list->filename[c],
-		    BL_VCF_CHROM(&vcf_call[c]),
-		    BL_VCF_POS(&vcf_call[c]), BL_VCF_SINGLE_SAMPLE(&vcf_call[c]));
-	    fprintf(ref_alt_matrix_fp, "%zu %s %s %" PRId64 " %s\n",
-		    c, file_list->filename[c],
-		    BL_VCF_CHROM(&vcf_call[c]),
-		    BL_VCF_POS(&vcf_call[c]), BL_VCF_SINGLE_SAMPLE(&vcf_call[c]));
+	for (c = 0; c < file_list->count; ++c)
+	    debug_call(file_list, c, stderr);
 #endif
+    
+	if ( ++rows % 1000 == 0 )
+	{
+	    fprintf(stderr, "%zu\r", rows);
+	    if ( opts->checkpoint && checkpoint_due(&checkpoint) )
+		checkpoint_write(&checkpoint, file_list, outs, out_count,
+				 row, merge.sites_fp, rows);
 	}
-	else
+    }
+    
+    if ( binning )
+	bins_close(&bins, outs, out_count);
+    if ( opts->annotate_filename != NULL )
+	annot_close(&annot);
+    if ( opts->incremental )
+	shards_close(&shards, outs, out_count);
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	if ( outs[o].stats != NULL )
+	    stats_close(&outs[o], file_list);
+	if ( outs[o].shm != NULL )
+	    shm_out_close(&outs[o]);
+	if ( outs[o].index != NULL )
+	    index_close(&outs[o]);
+	close_matrix_out(&outs[o]);
+    }
+    free(outs);
+    if ( opts->checkpoint || opts->resume )
+	checkpoint_close(&checkpoint);
+    merge_close(&merge);
+    fprintf(stderr, "Done!\n");
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open the matrix pipes for one output, and write its column list.
+ *      column[] maps output columns to file_list indexes, or NULL for
+ *      all samples in list order.  Aggregated outputs get one column
+ *      per group instead of per sample.  Binned outputs also get an
+ *      alt matrix.  --stats adds the QC sidecars (see stats.c), and
+ *      --annotate a row-aligned annotation sidecar (see annot.c).
+ *      When resuming from a checkpoint, the pipes append to the
+ *      outputs instead of replacing them.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    open_matrix_out(matrix_out_t *out, char *stem, file_list_t *file_list,
+			size_t count, size_t *column, matrix_opts_t *opts)
+
+{
+    size_t  c;
+    
+    if ( (out->stem = strdup(stem)) == NULL )
+    {
+	fprintf(stderr, "open_matrix_out(): Could not allocate stem.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    out->count = count;
+    out->rows = out->dropped_rows = 0;
+    if ( (out->column = (size_t *)malloc(count * sizeof(size_t))) == NULL )
+    {
+	fprintf(stderr, "open_matrix_out(): Could not allocate columns.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < count; ++c)
+	out->column[c] = column == NULL ? c : column[c];
+    
+    out->aggregate = opts->aggregate;
+    out->group_count = 0;
+    out->group_name = NULL;
+    out->group_start = NULL;
+    if ( out->aggregate != AGGREGATE_NONE )
+	group_columns(out, file_list);
+    out->bin_sum = NULL;
+    out->bin_calls = NULL;
+    
+    out->ref_fp = out->alt_fp = out->ref_alt_fp = out->called_fp = NULL;
+    out->annot_fp = NULL;
+    out->suffix_count = out_suffixes(out, opts, out->suffixes);
+    
+    /*
+     *  --incremental opens pipes per shard instead (see shards.c), and
+     *  --resume once checkpoint_restore() has checked the checkpoint
+     *  and truncated the outputs.
+     */
+    if ( ! opts->incremental && ! opts->resume )
+	open_out_pipes(out, stem, false);
+    out->stats = NULL;
+    if ( opts->stats )
+	stats_open(out, opts->resume);
+    out->shm = NULL;
+    if ( opts->shm_name != NULL )
+	shm_out_open(out, opts->shm_name, opts->shm_timeout);
+    out->index = NULL;
+    if ( opts->index )
+	index_open(out);
+    
+    /* Resumed outputs already have theirs */
+    if ( ! opts->resume )
+	write_columns(file_list, out);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      List the matrix pipes of an output by filename suffix
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  out_suffixes(matrix_out_t *out, matrix_opts_t *opts, char *suffixes[])
+
+{
+    size_t  count = 0;
+    
+    if ( out->aggregate == AGGREGATE_CALLED )
+	suffixes[count++] = "called";
+    else
+    {
+	suffixes[count++] = "ref";
+	if ( BINNING(opts) )
+	    suffixes[count++] = "alt";
+	suffixes[count++] = "ref+alt";
+    }
+    if ( opts->annotate_filename != NULL )
+	suffixes[count++] = "annot";
+    return count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the pipe of an output for a filename suffix
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+FILE    **out_pipe(matrix_out_t *out, char *suffix)
+
+{
+    if ( strcmp(suffix, "ref") == 0 )
+	return &out->ref_fp;
+    else if ( strcmp(suffix, "alt") == 0 )
+	return &out->alt_fp;
+    else if ( strcmp(suffix, "ref+alt") == 0 )
+	return &out->ref_alt_fp;
+    else if ( strcmp(suffix, "called") == 0 )
+	return &out->called_fp;
+    else
+	return &out->annot_fp;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open an output's matrix pipes to <stem>-<suffix>.tsv.xz, and
+ *      close them
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    open_out_pipes(matrix_out_t *out, char *stem, bool append)
+
+{
+    size_t  p;
+    
+    for (p = 0; p < out->suffix_count; ++p)
+	*out_pipe(out, out->suffixes[p]) =
+	    open_xz_pipe(stem, out->suffixes[p], append);
+}
+
+
+void    close_out_pipes(matrix_out_t *out)
+
+{
+    size_t  p;
+    FILE    **fp;
+    
+    for (p = 0; p < out->suffix_count; ++p)
+    {
+	fp = out_pipe(out, out->suffixes[p]);
+	if ( *fp != NULL )
 	{
-	    fprintf(stderr,
-		    "build_matrix(): Failed to read VCF call from %s.\n",
-		    file_list->filename[c]);
-	    exit(EX_DATAERR);
+	    pclose(*fp);
+	    *fp = NULL;
 	}
     }
-    puts("First calls read.");
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open a pipe to xz writing <stem>-<suffix>.tsv.xz, or appending
+ *      another xz stream to it
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+FILE    *open_xz_pipe(char *stem, char *suffix, bool append)
+
+{
+    char    cmd[PATH_MAX + 1];
+    FILE    *fp;
+    
+    /*
+     *  Use a lower compression level than default 6 so xz can keep up
+     *  No difference in output size between -3 and -4 so might as well
+     *  not waste CPU time and electricity
+     */
+    snprintf(cmd, PATH_MAX, "xz -3 - %s %s-%s.tsv.xz",
+	     append ? ">>" : ">", stem, suffix);
+    if ( (fp = popen(cmd, "w")) == NULL )
+    {
+	fprintf(stderr, "Cannot open %s: %s\n", cmd, strerror(errno));
+	fatal(EX_CANTCREAT);
+    }
+    return fp;
+}
+
 
-    open_count = file_list->count;
-    while ( open_count > 0 )
+/***************************************************************************
+ *  Description:
+ *      Reorder an output's columns so that the members of each group
+ *      are contiguous, in order of first appearance of each group.
+ *      Aggregating a row is then a simple pass over each group's range
+ *      of columns.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    group_columns(matrix_out_t *out, file_list_t *file_list)
+
+{
+    size_t  c,
+	    g,
+	    *group_of,
+	    *fill,
+	    *sorted;
+    char    *group;
+    
+    group_of = (size_t *)malloc(out->count * sizeof(size_t));
+    out->group_name = (char **)malloc(out->count * sizeof(char *));
+    out->group_start = (size_t *)calloc(out->count + 1, sizeof(size_t));
+    sorted = (size_t *)malloc(out->count * sizeof(size_t));
+    if ( (group_of == NULL) || (out->group_name == NULL) ||
+	 (out->group_start == NULL) || (sorted == NULL) )
     {
-	/*
-	 *  Find lowest pos among all samples
-	 */
-	
-	/* Skip over finished sample files */
-	for (c = 0; file_list->fp[c] == NULL; ++c)
+	fprintf(stderr, "group_columns(): Could not allocate groups.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    
+    for (c = 0; c < out->count; ++c)
+    {
+	if ( (group = file_list->group[out->column[c]]) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: No group listed for %s.\n",
+		    file_list->filename[out->column[c]]);
+	    fatal(EX_DATAERR);
+	}
+	for (g = 0; (g < out->group_count) &&
+		    (strcmp(out->group_name[g], group) != 0); ++g)
 	    ;
-	
-	/* Assume first sample has lowest position than scan the rest */
-	low_pos = BL_VCF_POS(&vcf_call[c]);
-	low_chrom = BL_VCF_CHROM(&vcf_call[c]);
-	for (c = c + 1; c < file_list->count; ++c)
+	if ( g == out->group_count )
+	    out->group_name[out->group_count++] = group;
+	group_of[c] = g;
+	++out->group_start[g + 1];
+    }
+    
+    /* Counting sort of columns by group */
+    for (g = 0; g < out->group_count; ++g)
+	out->group_start[g + 1] += out->group_start[g];
+    if ( (fill = (size_t *)malloc(out->group_count * sizeof(size_t))) == NULL )
+    {
+	fprintf(stderr, "group_columns(): Could not allocate groups.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    memcpy(fill, out->group_start, out->group_count * sizeof(size_t));
+    for (c = 0; c < out->count; ++c)
+	sorted[fill[group_of[c]]++] = out->column[c];
+    free(out->column);
+    out->column = sorted;
+    free(fill);
+    free(group_of);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Close an output's matrix pipes and report its row counts
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    close_matrix_out(matrix_out_t *out)
+
+{
+    close_out_pipes(out);
+    fprintf(stderr, "%s: %zu rows written, %zu rows filtered.\n",
+	    out->stem, out->rows, out->dropped_rows);
+    free(out->column);
+    free(out->group_name);
+    free(out->group_start);
+    free(out->stem);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Count the cells with data among an output's columns
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  row_calls(matrix_out_t *out, row_t *row)
+
+{
+    size_t  c,
+	    calls = 0;
+    
+    for (c = 0; c < out->count; ++c)
+	if ( (row->ref[out->column[c]] != DEPTH_MISSING) ||
+	     (row->ref_alt[out->column[c]] != DEPTH_MISSING) )
+	    ++calls;
+    return calls;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write one row to an output's ref and ref+alt matrices
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_row(matrix_out_t *out, row_t *row)
+
+{
+    size_t  c;
+    
+    if ( out->aggregate != AGGREGATE_NONE )
+    {
+	write_group_row(out, row);
+	return;
+    }
+    
+    fprintf(out->ref_fp, "%s\t%" PRId64 "\t", row->chrom, row->pos);
+    fprintf(out->ref_alt_fp, "%s\t%" PRId64 "\t", row->chrom, row->pos);
+    for (c = 0; c < out->count; ++c)
+    {
+	put_depth(row->ref[out->column[c]], out->ref_fp);
+	putc('\t', out->ref_fp);
+	put_depth(row->ref_alt[out->column[c]], out->ref_alt_fp);
+	putc('\t', out->ref_alt_fp);
+    }
+    putc('\n', out->ref_fp);
+    putc('\n', out->ref_alt_fp);
+    ++out->rows;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write one row of group aggregates.  Sums are over the samples in
+ *      the group with a value, and are missing if none has one.
+ *      Counts are of samples with a ref or ref+alt depth.
+ *
+ *      The inner loops are branch-free over a contiguous range of
+ *      columns (see group_columns()) so the compiler can vectorize them.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_group_row(matrix_out_t *out, row_t *row)
+
+{
+    size_t      g,
+		c,
+		s;
+    uint64_t    ref_sum,
+		ref_alt_sum,
+		ref_n,
+		ref_alt_n,
+		called;
+    bool        has_ref,
+		has_ref_alt;
+    
+    if ( out->aggregate == AGGREGATE_CALLED )
+	fprintf(out->called_fp, "%s\t%" PRId64 "\t", row->chrom, row->pos);
+    else
+    {
+	fprintf(out->ref_fp, "%s\t%" PRId64 "\t", row->chrom, row->pos);
+	fprintf(out->ref_alt_fp, "%s\t%" PRId64 "\t", row->chrom, row->pos);
+    }
+    
+    for (g = 0; g < out->group_count; ++g)
+    {
+	ref_sum = ref_alt_sum = ref_n = ref_alt_n = called = 0;
+	for (c = out->group_start[g]; c < out->group_start[g + 1]; ++c)
 	{
-	    chr_cmp = bl_chrom_name_cmp(BL_VCF_CHROM(&vcf_call[c]),low_chrom);
-	    if ( (file_list->fp[c] != NULL) && ((chr_cmp < 0) ||
-		    ((chr_cmp == 0) && (BL_VCF_POS(&vcf_call[c]) < low_pos))) )
-	    {
-		low_pos = BL_VCF_POS(&vcf_call[c]);
-		low_chrom = BL_VCF_CHROM(&vcf_call[c]);
-	    }
+	    s = out->column[c];
+	    has_ref = row->ref[s] != DEPTH_MISSING;
+	    has_ref_alt = row->ref_alt[s] != DEPTH_MISSING;
+	    ref_sum += has_ref ? row->ref[s] : 0;
+	    ref_alt_sum += has_ref_alt ? row->ref_alt[s] : 0;
+	    ref_n += has_ref;
+	    ref_alt_n += has_ref_alt;
+	    called += has_ref | has_ref_alt;
 	}
 	
-	/* Output row for low pos, read next call for represented samples */
-	fprintf(ref_matrix_fp, "%s\t%zu\t", low_chrom, low_pos);
-	fprintf(ref_alt_matrix_fp, "%s\t%zu\t", low_chrom, low_pos);
-	for (c = 0; c < file_list->count; ++c)
+	if ( out->aggregate == AGGREGATE_CALLED )
 	{
-	    if ( (file_list->fp[c] != NULL) &&
-		 (BL_VCF_POS(&vcf_call[c]) == low_pos) )
-	    {
-		/* Find start of ref count */
-		ref_count = BL_VCF_SINGLE_SAMPLE(&vcf_call[c]);
-		strsep(&ref_count, ":");
-		
-		/* null-terminate ref count */
-		alt_count = ref_count;
-		strsep(&alt_count, ",");
-		
-		/* Find start of depth, already null-terminated, last field */
-		ref_alt_count = alt_count;
-		strsep(&ref_alt_count, ":");
-		fprintf(ref_matrix_fp, "%s\t", ref_count);
-		fprintf(ref_alt_matrix_fp, "%s\t", ref_alt_count);
-		if ( bl_vcf_read_ss_call( &vcf_call[c], file_list->fp[c],
-			BL_VCF_FIELD_ALL) == BL_READ_EOF )
-		{
-		    fprintf(stderr, "Closing %zu %s\n", c,
-			    file_list->filename[c]);
-		    fclose(file_list->fp[c]);
-		    file_list->fp[c] = NULL;
-		    --open_count;
-		}
-	    }
-	    else
-	    {
-		fprintf(ref_matrix_fp, ".\t");
-		fprintf(ref_alt_matrix_fp, ".\t");
-	    }
+	    put_count(called, out->called_fp);
+	    putc('\t', out->called_fp);
 	}
-	putc('\n', ref_matrix_fp);
-	putc('\n', ref_alt_matrix_fp);
-	
-#ifdef DEBUG
-	for (c = 0; c < file_list->count; ++c)
+	else
 	{
-	    if ( file_list->fp[c] != NULL )
-	    {
-		fprintf(ref_matrix_fp, "%zu %s %s %" PRId64 " %s\n",
-			c, file_list->filename[c],
-			BL_VCF_CHROM(&vcf_call[c]),
-			BL_VCF_POS(&vcf_call[c]),
-			BL_VCF_SINGLE_SAMPLE(&vcf_call[c]));
-		fprintf(ref_alt_matrix_fp, "%zu %s %s %" PRId64 " %s\n",
-			c, file_list->filename[c],
-			BL_VCF_CHROM(&vcf_call[c]),
-			BL_VCF_POS(&vcf_call[c]),
-			BL_VCF_SINGLE_SAMPLE(&vcf_call[c]));
-	    }
+	    if ( ref_n == 0 )
+		putc('.', out->ref_fp);
 	    else
-	    {
-		fprintf(ref_matrix_fp, "%zu %s EOF\n",
-			c, file_list->filename[c]);
-		fprintf(ref_alt_matrix_fp, "%zu %s EOF\n",
-			c, file_list->filename[c]);
-	    }
+		put_count(ref_sum, out->ref_fp);
+	    putc('\t', out->ref_fp);
+	    if ( ref_alt_n == 0 )
+		putc('.', out->ref_alt_fp);
+	    else
+		put_count(ref_alt_sum, out->ref_alt_fp);
+	    putc('\t', out->ref_alt_fp);
 	}
-#endif
-
-	if ( ++rows % 1000 == 0 )
-	    fprintf(stderr, "%zu\r", rows);
     }
-    pclose(ref_matrix_fp);
-    pclose(ref_alt_matrix_fp);
-    fprintf(stderr, "Done!\n");
+    
+    if ( out->aggregate == AGGREGATE_CALLED )
+	putc('\n', out->called_fp);
+    else
+    {
+	putc('\n', out->ref_fp);
+	putc('\n', out->ref_alt_fp);
+    }
+    ++out->rows;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write a depth value, or "." if missing.  Much cheaper than
+ *      fprintf() for the billions of cells in a large matrix.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    put_depth(depth_t depth, FILE *fp)
+
+{
+    if ( depth == DEPTH_MISSING )
+	putc('.', fp);
+    else
+	put_count(depth, fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write an unsigned integer in decimal
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    put_count(uint64_t count, FILE *fp)
+
+{
+    char    digits[24],
+	    *p = digits + sizeof(digits);
+    
+    do
+    {
+	*--p = '0' + count % 10;
+	count /= 10;
+    }   while ( count != 0 );
+    fwrite(p, digits + sizeof(digits) - p, 1, fp);
 }
 
 
 void    usage(char *argv[])
 
 {
-    fprintf(stderr, "Usage: %s filename-with-list-of-VCFs matrix-output-stem\n", argv[0]);
+    fprintf(stderr, "Usage: %s [options] filename-with-list-of-VCFs matrix-output-stem\n", argv[0]);
     fprintf(stderr, "Two matrix files are produced, named\n");
     fprintf(stderr, "<matrix-output-stem>-ref.tsv and <matrix-output-stem>-ref+alt.tsv\n");
+    fprintf(stderr, "The VCF for each column is listed in <matrix-output-stem>-columns.tsv\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --min-dp N       Mask calls with DP < N\n");
+    fprintf(stderr, "  --min-gq N       Mask calls with GQ < N\n");
+    fprintf(stderr, "  --min-ref-alt N  Mask calls with AD ref+alt < N\n");
+    fprintf(stderr, "  --max-ref-alt N  Mask calls with AD ref+alt > N\n");
+    fprintf(stderr, "  --sites FILE     Output exactly the sites (CHROM POS) listed in FILE,\n");
+    fprintf(stderr, "                   which must be sorted like the VCFs\n");
+    fprintf(stderr, "  --samples LIST   Use only the samples in LIST\n");
+    fprintf(stderr, "  --exclude-samples LIST\n");
+    fprintf(stderr, "                   Do not use the samples in LIST\n");
+    fprintf(stderr, "LIST is a comma-separated list of 1-based indexes into the VCF list (N or\n");
+    fprintf(stderr, "N-M) and sample names (VCF filename with or without directory and .vcf),\n");
+    fprintf(stderr, "or @FILE to read them from FILE, one per line.\n");
+    fprintf(stderr, "  --cohort NAME=LIST\n");
+    fprintf(stderr, "                   Also write a matrix set for the samples in LIST, named\n");
+    fprintf(stderr, "                   <matrix-output-stem>-NAME-*.  May be repeated.  With\n");
+    fprintf(stderr, "                   cohorts, only per-cohort matrices are written and each\n");
+    fprintf(stderr, "                   VCF is read once no matter how many cohorts use it.\n");
+    fprintf(stderr, "  --min-calls N    Drop rows with fewer than N unmasked calls [1]\n");
+    fprintf(stderr, "                   (evaluated per cohort, ignored with --sites)\n");
+    fprintf(stderr, "  --aggregate sum|called\n");
+    fprintf(stderr, "                   Write one column per group, taken from the second column\n");
+    fprintf(stderr, "                   of the VCF list.  sum: ref and ref+alt depths summed over\n");
+    fprintf(stderr, "                   the group.  called: number of samples in the group with\n");
+    fprintf(stderr, "                   a call, written to <matrix-output-stem>-called.tsv.xz.\n");
+    fprintf(stderr, "  --bin-size N     Sum depths over consecutive N bp windows\n");
+    fprintf(stderr, "  --bins BED       Sum depths over the windows in BED, sorted like the VCFs\n");
+    fprintf(stderr, "                   Windows may overlap, e.g. exons, and a site is summed\n");
+    fprintf(stderr, "                   in each window containing it.\n");
+    fprintf(stderr, "                   Binned matrices have one row per window (CHROM, 1-based\n");
+    fprintf(stderr, "                   START and END), and an additional -alt matrix.\n");
+    fprintf(stderr, "  --stats          Also write QC statistics for the rows written:\n");
+    fprintf(stderr, "                   <matrix-output-stem>-sample-stats.tsv (calls, call rate,\n");
+    fprintf(stderr, "                   mean depth, mean allele balance, depth histogram) and\n");
+    fprintf(stderr, "                   <matrix-output-stem>-site-stats.tsv.xz (CHROM, POS, calls,\n");
+    fprintf(stderr, "                   call rate, mean depth, mean allele balance).  With binning,\n");
+    fprintf(stderr, "                   statistics are per site, not per window.\n");
+    fprintf(stderr, "  --gvcf           Inputs are gVCFs: sites inside a sample's reference block\n");
+    fprintf(stderr, "                   (END= in INFO, ALT <NON_REF>, <*>, or .) get the block's\n");
+    fprintf(stderr, "                   MIN_DP (or DP) instead of \".\"\n");
+    fprintf(stderr, "  --annotate FILE  Write the IDs of the BED or GTF (*.gtf) intervals in FILE,\n");
+    fprintf(stderr, "                   which may be compressed (*.gz, *.bz2, *.xz),\n");
+    fprintf(stderr, "                   overlapping each row to <matrix-output-stem>-annot.tsv.xz\n");
+    fprintf(stderr, "                   (CHROM, POS or START END, comma-separated IDs or \".\"),\n");
+    fprintf(stderr, "                   one line per matrix row.  FILE must be sorted like the\n");
+    fprintf(stderr, "                   VCFs.  BED IDs are the name column, GTF IDs gene_id.\n");
+    fprintf(stderr, "  --append STEM    Add the samples in the VCF list to the existing matrix set\n");
+    fprintf(stderr, "                   STEM-*, reading it sequentially instead of rebuilding it.\n");
+    fprintf(stderr, "                   New sites get rows that are missing for existing samples.\n");
+    fprintf(stderr, "                   Existing rows are kept regardless of --min-calls, and are\n");
+    fprintf(stderr, "                   not masked again.  Not for cohort, aggregate, binned, or\n");
+    fprintf(stderr, "                   --sites matrices.\n");
+    fprintf(stderr, "  --checkpoint N   Save a checkpoint to <matrix-output-stem>-checkpoint.tsv\n");
+    fprintf(stderr, "                   about every N seconds.  VCFs must be seekable files.\n");
+    fprintf(stderr, "  --resume         Resume from the checkpoint, if any, discarding output\n");
+    fprintf(stderr, "                   written after it.  Use the same arguments as the run\n");
+    fprintf(stderr, "                   being resumed, so a preempted job can simply be rerun.\n");
+    fprintf(stderr, "                   Not with --append or binning.\n");
+    fprintf(stderr, "  --incremental    Write each output as one shard per contig under\n");
+    fprintf(stderr, "                   <stem>-shards/, listed in <matrix-output-stem>-manifest.tsv\n");
+    fprintf(stderr, "                   with a fingerprint of the contig's VCF lines, sample list,\n");
+    fprintf(stderr, "                   and options.  Re-runs merge only contigs whose fingerprint\n");
+    fprintf(stderr, "                   changed and reuse the other shards.  Not with --append,\n");
+    fprintf(stderr, "                   binning, --stats, --sites, or checkpoints.\n");
+    fprintf(stderr, "  --procs N        Merge with N worker processes, each a shard as planned by\n");
+    fprintf(stderr, "                   ad-matrix plan.  Fragments are written under\n");
+    fprintf(stderr, "                   <matrix-output-stem>-procs/ and appended to the outputs in\n");
+    fprintf(stderr, "                   order.  VCFs must be seekable files.  Not with --append,\n");
+    fprintf(stderr, "                   binning, --stats, --incremental, checkpoints, or --shard.\n");
+    fprintf(stderr, "  --shm NAME       Also publish the ref and ref+alt depths in blocks of rows\n");
+    fprintf(stderr, "                   through the POSIX shared memory ring /NAME while merging,\n");
+    fprintf(stderr, "                   for a local reader such as ad-matrix shm-cat.  ad-matrix\n");
+    fprintf(stderr, "                   waits for the reader when the ring is full, and stops\n");
+    fprintf(stderr, "                   publishing if the reader dies or makes no progress for\n");
+    fprintf(stderr, "                   --shm-timeout seconds.  The xz outputs are written in\n");
+    fprintf(stderr, "                   full either way.  Not with\n");
+    fprintf(stderr, "                   --cohort, --aggregate, binning, --incremental, --resume,\n");
+    fprintf(stderr, "                   or --procs.\n");
+    fprintf(stderr, "  --shm-timeout SECONDS\n");
+    fprintf(stderr, "                   Longest wait for a --shm reader to attach or release a\n");
+    fprintf(stderr, "                   block, 0 to wait indefinitely for a live one [%d]\n", SHM_TIMEOUT);
+    fprintf(stderr, "  --index          Write each block of about 1M cells (rows * samples) of a\n");
+    fprintf(stderr, "                   contig as a separate xz stream, listed in\n");
+    fprintf(stderr, "                   <matrix-output-stem>-index.tsv with a zone map of\n");
+    fprintf(stderr, "                   its depths and calls, for region queries with\n");
+    fprintf(stderr, "                   ad-matrix query.  Not with\n");
+    fprintf(stderr, "                   --aggregate, binning, --incremental, checkpoints, or\n");
+    fprintf(stderr, "                   --procs.\n");
+    fprintf(stderr, "  --plan FILE --shard N\n");
+    fprintf(stderr, "                   Merge only shard N of a plan written by ad-matrix plan.\n");
+    fprintf(stderr, "                   Not with --append, binning, --stats, or --incremental.\n");
+    fprintf(stderr, "Masked calls are output as \".\".\n");
+    fprintf(stderr, "\nUsage: %s merge-matrices [options] matrix-output-stem input-stem ...\n", argv[0]);
+    fprintf(stderr, "Merge existing matrix sets.  Run with no arguments for options.\n");
+    fprintf(stderr, "\nUsage: %s replace-column [options] matrix-output-stem input-stem sample VCF\n", argv[0]);
+    fprintf(stderr, "Replace one sample of an existing matrix set.  Run with no arguments for options.\n");
+    fprintf(stderr, "\nUsage: %s plan [options] filename-with-list-of-VCFs shard-count plan-file\n", argv[0]);
+    fprintf(stderr, "Split a merge into shards of about equal work.  Run with no arguments for options.\n");
+    fprintf(stderr, "\nUsage: %s run --plan plan-file --shard N [options] filename-with-list-of-VCFs\n", argv[0]);
+    fprintf(stderr, "           shard-output-stem\n");
+    fprintf(stderr, "Merge shard N of a plan, e.g. on one node of a cluster.\n");
+    fprintf(stderr, "\nUsage: %s concat matrix-output-stem shard-output-stem ...\n", argv[0]);
+    fprintf(stderr, "Join the shard outputs, listed in plan order.\n");
+    fprintf(stderr, "\nUsage: %s paste matrix-output-stem partial-stem partial-stem ...\n", argv[0]);
+    fprintf(stderr, "Join matrix sets of disjoint samples of the same VCF list side by side.\n");
+    fprintf(stderr, "\nUsage: %s shm-cat NAME [ref|ref+alt]\n", argv[0]);
+    fprintf(stderr, "Print a matrix published by ad-matrix --shm NAME as it is merged.\n");
+    fprintf(stderr, "\nUsage: %s serve [options] filename-with-list-of-VCFs socket-path\n", argv[0]);
+    fprintf(stderr, "Hold the merged calls in memory and answer matrix requests on a Unix socket.\n");
+    fprintf(stderr, "\nUsage: %s request [options] socket-path ref|alt|ref+alt|columns [REGION]\n", argv[0]);
+    fprintf(stderr, "Print a matrix for a region and samples from ad-matrix serve.\n");
+    fprintf(stderr, "\nUsage: %s query [options] matrix-stem CHROM[:START-END]\n", argv[0]);
+    fprintf(stderr, "Print a region of a matrix set written with --index.\n");
+    fprintf(stderr, "\nUsage: %s import [options] input-stem matrix-output-stem\n", argv[0]);
+    fprintf(stderr, "Rewrite a matrix set written without --index with one.\n");
     exit(EX_USAGE);
 }
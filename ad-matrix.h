@@ -2,14 +2,876 @@
 #include <stdio.h>
 #endif
 
+#ifndef _LIMITS_H_
+#include <limits.h>
+#endif
+
+#ifndef _STDINT_H_
+#include <stdint.h>
+#endif
+
+#ifndef _SYS_TYPES_H_
+#include <sys/types.h>
+#endif
+
+#ifndef _STDBOOL_H_
+#include <stdbool.h>
+#endif
+
+#ifndef _STDATOMIC_H_
+#include <stdatomic.h>
+#endif
+
+/*
+ *  Depths are stored as unsigned 32-bit values.  The largest value is
+ *  reserved to mark a missing (or masked) cell, which is output as ".".
+ */
+typedef uint32_t    depth_t;
+#define DEPTH_MISSING   UINT32_MAX
+
+/* Cached position of each FORMAT key of interest, -1 if not present */
+typedef struct
+{
+    char    *format;
+    int     ad,
+	    dp,
+	    gq,
+	    min_dp;
+}   format_layout_t;
+
+#ifndef _BIOLIBC_VCF_H_
+#include <biolibc/vcf.h>
+#endif
+
+#define CHROM_MAX_CHARS     256
+
+/*
+ *  Site whitelist galloping: sequential peeks before seeking, first seek
+ *  distance (doubled each probe), and the span below which bisection
+ *  gives way to a linear scan.
+ */
+#define GALLOP_LINEAR_PEEKS 16
+#define GALLOP_MIN_STEP     65536
+#define GALLOP_SCAN_BYTES   16384
+
+/* Values extracted from one sample call */
+typedef struct
+{
+    depth_t ref,
+	    alt,
+	    dp,
+	    gq,
+	    min_dp;     // gVCF reference blocks
+}   cell_t;
+
+/*
+ *  Active gVCF reference block of one sample.  Its depth is parsed
+ *  once, when the block record is read, and used for every site up
+ *  to END.
+ */
+typedef struct
+{
+    char    chrom[CHROM_MAX_CHARS + 1];
+    int64_t end;        // 0 if no block
+    cell_t  cell;
+}   ref_block_t;
+
+/*
+ *  Sequential reader for an existing ref and ref+alt matrix pair, with
+ *  the column list from <stem>-columns.tsv.  Holds the current row.
+ */
 typedef struct
 {
-    size_t  count;
-    char    **filename;
-    FILE    **fp;
+    char        *stem;
+    FILE        *ref_fp,
+		*ref_alt_fp;
+    size_t      count,
+		*list_index,
+		max_index,
+		first,          // Row index of the first column
+		index_offset,   // Added to list_index in the output
+		rows;
+    char        **name;
+    char        chrom[CHROM_MAX_CHARS + 1];
+    int64_t     pos;
+    depth_t     *ref,
+		*ref_alt;
+    bool        have_row;
+}   matrix_in_t;
+
+typedef struct
+{
+    size_t          count,
+		    open_count;
+    char            **filename,
+		    **group;        // Optional second column of list
+    size_t          *list_index;    // 1-based position in the VCF list
+    FILE            **fp;
+    bl_vcf_t        *call;
+    format_layout_t *layout;
+    ref_block_t     *block;         // NULL unless --gvcf
+    matrix_in_t     *base;          // Existing matrices merged in
+    size_t          base_count,
+		    index_base;     // Added to list_index in the output
 }   file_list_t;
 
+/*
+ *  Cell-level masks applied during the merge.  Any call that fails a
+ *  mask is output as missing.  A limit of 0 (or DEPTH_MISSING for the
+ *  upper ref+alt limit) is disabled.
+ */
+typedef struct
+{
+    depth_t min_dp,
+	    min_gq,
+	    min_ref_alt,
+	    max_ref_alt;
+}   cell_mask_t;
+
+/* Depths of all samples at one site */
+typedef struct
+{
+    char    chrom[CHROM_MAX_CHARS + 1];
+    int64_t pos;
+    depth_t *ref,
+	    *alt,
+	    *ref_alt;
+}   row_t;
+
+/* A named subset of samples getting its own matrix set */
+typedef struct
+{
+    char    *name,
+	    *spec;      // Sample selection, see select_samples()
+    size_t  count,
+	    *column;    // file_list indexes of members
+}   cohort_t;
+
+typedef enum
+{
+    AGGREGATE_NONE = 0,
+    AGGREGATE_SUM,
+    AGGREGATE_CALLED
+}   aggregate_t;
+
+/*
+ *  QC statistics for one output, accumulated as rows are written.
+ *  Per-sample counters are separate arrays indexed by output column so
+ *  that each is updated in a sequential sweep of the row.
+ */
+#define STATS_DEPTH_BINS    17  // 0, 1, 2-3, 4-7, ... 32768+
+
+typedef struct
+{
+    uint64_t    sites,
+		*calls,
+		*depth_calls,
+		*depth_sum,
+		*depth_hist,    // STATS_DEPTH_BINS per column
+		*ab_calls;
+    double      *ab_sum;        // Sum of alt / (ref + alt)
+    FILE        *site_fp;
+}   stats_t;
+
+/*
+ *  Shared-memory ring for --shm (see shm.c).  The segment is a header
+ *  followed by SHM_SLOTS slots, each a block of up to block_rows rows
+ *  of one contig: the block header, then int64_t pos[block_rows], then
+ *  depth_t ref[block_rows][columns] and ref_alt[block_rows][columns],
+ *  each at a multiple of SHM_ALIGN bytes from the slot.  Block n is in
+ *  slot n % slots.  The writer publishes a block by incrementing
+ *  written and the reader releases it by incrementing read.  The reader
+ *  stores its PID on attaching, so the writer can tell if it has died.
+ */
+#define SHM_MAGIC       "ADMSHM2"
+#define SHM_SLOTS       8
+#define SHM_BLOCK_BYTES (4 * 1048576)   // Target size of a slot
+#define SHM_ALIGN       64
+#define SHM_POLL_NS     1000000         // 1 ms
+#define SHM_TIMEOUT     60              // Default --shm-timeout seconds
+
+typedef struct
+{
+    char                magic[8];
+    uint64_t            columns,
+			slots,
+			block_rows,
+			slot_bytes;
+    _Atomic uint64_t    written,
+			read;
+    _Atomic uint32_t    done;
+    _Atomic int32_t     reader_pid;     // 0 until a reader attaches
+}   shm_header_t;
+
+typedef struct
+{
+    uint64_t    rows;
+    char        chrom[CHROM_MAX_CHARS + 1];
+}   shm_block_t;
+
+typedef struct
+{
+    char            name[PATH_MAX + 1];
+    shm_header_t    *header;
+    size_t          map_bytes,
+		    pos_offset,     // Of the arrays in a slot
+		    ref_offset,
+		    ref_alt_offset;
+    shm_block_t     *block;         // Being filled, NULL if none
+    time_t          timeout;        // Longest wait for the reader, 0 for none
+    bool            detached;       // Reader gone, no longer publishing
+}   shm_out_t;
+
+/*
+ *  Row-block index of an output (--index, see index.c).  Each block is
+ *  a separate xz stream of the ref and ref+alt matrices.  The zone map
+ *  of a block bounds what a row filter can find in it: row_calls_ge[k]
+ *  is the most calls in any row with ref+alt >= 2^k.
+ */
+#define INDEX_BLOCK_CELLS   1048576 // Target rows * columns per block
+#define INDEX_MATRICES      2       // ref, ref+alt
+#define INDEX_LINE_NUMS     (3 + 2 * INDEX_MATRICES)
+#define ZONE_LEVELS         16      // ref+alt >= 1, 2, 4, ... 32768
+#define ZONE_LINE_NUMS      3
+
+/* Rows of call presence sampled by --reorder-columns (see reorder.c) */
+#define REORDER_SAMPLE_ROWS 1024
+#define REORDER_WORDS       (REORDER_SAMPLE_ROWS / 64)
+#define REORDER_NEIGHBORS   64      // Candidates each side in sorted order
+
+/* Presence bitmap of a column, sorted to find its likely neighbors */
+typedef struct
+{
+    uint64_t    *bits;
+    size_t      column;
+}   presence_sig_t;
+
+typedef struct
+{
+    char        chrom[CHROM_MAX_CHARS + 1];
+    int64_t     first_pos,
+		last_pos;
+    size_t      rows;
+    off_t       offset[INDEX_MATRICES],     // Of the xz streams
+		bytes[INDEX_MATRICES];
+    bool        zone;           // Zone map below present
+    uint64_t    calls;
+    depth_t     max_depth;      // ref+alt, 0 if no calls
+    size_t      max_row_calls,
+		row_calls_ge[ZONE_LEVELS];
+}   index_block_t;
+
+typedef struct
+{
+    FILE            *fp;
+    size_t          block_rows;     // Maximum
+    index_block_t   block;          // Being written
+}   index_t;
+
+/*
+ *  One matrix set being written: ref and ref+alt pipes, or a called
+ *  count pipe for --aggregate called.
+ */
+#define OUT_SUFFIXES_MAX    4   // ref, alt, ref+alt, annot
+
+typedef struct
+{
+    char        *stem;
+    size_t      count,
+		*column,        // file_list index for each member sample
+		rows,
+		dropped_rows;
+    aggregate_t aggregate;
+    size_t      group_count,
+		*group_start;   // Group g is column[group_start[g] ..]
+    char        **group_name;
+    uint64_t    *bin_sum;       // ref, alt, ref+alt sums per window, column
+    uint32_t    *bin_calls;     // Number of values in each sum
+    stats_t     *stats;         // NULL unless --stats
+    shm_out_t   *shm;           // NULL unless --shm
+    index_t     *index;         // NULL unless --index
+    size_t      suffix_count;
+    char        *suffixes[OUT_SUFFIXES_MAX];    // Of the pipes below
+    FILE        *ref_fp,
+		*alt_fp,
+		*ref_alt_fp,
+		*called_fp,
+		*annot_fp;      // NULL unless --annotate
+}   matrix_out_t;
+
+/* One annotation interval, 1-based and inclusive */
+typedef struct
+{
+    int64_t start,
+	    end;
+    char    *id;
+}   interval_t;
+
+/*
+ *  Sweep line over a sorted annotation file.  Intervals are read once,
+ *  when the merge key reaches their start, and dropped once it passes
+ *  their end.  ids is rebuilt only when the active set changes.
+ */
+#define ANNOT_FIELD_MAX 4096
+
+typedef struct
+{
+    FILE        *fp;
+    char        *filename;
+    bool        piped,          // fp is a decompressor, see annot_open()
+		gtf;
+    char        next_chrom[CHROM_MAX_CHARS + 1];
+    interval_t  next;           // Next interval not yet active
+    bool        have_next;
+    char        chrom[CHROM_MAX_CHARS + 1];
+    interval_t  *active;        // Intervals on chrom overlapping the query
+    size_t      active_count,
+		active_max;
+    int64_t     end;            // End of the last query
+    bool        changed;
+    char        *ids;           // Comma-separated IDs of active, or "."
+    size_t      ids_max;
+}   annot_t;
+
+/* One binning window, 1-based and inclusive */
+typedef struct
+{
+    char    chrom[CHROM_MAX_CHARS + 1];
+    int64_t start,
+	    end;
+}   window_t;
+
+/*
+ *  Window state for binning, either consecutive fixed-size bins or
+ *  intervals read from a BED file.  BED intervals may overlap, so every
+ *  window the merge key is in stays open, with its own sums in slot w
+ *  of each output's bin_sum and bin_calls.  Windows are written in BED
+ *  order, when the first open window ends.
+ */
+typedef struct
+{
+    int64_t     size;
+    FILE        *bed_fp;
+    char        *bed_filename;
+    window_t    *windows;       // Open windows, in BED order
+    size_t      window_count,
+		window_max;
+    window_t    next;           // Next BED window, not yet open
+    bool        have_next;
+    annot_t     *annot;         // NULL unless --annotate
+}   bins_t;
+
+#define BIN_VALUES  3   // ref, alt, ref+alt
+
+/*
+ *  Checkpoint of a merge in progress (see checkpoint.c).  fp is open
+ *  only while resuming, between checkpoint_open() and
+ *  checkpoint_restore().
+ */
+#define CHECKPOINT_VERSION      "1"
+#define CHECKPOINT_FIELD_MAX    64
+#define OUT_PIPES_MAX           (OUT_SUFFIXES_MAX + 1)  // And site-stats
+
+typedef struct
+{
+    char    filename[PATH_MAX + 1],
+	    temp_filename[PATH_MAX + 1];
+    FILE    *fp;
+    size_t  file_count;     // Outputs in the checkpoint
+    char    **paths;        // Their paths and sizes, until restored
+    int64_t *sizes;
+    time_t  interval,       // -1 for no periodic checkpoints
+	    last;
+}   checkpoint_t;
+
+/* Key range of one planned shard, [start, end).  "" chrom is open. */
+typedef struct
+{
+    char    start_chrom[CHROM_MAX_CHARS + 1],
+	    end_chrom[CHROM_MAX_CHARS + 1];
+    int64_t start_pos,
+	    end_pos;
+}   region_t;
+
+typedef struct
+{
+    cell_mask_t mask;
+    aggregate_t aggregate;
+    cohort_t    *cohorts;
+    size_t      cohort_count,
+		min_calls,
+		base_count;
+    int64_t     bin_size;
+    time_t      checkpoint_interval,
+		shm_timeout;
+    size_t      procs;          // --procs workers, 0 for none
+    bool        stats,
+		gvcf,
+		checkpoint,
+		resume,
+		incremental,
+		index,
+		quiet;          // No progress on stdout (libadmatrix)
+    char        *sites_filename,
+		*bins_filename,
+		*annotate_filename,
+		**base_stems,   // --append or merge-matrices inputs
+		*base_list_filename,    // Names a base with no columns file
+		*replace_sample,
+		*samples,
+		*exclude_samples,
+		*shm_name;
+    region_t    *region;        // NULL unless --shard
+    size_t      *column_order;  // Of base columns, NULL for input order
+}   matrix_opts_t;
+
+/* One contig of one VCF, found by scan_contigs() */
+typedef struct
+{
+    char        *chrom;
+    off_t       end;            // Offset after its last call
+    uint64_t    hash;           // Of its data lines
+}   contig_t;
+
+/*
+ *  One output shard (a contig) of an --incremental run.  rows holds
+ *  the rows written and filtered for each output.
+ */
+typedef struct
+{
+    char        *chrom;
+    uint64_t    fingerprint;
+    bool        done;           // Reused, or written by this run
+    size_t      *rows;
+}   shard_t;
+
+typedef struct
+{
+    char        manifest_filename[PATH_MAX + 1];
+    contig_t    **contigs;      // Per sample, in file order
+    size_t      sample_count,
+		*contig_count,
+		*next,          // Per sample cursor into contigs
+		out_count;
+    shard_t     *shards,        // This run, in merge order
+		*old;           // From the manifest of the previous run
+    size_t      shard_count,
+		old_count,
+		current,        // Shard being written, shard_count if none
+		*start_rows;    // Rows and filtered per output at its start
+}   shards_t;
+
+#define MANIFEST_VERSION    "ad-matrix-manifest-1"
+#define FNV_OFFSET  14695981039346656037ULL
+#define FNV_PRIME   1099511628211ULL
+
+/* Sampled call line of a VCF, for shard planning */
+typedef struct
+{
+    char        *chrom;
+    int64_t     pos;
+    off_t       offset;
+}   plan_point_t;
+
+/* Sampled lines of one VCF, in file order */
+#define PLAN_SAMPLES    256     // Default lines sampled per VCF
+
+typedef struct
+{
+    plan_point_t    *points;
+    size_t          count;
+    off_t           size;
+    double          line_bytes;     // Mean length of a call line
+}   density_t;
+
+/*
+ *  One sample-block partial being pasted (see paste.c).  Holds the
+ *  current line of each of its matrices, which all have the same rows.
+ */
+typedef struct
+{
+    char        *stem;
+    size_t      count,          // Columns
+		rows;
+    FILE        *fp[OUT_SUFFIXES_MAX];
+    char        *line[OUT_SUFFIXES_MAX],
+		*values[OUT_SUFFIXES_MAX];  // After the key in line
+    size_t      line_max[OUT_SUFFIXES_MAX];
+    char        chrom[CHROM_MAX_CHARS + 1];
+    int64_t     pos;
+    bool        have_row;
+}   partial_t;
+
+#define PROCS_SHARDS_PER_PROC   4
+
+/*
+ *  Merge cursor over an opened file list (see merge_open()).  row holds
+ *  the last row merged.  skip_contig, shards and outs are set by
+ *  --incremental, so that contigs with a reusable shard are skipped.
+ */
+typedef struct merge
+{
+    file_list_t     *file_list;
+    matrix_opts_t   *opts;
+    FILE            *sites_fp;
+    row_t           row;
+    size_t          total,          // Samples plus existing columns
+		    min_calls;
+    bool            base_row;       // row came from an existing matrix
+    shards_t        *shards;
+    matrix_out_t    *outs;
+    size_t          out_count;
+    bool            (*skip_contig)(struct merge *merge, char *chrom);
+}   merge_t;
+
+/*
+ *  Resident call cache of ad-matrix serve (see serve.c).  Each sample's
+ *  unmasked calls are one byte stream, in blocks of up to
+ *  CACHE_BLOCK_CALLS calls of one contig.  A call is 4 varints: POS
+ *  minus the previous POS (the block's first POS at the start of a
+ *  block), then ref, alt, and ref+alt + 1, so that DEPTH_MISSING wraps
+ *  to 0.  The block index is sorted by contig (in merge order) and POS,
+ *  so the first block of a region is found by bisection.
+ */
+#define CACHE_BLOCK_CALLS   64
+#define CACHE_CALL_MAX      25      // Bytes: 10 for POS, 5 per depth
+#define SERVE_REQUEST_MAX   1048576 // Long enough for a list of names
+
+typedef struct
+{
+    uint32_t    contig;
+    int64_t     pos;        // First POS in the block
+    size_t      offset;     // Of the first call in bytes
+}   cache_block_t;
+
+typedef struct
+{
+    unsigned char   *bytes;
+    size_t          len,
+		    max;
+    cache_block_t   *blocks;
+    size_t          block_count,
+		    max_blocks,
+		    block_calls;    // Calls in the last block
+    int64_t         last_pos;
+}   cache_sample_t;
+
+typedef struct
+{
+    file_list_t     file_list;      // Served samples, files closed
+    cache_sample_t  *samples;
+    char            **contigs;      // In merge order
+    size_t          contig_count,
+		    max_contigs,
+		    calls;
+}   cache_t;
+
+/* Read position of a query in one sample's stream */
+typedef struct
+{
+    cache_sample_t  *sample;
+    size_t          block,
+		    offset;
+    uint32_t        contig;
+    int64_t         pos;
+    depth_t         ref,
+		    alt,
+		    ref_alt;
+    bool            have_call;
+}   cache_cursor_t;
+
+/* A region query over an indexed matrix set (see query.c) */
+typedef enum
+{
+    QUERY_TSV = 0,
+    QUERY_BIN,
+    QUERY_NPY
+}   query_format_t;
+
+typedef struct
+{
+    matrix_in_t     in;             // Column list and row buffers
+    char            *which,         // ref, alt, or ref+alt
+		    chrom[CHROM_MAX_CHARS + 1];
+    int64_t         start,
+		    end;
+    size_t          *column,        // Selected columns
+		    count,
+		    min_calls,
+		    rows,
+		    blocks_read,
+		    blocks_skipped;
+    depth_t         min_dp;         // Mask cells with ref+alt < min_dp
+    query_format_t  format;
+    int64_t         *values;        // POS and cells of each output row
+    size_t          values_max;     // Rows allocated
+}   query_t;
+
+#define BINNING(opts)   (((opts)->bin_size != 0) || ((opts)->bins_filename != NULL))
+
 void    usage(char *argv[]);
-void    open_files(char *list_filename, file_list_t *file_list, char *mode);
-void    build_matrix(file_list_t *file_list, char *matrix_file);
+void    add_cohort(matrix_opts_t *opts, char *arg);
+void    write_columns(file_list_t *file_list, matrix_out_t *out);
+void    build_matrix(file_list_t *file_list, char *matrix_file,
+		     matrix_opts_t *opts);
+depth_t depth_arg(char *argv[], int arg);
+void    open_matrix_out(matrix_out_t *out, char *stem, file_list_t *file_list,
+			size_t count, size_t *column, matrix_opts_t *opts);
+size_t  out_suffixes(matrix_out_t *out, matrix_opts_t *opts, char *suffixes[]);
+FILE    **out_pipe(matrix_out_t *out, char *suffix);
+void    open_out_pipes(matrix_out_t *out, char *stem, bool append);
+void    close_out_pipes(matrix_out_t *out);
+FILE    *open_xz_pipe(char *stem, char *suffix, bool append);
+void    group_columns(matrix_out_t *out, file_list_t *file_list);
+void    close_matrix_out(matrix_out_t *out);
+size_t  row_calls(matrix_out_t *out, row_t *row);
+void    write_row(matrix_out_t *out, row_t *row);
+void    write_group_row(matrix_out_t *out, row_t *row);
+void    put_depth(depth_t depth, FILE *fp);
+void    put_count(uint64_t count, FILE *fp);
+
+/* engine.c */
+void    open_files(char *list_filename, file_list_t *file_list, char *mode,
+		   matrix_opts_t *opts);
+void    select_samples(char *spec, char *filenames[], size_t list_index[],
+		       size_t count, bool selected[], bool value);
+void    select_sample(char *item, char *filenames[], size_t list_index[],
+		      size_t count, bool selected[], bool value);
+size_t  column_index(file_list_t *file_list, size_t s);
+char    *column_name(file_list_t *file_list, size_t s);
+void    close_files(file_list_t *file_list);
+void    merge_open(merge_t *merge, file_list_t *file_list, matrix_opts_t *opts);
+void    merge_start(merge_t *merge);
+bool    merge_next(merge_t *merge);
+void    merge_close(merge_t *merge);
+depth_t parse_depth(char *str, char **end);
+void    update_format_layout(format_layout_t *layout, char *format);
+void    parse_call(char *sample, format_layout_t *layout, cell_t *cell);
+void    low_key(file_list_t *file_list, char *chrom, int64_t *pos);
+bool    next_site(FILE *sites_fp, char *sites_filename,
+		  char *chrom, int64_t *pos);
+void    row_init(row_t *row, size_t count);
+void    row_free(row_t *row);
+size_t  collect_row(file_list_t *file_list, row_t *row, cell_mask_t *mask);
+bool    next_call(file_list_t *file_list, size_t c);
+void    skip_to_site(file_list_t *file_list, size_t c,
+		     char *chrom, int64_t pos);
+void    land_on_site(file_list_t *file_list, size_t c, off_t prev,
+		     off_t line_start, char *chrom, int64_t pos);
+off_t   sync_line(FILE *fp, off_t offset);
+int     read_key(FILE *fp, char *chrom, size_t chrom_max, int64_t *pos);
+int     key_cmp(char *chrom1, int64_t pos1, char *chrom2, int64_t pos2);
+void    debug_call(file_list_t *file_list, size_t c, FILE *fp);
+bool    mask_enabled(cell_mask_t *mask);
+bool    cell_masked(cell_t *cell, cell_mask_t *mask);
+int     region_cmp(region_t *region, char *chrom, int64_t pos);
+
+/* bins.c */
+void    bins_open(bins_t *bins, matrix_opts_t *opts, matrix_out_t outs[],
+		  size_t out_count);
+void    bins_close(bins_t *bins, matrix_out_t outs[], size_t out_count);
+void    bin_row(bins_t *bins, matrix_out_t outs[], size_t out_count,
+		row_t *row, size_t min_calls);
+bool    in_window(window_t *window, row_t *row);
+void    bin_add(matrix_out_t *out, row_t *row, size_t w);
+void    open_window(bins_t *bins, matrix_out_t outs[], size_t out_count);
+void    close_window(bins_t *bins, matrix_out_t outs[], size_t out_count);
+void    flush_window(bins_t *bins, matrix_out_t outs[], size_t out_count,
+		     size_t w);
+void    write_window_row(matrix_out_t *out, window_t *window, size_t w);
+bool    next_bed_window(bins_t *bins);
+
+/* stats.c */
+void    stats_open(matrix_out_t *out, bool append);
+void    stats_close(matrix_out_t *out, file_list_t *file_list);
+void    stats_row(matrix_out_t *out, row_t *row);
+int     stats_depth_bin(depth_t depth);
+void    put_ratio(uint64_t count, double sum, FILE *fp);
+
+/* gvcf.c */
+int64_t ref_block_end(bl_vcf_t *call);
+void    take_ref_block(file_list_t *file_list, size_t c, cell_t *cell);
+bool    in_ref_block(ref_block_t *block, char *chrom, int64_t pos);
+void    skip_ref_block(file_list_t *file_list, size_t c,
+		       char *chrom, int64_t pos);
+
+/* annot.c */
+void    annot_open(annot_t *annot, char *filename);
+void    annot_close(annot_t *annot);
+bool    annot_read(annot_t *annot);
+char    *annot_query(annot_t *annot, char *chrom, int64_t start, int64_t end);
+void    annot_ids(annot_t *annot);
+char    *gtf_gene_id(char *attributes);
+
+/* matrix-in.c */
+void    matrix_in_open(matrix_in_t *in, char *stem, char *list_filename);
+void    matrix_in_columns(matrix_in_t *in, char *stem, char *list_filename);
+void    legacy_columns(matrix_in_t *in, char *stem, char *list_filename);
+void    matrix_in_close(matrix_in_t *in);
+FILE    *open_xz_reader(char *stem, char *suffix);
+bool    matrix_in_read(matrix_in_t *in);
+int     read_row_key(FILE *fp, char *chrom, int64_t *pos);
+int     read_depth(FILE *fp, depth_t *depth);
+bool    matrix_in_collect(matrix_in_t *in, row_t *row);
+size_t  open_bases(file_list_t *file_list, char *stems[], size_t count,
+		   char *list_filename);
+void    close_bases(file_list_t *file_list);
+bool    bases_have_rows(file_list_t *file_list);
+bool    bases_low_key(file_list_t *file_list, row_t *row, bool have_key);
+bool    collect_bases(file_list_t *file_list, row_t *row);
+matrix_in_t *column_base(file_list_t *file_list, size_t s);
+
+/* merge.c */
+int     merge_matrices(int argc, char *argv[]);
+void    merge_usage(char *argv[]);
+
+/* import.c */
+int     import_matrix(int argc, char *argv[]);
+void    import_usage(char *argv[]);
+
+/* reorder.c */
+size_t  *reorder_columns(char *stem);
+uint64_t    *sample_presence(matrix_in_t *in);
+int     presence_cmp(const void *p1, const void *p2);
+size_t  presence_diff(uint64_t *bits1, uint64_t *bits2);
+
+/* replace.c */
+int     replace_column(int argc, char *argv[]);
+void    replace_usage(char *argv[]);
+void    open_vcf(file_list_t *file_list, char *filename);
+size_t  *replace_columns(file_list_t *file_list, char *sample);
+
+/* checkpoint.c */
+void    checkpoint_open(checkpoint_t *ckpt, char *matrix_stem,
+			file_list_t *file_list, FILE *sites_fp,
+			matrix_opts_t *opts);
+size_t  checkpoint_restore(checkpoint_t *ckpt, file_list_t *file_list,
+			   matrix_out_t outs[], size_t out_count,
+			   row_t *row, FILE *sites_fp);
+void    checkpoint_truncate(checkpoint_t *ckpt, matrix_out_t outs[],
+			    size_t out_count);
+void    checkpoint_write(checkpoint_t *ckpt, file_list_t *file_list,
+			 matrix_out_t outs[], size_t out_count,
+			 row_t *row, FILE *sites_fp, size_t rows);
+bool    checkpoint_due(checkpoint_t *ckpt);
+void    checkpoint_close(checkpoint_t *ckpt);
+size_t  out_pipes(matrix_out_t *out, FILE **pipes[], char *suffixes[]);
+off_t   call_offset(FILE *fp);
+void    checkpoint_string(checkpoint_t *ckpt, char *buff, size_t max);
+void    checkpoint_expect(checkpoint_t *ckpt, char *keyword);
+int64_t checkpoint_int(checkpoint_t *ckpt);
+double  checkpoint_double(checkpoint_t *ckpt);
+void    checkpoint_mismatch(checkpoint_t *ckpt);
+
+/* shards.c */
+void    shards_open(shards_t *shards, char *matrix_stem, file_list_t *file_list,
+		    matrix_out_t outs[], size_t out_count, matrix_opts_t *opts);
+void    shards_close(shards_t *shards, matrix_out_t outs[], size_t out_count);
+bool    shard_skip(merge_t *merge, char *chrom);
+void    shard_end(shards_t *shards, matrix_out_t outs[], size_t out_count);
+void    shard_stem(char *stem, matrix_out_t *out, char *chrom);
+void    shard_path(char *path, matrix_out_t *out, char *chrom, char *suffix);
+void    scan_contigs(shards_t *shards, file_list_t *file_list, size_t c);
+void    add_contigs(shards_t *shards, size_t c);
+uint64_t    params_hash(file_list_t *file_list, matrix_opts_t *opts);
+uint64_t    fnv_hash(uint64_t hash, void *data, size_t len);
+uint64_t    file_hash(char *filename);
+void    read_manifest(shards_t *shards);
+void    write_manifest(shards_t *shards);
+void    assemble_outputs(shards_t *shards, matrix_out_t *out);
+
+/* plan.c */
+int     plan_shards(int argc, char *argv[]);
+density_t   *sample_densities(file_list_t *file_list, size_t samples);
+void    free_densities(density_t *densities, size_t count);
+size_t  plan_bounds(density_t densities[], size_t count, size_t shard_count,
+		    plan_point_t bounds[]);
+void    bound_region(region_t *region, plan_point_t bounds[],
+		     size_t bound_count, size_t s);
+void    sample_density(density_t *density, FILE *fp, char *filename,
+		       size_t samples);
+double  density_bytes(density_t *density, char *chrom, int64_t pos);
+double  plan_bytes(density_t densities[], size_t count, plan_point_t *key);
+int     point_cmp(const void *p1, const void *p2);
+void    read_region(region_t *region, char *plan_filename, size_t shard);
+int     concat_shards(int argc, char *argv[]);
+void    concat_file(char *matrix_stem, char *shard_stems[], size_t shard_count,
+		    char *suffix, bool same);
+void    concat_index(char *matrix_stem, char *shard_stems[], size_t shard_count,
+		     char *suffix);
+void    plan_usage(char *argv[]);
+void    concat_usage(char *argv[]);
+
+/* paste.c */
+int     paste_matrices(int argc, char *argv[]);
+void    partial_open(partial_t *partial, char *stem, char *suffixes[],
+		     size_t suffix_count, FILE *columns_fp);
+bool    partial_read(partial_t *partial, size_t suffix_count,
+		     size_t key_fields);
+void    paste_mismatch(partial_t *partial);
+void    partial_close(partial_t *partial, size_t suffix_count);
+void    paste_usage(char *argv[]);
+
+/* procs.c */
+void    run_procs(file_list_t *file_list, char *matrix_stem,
+		  matrix_opts_t *opts);
+void    run_worker(file_list_t *file_list, char *dir, size_t shard,
+		   region_t *region, matrix_opts_t *opts);
+void    append_fragments(char *matrix_stem, char *dir, size_t shard);
+void    stop_workers(pid_t pids[], bool done[], size_t count);
+
+/* shm.c */
+void    shm_out_open(matrix_out_t *out, char *name, time_t timeout);
+void    shm_out_close(matrix_out_t *out);
+void    shm_row(matrix_out_t *out, row_t *row);
+void    shm_publish(shm_out_t *shm);
+bool    shm_wait_read(shm_out_t *shm, uint64_t read);
+void    shm_detach(shm_out_t *shm, char *reason);
+void    shm_layout(shm_out_t *shm, uint64_t columns, uint64_t block_rows);
+void    shm_wait(void);
+int     shm_cat(int argc, char *argv[]);
+void    shm_cat_usage(char *argv[]);
+
+/* serve.c */
+int     serve_cache(int argc, char *argv[]);
+void    cache_load(cache_t *cache, char *list_filename, matrix_opts_t *opts);
+void    cache_add_call(cache_t *cache, size_t c, row_t *row);
+size_t  cache_bytes(cache_t *cache);
+void    cache_seek(cache_cursor_t *cursor, cache_sample_t *sample,
+		   uint32_t contig, int64_t pos);
+void    cache_next(cache_cursor_t *cursor);
+unsigned char   *put_varint(unsigned char *p, uint64_t value);
+uint64_t    get_varint(unsigned char **p);
+int     serve_listen(char *socket_path);
+void    serve_request(cache_t *cache, int fd);
+bool    parse_region(char *spec, char *chrom, int64_t *start, int64_t *end);
+void    serve_matrix(cache_t *cache, FILE *fp, char *which, char *chrom,
+		     int64_t start, int64_t end, bool selected[],
+		     size_t min_calls);
+int     serve_client(int argc, char *argv[]);
+char    *read_sample_file(char *filename);
+void    serve_usage(char *argv[]);
+void    client_usage(char *argv[]);
+
+/* query.c */
+int     query_matrix(int argc, char *argv[]);
+bool    zone_skip(query_t *query, index_block_t *block);
+void    query_block(query_t *query, index_block_t *block);
+FILE    *open_block_reader(char *stem, char *suffix, off_t offset);
+bool    query_read_row(query_t *query, FILE *fp, depth_t *depths,
+		       char *chrom, int64_t *pos);
+void    query_row(query_t *query, int64_t pos);
+void    write_npy(query_t *query, FILE *fp);
+void    query_usage(char *argv[]);
+
+/* index.c */
+void    index_open(matrix_out_t *out);
+void    index_row(matrix_out_t *out, row_t *row);
+void    index_end_block(matrix_out_t *out, bool reopen);
+void    index_write(FILE *fp, index_block_t *block);
+int     zone_level(depth_t depth);
+void    index_close(matrix_out_t *out);
+bool    index_read(FILE *fp, char *filename, index_block_t *block);
 
+/* libadmatrix.c */
+void    fatal(int status);
@@ -0,0 +1,105 @@
+/***************************************************************************
+ *  Description:
+ *      libadmatrix: the ad-matrix merge as a library.  Open a list of
+ *      single-sample VCFs, read the merged depths in blocks of rows,
+ *      and close.  Nothing is written, so the caller gets the values
+ *      without formatting or parsing text.
+ *
+ *      Functions returning int return EX_OK or another sysexits(3)
+ *      status instead of exiting.  Messages are still printed to
+ *      stderr.  After an error, only admatrix_close() may be called.
+ *
+ *      Separate iterators may be used by separate threads at once.  An
+ *      iterator itself must be used by one thread at a time.
+ *
+ *      Example:
+ *
+ *          admatrix_t          *am;
+ *          admatrix_opts_t     opts;
+ *          admatrix_block_t    block;
+ *
+ *          admatrix_opts_init(&opts);
+ *          opts.min_dp = 10;
+ *          if ( admatrix_open(&am, "vcfs.txt", &opts) != EX_OK )
+ *              ...
+ *          while ( (admatrix_read_block(am, &block) == EX_OK) &&
+ *                  (block.rows != 0) )
+ *              for (r = 0; r < block.rows; ++r)
+ *                  ... block.chrom, block.pos[r],
+ *                      block.ref_alt[r * block.columns + c] ...
+ *          admatrix_close(am);
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#ifndef _ADMATRIX_H_
+#define _ADMATRIX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Value of a missing (or masked) cell, "." in the matrices */
+#define ADMATRIX_MISSING    UINT32_MAX
+#define ADMATRIX_BLOCK_ROWS 1024    // Default maximum rows per block
+
+typedef struct admatrix_iter  admatrix_t;
+
+/*
+ *  Options of the merge, as for the command.  Set the defaults with
+ *  admatrix_opts_init() before changing any.
+ */
+typedef struct
+{
+    uint32_t    min_dp,         // --min-dp etc., 0 for none
+		min_gq,
+		min_ref_alt,
+		max_ref_alt;    // ADMATRIX_MISSING for none
+    size_t      min_calls,      // --min-calls, ignored with sites_filename
+		block_rows;
+    const char  *samples,       // --samples, NULL for all
+		*exclude_samples,
+		*sites_filename;
+    bool        gvcf;
+    const char  *start_chrom,   // Rows from start to before end, NULL
+		*end_chrom;     // for open ends
+    int64_t     start_pos,
+		end_pos;
+}   admatrix_opts_t;
+
+/*
+ *  Rows read by admatrix_read_block(), all on the same contig.  The
+ *  arrays belong to the admatrix_t and are valid until the next read.
+ *  Depths are row-major: column c of row r is [r * columns + c].
+ */
+typedef struct
+{
+    const char      *chrom;
+    size_t          rows,
+		    columns;
+    const int64_t   *pos;
+    const uint32_t  *ref,
+		    *alt,
+		    *ref_alt;
+}   admatrix_block_t;
+
+void    admatrix_opts_init(admatrix_opts_t *opts);
+int     admatrix_open(admatrix_t **am, const char *list_filename,
+		      const admatrix_opts_t *opts);
+size_t  admatrix_columns(admatrix_t *am);
+const char  *admatrix_column_name(admatrix_t *am, size_t c);
+size_t  admatrix_column_index(admatrix_t *am, size_t c);
+int     admatrix_read_block(admatrix_t *am, admatrix_block_t *block);
+void    admatrix_close(admatrix_t *am);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _ADMATRIX_H_
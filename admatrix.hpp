@@ -0,0 +1,303 @@
+/***************************************************************************
+ *  Description:
+ *      Header-only C++ facade over libadmatrix (see admatrix.h).
+ *
+ *      admatrix::Matrix<T, Extract> merges a VCF list and presents each
+ *      block of rows as a view of cells of type T, taken from the raw
+ *      depths by Extract.  Everything is resolved at compile time: no
+ *      virtual functions, and the only allocation is one block buffer,
+ *      made when the matrix is opened.  When T is uint32_t and Extract
+ *      is a raw depth, the view points straight into the C block.
+ *
+ *          admatrix::Options   opts;
+ *          opts.min_dp = 10;
+ *          admatrix::Matrix<float, admatrix::Vaf> m("vcfs.txt", opts);
+ *          for (const auto &block : m)
+ *              for (const auto &row : block)
+ *                  for (float vaf : row)
+ *                      ... block.chrom(), row.pos() ...
+ *
+ *      Missing cells are admatrix::missing<T>(): the largest value of
+ *      an integer type, NaN for floating point.  Depths too large for
+ *      T are clamped below it.  Errors throw admatrix::Error with the
+ *      sysexits(3) status.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#ifndef _ADMATRIX_HPP_
+#define _ADMATRIX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <sysexits.h>
+
+#include "admatrix.h"
+
+namespace admatrix
+{
+
+class Error : public std::runtime_error
+{
+    public:
+	Error(const std::string &what, int status) :
+	    std::runtime_error(what), status_(status) {}
+	int status() const { return status_; }
+    private:
+	int status_;
+};
+
+/* Options as for the command, with the defaults of admatrix_opts_init() */
+struct Options : admatrix_opts_t
+{
+    Options() { admatrix_opts_init(this); }
+};
+
+template <class T>
+constexpr T missing()
+{
+    return std::numeric_limits<T>::has_quiet_NaN ?
+	   std::numeric_limits<T>::quiet_NaN() : std::numeric_limits<T>::max();
+}
+
+/***************************************************************************
+ *  Description:
+ *      Convert a raw depth to T, clamping depths that would collide
+ *      with or exceed missing<T>()
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+template <class T>
+inline T cell(uint32_t depth)
+
+{
+    if ( depth == ADMATRIX_MISSING )
+	return missing<T>();
+    if ( ! std::is_floating_point<T>::value &&
+	 (depth >= (uint64_t)std::numeric_limits<T>::max()) )
+	return std::numeric_limits<T>::max() - 1;
+    return static_cast<T>(depth);
+}
+
+/*
+ *  Extractors.  value() computes cell i of a block (row-major index).
+ *  If is_raw, the cell is the depth in the array returned by raw(),
+ *  which can be used in place when T is uint32_t.
+ */
+struct Ref
+{
+    template <class T>
+    static T value(const admatrix_block_t &b, size_t i)
+	{ return cell<T>(b.ref[i]); }
+    static constexpr bool is_raw = true;
+    static const uint32_t *raw(const admatrix_block_t &b) { return b.ref; }
+};
+
+struct Alt
+{
+    template <class T>
+    static T value(const admatrix_block_t &b, size_t i)
+	{ return cell<T>(b.alt[i]); }
+    static constexpr bool is_raw = true;
+    static const uint32_t *raw(const admatrix_block_t &b) { return b.alt; }
+};
+
+struct RefAlt
+{
+    template <class T>
+    static T value(const admatrix_block_t &b, size_t i)
+	{ return cell<T>(b.ref_alt[i]); }
+    static constexpr bool is_raw = true;
+    static const uint32_t *raw(const admatrix_block_t &b)
+	{ return b.ref_alt; }
+};
+
+/* Variant allele fraction alt / (ref + alt) from AD */
+struct Vaf
+{
+    template <class T>
+    static T value(const admatrix_block_t &b, size_t i)
+    {
+	static_assert(std::is_floating_point<T>::value,
+		      "Vaf needs a floating point cell type");
+	uint64_t    ref = b.ref[i], alt = b.alt[i];
+
+	if ( (ref == ADMATRIX_MISSING) || (alt == ADMATRIX_MISSING) ||
+	     (ref + alt == 0) )
+	    return missing<T>();
+	return static_cast<T>(alt) / static_cast<T>(ref + alt);
+    }
+    static constexpr bool is_raw = false;
+    static const uint32_t *raw(const admatrix_block_t &) { return nullptr; }
+};
+
+/* Contiguous read-only cells, like std::span<const T> */
+template <class T>
+class Span
+{
+    public:
+	Span(const T *data, size_t size) : data_(data), size_(size) {}
+	const T *data() const { return data_; }
+	size_t size() const { return size_; }
+	const T &operator[](size_t i) const { return data_[i]; }
+	const T *begin() const { return data_; }
+	const T *end() const { return data_ + size_; }
+    private:
+	const T *data_;
+	size_t  size_;
+};
+
+/* One row of a block: its position and one cell per sample */
+template <class T>
+class Row : public Span<T>
+{
+    public:
+	Row(int64_t pos, const T *cells, size_t columns) :
+	    Span<T>(cells, columns), pos_(pos) {}
+	int64_t pos() const { return pos_; }
+    private:
+	int64_t pos_;
+};
+
+/* Rows of one contig, valid until the matrix reads the next block */
+template <class T>
+class Block
+{
+    public:
+	class iterator
+	{
+	    public:
+		iterator(const Block *block, size_t r) : block_(block), r_(r) {}
+		Row<T> operator*() const { return (*block_)[r_]; }
+		iterator &operator++() { ++r_; return *this; }
+		bool operator!=(const iterator &other) const
+		    { return r_ != other.r_; }
+	    private:
+		const Block *block_;
+		size_t      r_;
+	};
+
+	const char *chrom() const { return chrom_; }
+	size_t rows() const { return rows_; }
+	size_t columns() const { return columns_; }
+	const int64_t *pos() const { return pos_; }
+	Span<T> cells() const { return Span<T>(cells_, rows_ * columns_); }
+	Row<T> operator[](size_t r) const
+	    { return Row<T>(pos_[r], cells_ + r * columns_, columns_); }
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, rows_); }
+
+    private:
+	template <class, class> friend class Matrix;
+	const char      *chrom_ = "";
+	size_t          rows_ = 0,
+			columns_ = 0;
+	const int64_t   *pos_ = nullptr;
+	const T         *cells_ = nullptr;
+};
+
+/***************************************************************************
+ *  Description:
+ *      A merge in progress.  Iterating reads the blocks in order, once:
+ *      the merge is a single pass over the VCFs.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+template <class T, class Extract = RefAlt>
+class Matrix
+{
+    public:
+	class iterator
+	{
+	    public:
+		explicit iterator(Matrix *matrix) : matrix_(matrix) {}
+		const Block<T> &operator*() const { return matrix_->block_; }
+		const Block<T> *operator->() const { return &matrix_->block_; }
+		iterator &operator++()
+		{
+		    if ( ! matrix_->read() )
+			matrix_ = nullptr;
+		    return *this;
+		}
+		bool operator!=(const iterator &other) const
+		    { return matrix_ != other.matrix_; }
+	    private:
+		Matrix  *matrix_;
+	};
+
+	Matrix(const std::string &list_filename,
+	       const Options &opts = Options())
+	{
+	    int status = admatrix_open(&am_, list_filename.c_str(), &opts);
+
+	    if ( status != EX_OK )
+		throw Error("admatrix: Cannot open " + list_filename, status);
+	    block_rows_ = opts.block_rows == 0 ? ADMATRIX_BLOCK_ROWS :
+			  opts.block_rows;
+	    if ( ! direct() )
+		buff_.resize(block_rows_ * admatrix_columns(am_));
+	}
+
+	Matrix(const Matrix &) = delete;
+	Matrix &operator=(const Matrix &) = delete;
+	~Matrix() { admatrix_close(am_); }
+
+	size_t columns() const { return admatrix_columns(am_); }
+	std::string column_name(size_t c) const
+	    { return admatrix_column_name(am_, c); }
+	size_t column_index(size_t c) const
+	    { return admatrix_column_index(am_, c); }
+
+	/* Read the next block, false at the end of the merge */
+	bool read()
+	{
+	    admatrix_block_t    b;
+	    int                 status;
+
+	    if ( (status = admatrix_read_block(am_, &b)) != EX_OK )
+		throw Error("admatrix: Merge failed", status);
+	    block_.chrom_ = b.chrom;
+	    block_.rows_ = b.rows;
+	    block_.columns_ = b.columns;
+	    block_.pos_ = b.pos;
+	    if ( direct() )
+		block_.cells_ = reinterpret_cast<const T *>(Extract::raw(b));
+	    else
+	    {
+		for (size_t i = 0; i < b.rows * b.columns; ++i)
+		    buff_[i] = Extract::template value<T>(b, i);
+		block_.cells_ = buff_.data();
+	    }
+	    return b.rows != 0;
+	}
+
+	iterator begin() { return read() ? iterator(this) : end(); }
+	iterator end() { return iterator(nullptr); }
+
+    private:
+	/* The block's own array is used when no conversion is needed */
+	static constexpr bool direct()
+	    { return std::is_same<T, uint32_t>::value && Extract::is_raw; }
+
+	admatrix_t          *am_ = nullptr;
+	size_t              block_rows_;
+	std::vector<T>      buff_;
+	Block<T>            block_;
+};
+
+}   // namespace admatrix
+
+#endif  // _ADMATRIX_HPP_
@@ -0,0 +1,384 @@
+/***************************************************************************
+ *  Description:
+ *      Annotation join.  Rows are tagged with the IDs of the BED or GTF
+ *      intervals overlapping them, using a sweep line that advances with
+ *      the merge key.  Since both rows and intervals are sorted, each
+ *      interval is read once and dropped once, so the join is
+ *      O(rows + intervals) with no lookups.
+ *
+ *      BED IDs are the name column, or chrom:start-end if there is none.
+ *      GTF IDs are the gene_id attribute.  An ID is listed once per row
+ *      even if several of its intervals (e.g. exons) overlap the row.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+#include <biolibc/biostring.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Open an annotation file and read its first interval.  Files
+ *      named *.gz, *.bz2, or *.xz are read through a decompressor.
+ *      Files named *.gtf, or *.gtf with one of those suffixes, are GTF,
+ *      anything else is BED.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    annot_open(annot_t *annot, char *filename)
+
+{
+    static char *decompressors[][2] =
+	{ { ".gz", "gzip" }, { ".bz2", "bzip2" }, { ".xz", "xz" } };
+    char    cmd[PATH_MAX + 32];
+    size_t  len = strlen(filename),
+	    d,
+	    ext_len;
+    
+    memset(annot, 0, sizeof(*annot));
+    annot->filename = filename;
+    if ( access(filename, R_OK) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    
+    for (d = 0; d < sizeof(decompressors) / sizeof(*decompressors); ++d)
+    {
+	ext_len = strlen(decompressors[d][0]);
+	if ( (len > ext_len) &&
+	     (strcmp(filename + len - ext_len, decompressors[d][0]) == 0) )
+	    break;
+    }
+    if ( d < sizeof(decompressors) / sizeof(*decompressors) )
+    {
+	len -= ext_len;
+	snprintf(cmd, PATH_MAX + 32, "%s -dc %s", decompressors[d][1],
+		 filename);
+	annot->fp = popen(cmd, "r");
+	annot->piped = true;
+    }
+    else
+	annot->fp = fopen(filename, "r");
+    if ( annot->fp == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    annot->gtf = (len > 4) && (strncmp(filename + len - 4, ".gtf", 4) == 0);
+    
+    annot->active_max = 64;
+    annot->ids_max = 1024;
+    annot->active = (interval_t *)malloc(annot->active_max *
+					 sizeof(interval_t));
+    annot->ids = (char *)malloc(annot->ids_max);
+    if ( (annot->active == NULL) || (annot->ids == NULL) )
+    {
+	fprintf(stderr, "annot_open(): Could not allocate intervals.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    strcpy(annot->ids, ".");
+    annot->have_next = annot_read(annot);
+}
+
+
+void    annot_close(annot_t *annot)
+
+{
+    size_t  c;
+    
+    if ( annot->piped )
+	pclose(annot->fp);
+    else
+	fclose(annot->fp);
+    for (c = 0; c < annot->active_count; ++c)
+	free(annot->active[c].id);
+    if ( annot->have_next )
+	free(annot->next.id);
+    free(annot->active);
+    free(annot->ids);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next interval into annot->next.  Header lines (#, track,
+ *      browser) are skipped.  Returns false at EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    annot_read(annot_t *annot)
+
+{
+    char    chrom[CHROM_MAX_CHARS + 1],
+	    field[ANNOT_FIELD_MAX + 1],
+	    *end,
+	    *id = NULL;
+    size_t  len;
+    int     delim,
+	    col,
+	    start_col = annot->gtf ? 4 : 2,
+	    end_col = annot->gtf ? 5 : 3,
+	    id_col = annot->gtf ? 9 : 4;
+    int64_t start = -1,
+	    stop = -1;
+    
+    while ( true )
+    {
+	delim = xt_tsv_read_field(annot->fp, chrom, CHROM_MAX_CHARS, &len);
+	if ( (delim == EOF) && (len == 0) )
+	    return false;
+	if ( (len > 0) && (*chrom != '#') &&
+	     (strncmp(chrom, "track", 5) != 0) &&
+	     (strncmp(chrom, "browser", 7) != 0) )
+	    break;
+	while ( (delim != '\n') && (delim != EOF) )
+	    delim = getc(annot->fp);
+    }
+    
+    for (col = 2; delim == '\t'; ++col)
+    {
+	delim = xt_tsv_read_field(annot->fp, field, ANNOT_FIELD_MAX, &len);
+	if ( col == start_col )
+	{
+	    start = strtoll(field, &end, 10);
+	    if ( (*end != '\0') || (len == 0) )
+		start = -1;
+	}
+	else if ( col == end_col )
+	{
+	    stop = strtoll(field, &end, 10);
+	    if ( (*end != '\0') || (len == 0) )
+		stop = -1;
+	}
+	else if ( (col == id_col) && (len > 0) )
+	    id = annot->gtf ? gtf_gene_id(field) : strdup(field);
+    }
+    
+    /* Convert BED 0-based start */
+    if ( ! annot->gtf && (start >= 0) )
+	++start;
+    if ( (start < 1) || (stop < start) )
+    {
+	fprintf(stderr, "ad-matrix: Bad interval in %s at %s.\n",
+		annot->filename, chrom);
+	exit(EX_DATAERR);
+    }
+    if ( (*annot->next_chrom != '\0') &&
+	 (key_cmp(chrom, start, annot->next_chrom, annot->next.start) < 0) )
+    {
+	fprintf(stderr, "ad-matrix: %s is not sorted: %s %" PRId64
+		" follows %s %" PRId64 ".\n", annot->filename,
+		chrom, start, annot->next_chrom, annot->next.start);
+	exit(EX_DATAERR);
+    }
+    
+    if ( id == NULL )
+    {
+	snprintf(field, ANNOT_FIELD_MAX, "%s:%" PRId64 "-%" PRId64,
+		 chrom, annot->gtf ? start : start - 1, stop);
+	id = strdup(field);
+    }
+    if ( id == NULL )
+    {
+	fprintf(stderr, "annot_read(): Could not allocate ID.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    if ( strcmp(annot->next_chrom, chrom) != 0 )
+	strcpy(annot->next_chrom, chrom);
+    annot->next.start = start;
+    annot->next.end = stop;
+    annot->next.id = id;
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the IDs of intervals overlapping chrom start..end, or "."
+ *      if there are none.  Successive query starts must not move
+ *      backward, but ends may, since overlapping BED windows are queried
+ *      in start order.  The string is valid until the next query.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+char    *annot_query(annot_t *annot, char *chrom, int64_t start, int64_t end)
+
+{
+    size_t  c,
+	    kept;
+    int     chr_cmp;
+    
+    /* Drop intervals ending before the query */
+    if ( strcmp(annot->chrom, chrom) != 0 )
+    {
+	for (c = 0; c < annot->active_count; ++c)
+	    free(annot->active[c].id);
+	annot->changed |= annot->active_count != 0;
+	annot->active_count = 0;
+	snprintf(annot->chrom, CHROM_MAX_CHARS + 1, "%s", chrom);
+    }
+    for (c = kept = 0; c < annot->active_count; ++c)
+    {
+	if ( annot->active[c].end >= start )
+	{
+	    /* Active after a longer query, but not in this one, or back */
+	    annot->changed |= (annot->active[c].start > end) !=
+			      (annot->active[c].start > annot->end);
+	    annot->active[kept++] = annot->active[c];
+	}
+	else
+	    free(annot->active[c].id);
+    }
+    annot->changed |= kept != annot->active_count;
+    annot->active_count = kept;
+    
+    /* Add intervals starting by the end of the query */
+    while ( annot->have_next )
+    {
+	chr_cmp = bl_chrom_name_cmp(annot->next_chrom, chrom);
+	if ( (chr_cmp > 0) || ((chr_cmp == 0) && (annot->next.start > end)) )
+	    break;
+	if ( (chr_cmp == 0) && (annot->next.end >= start) )
+	{
+	    if ( annot->active_count == annot->active_max )
+	    {
+		annot->active_max *= 2;
+		annot->active = (interval_t *)realloc(annot->active,
+				annot->active_max * sizeof(interval_t));
+		if ( annot->active == NULL )
+		{
+		    fprintf(stderr, "annot_query(): Could not allocate intervals.\n");
+		    exit(EX_UNAVAILABLE);
+		}
+	    }
+	    annot->active[annot->active_count++] = annot->next;
+	    annot->changed = true;
+	}
+	else
+	    free(annot->next.id);
+	annot->have_next = annot_read(annot);
+    }
+    
+    annot->end = end;
+    if ( annot->changed )
+	annot_ids(annot);
+    return annot->ids;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Rebuild the comma-separated ID list of the active intervals
+ *      starting by the end of the last query, listing each ID once
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    annot_ids(annot_t *annot)
+
+{
+    size_t  c,
+	    d,
+	    len = 0,
+	    id_len;
+    char    *id;
+    
+    for (c = 0; c < annot->active_count; ++c)
+    {
+	if ( annot->active[c].start > annot->end )
+	    continue;
+	id = annot->active[c].id;
+	for (d = 0; (d < c) && ((annot->active[d].start > annot->end) ||
+		    (strcmp(annot->active[d].id, id) != 0)); ++d)
+	    ;
+	if ( d < c )
+	    continue;
+    
+	id_len = strlen(id);
+	if ( len + id_len + 2 > annot->ids_max )
+	{
+	    annot->ids_max = (len + id_len + 2) * 2;
+	    if ( (annot->ids = (char *)realloc(annot->ids, annot->ids_max))
+		 == NULL )
+	    {
+		fprintf(stderr, "annot_ids(): Could not allocate IDs.\n");
+		exit(EX_UNAVAILABLE);
+	    }
+	}
+	if ( len > 0 )
+	    annot->ids[len++] = ',';
+	memcpy(annot->ids + len, id, id_len);
+	len += id_len;
+    }
+    if ( len == 0 )
+	annot->ids[len++] = '.';
+    annot->ids[len] = '\0';
+    annot->changed = false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return a copy of the gene_id value in a GTF attribute field, or
+ *      NULL if there is none
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+char    *gtf_gene_id(char *attributes)
+
+{
+    char    *p,
+	    *id;
+    size_t  len;
+    
+    for (p = attributes; (p = strstr(p, "gene_id")) != NULL; p += 7)
+    {
+	if ( (p != attributes) && (p[-1] != ' ') && (p[-1] != ';') )
+	    continue;
+	p += 7;
+	while ( *p == ' ' )
+	    ++p;
+	if ( *p == '"' )
+	    ++p;
+	len = strcspn(p, "\";");
+	if ( (id = (char *)malloc(len + 1)) != NULL )
+	{
+	    memcpy(id, p, len);
+	    id[len] = '\0';
+	}
+	return id;
+    }
+    return NULL;
+}
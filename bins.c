@@ -0,0 +1,459 @@
+/***************************************************************************
+ *  Description:
+ *      Window binning: sum per-sample depths over fixed-size bins or
+ *      BED intervals as the merge advances, so that only one row per
+ *      window is ever written.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+#include <biolibc/biostring.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Set up window state and per-output window accumulators
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    bins_open(bins_t *bins, matrix_opts_t *opts, matrix_out_t outs[],
+		  size_t out_count)
+
+{
+    size_t  o;
+    
+    bins->size = opts->bin_size;
+    bins->bed_fp = NULL;
+    bins->bed_filename = opts->bins_filename;
+    bins->window_count = 0;
+    bins->window_max = 1;
+    *bins->next.chrom = '\0';
+    bins->have_next = false;
+    bins->annot = NULL;
+    
+    bins->windows = (window_t *)malloc(bins->window_max * sizeof(window_t));
+    if ( bins->windows == NULL )
+    {
+	fprintf(stderr, "bins_open(): Could not allocate windows.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (o = 0; o < out_count; ++o)
+    {
+	outs[o].bin_sum = (uint64_t *)calloc(BIN_VALUES * outs[o].count,
+					     sizeof(uint64_t));
+	outs[o].bin_calls = (uint32_t *)calloc(BIN_VALUES * outs[o].count,
+					       sizeof(uint32_t));
+	if ( (outs[o].bin_sum == NULL) || (outs[o].bin_calls == NULL) )
+	{
+	    fprintf(stderr, "bins_open(): Could not allocate accumulators.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+    }
+    
+    if ( bins->bed_filename != NULL )
+    {
+	if ( (bins->bed_fp = fopen(bins->bed_filename, "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    bins->bed_filename, strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	bins->have_next = next_bed_window(bins);
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the open windows, and with BED windows, every window after
+ *      the last site.  Free accumulators.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    bins_close(bins_t *bins, matrix_out_t outs[], size_t out_count)
+
+{
+    size_t  o;
+    
+    while ( (bins->window_count > 0) || bins->have_next )
+    {
+	if ( bins->window_count == 0 )
+	{
+	    open_window(bins, outs, out_count);
+	    bins->have_next = next_bed_window(bins);
+	}
+	close_window(bins, outs, out_count);
+    }
+    if ( bins->bed_fp != NULL )
+	fclose(bins->bed_fp);
+    free(bins->windows);
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	free(outs[o].bin_sum);
+	free(outs[o].bin_calls);
+	outs[o].bin_sum = NULL;
+	outs[o].bin_calls = NULL;
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Add a row to the windows containing it, first writing any windows
+ *      that end before it.  Fixed-size bins are written for every bin
+ *      from the start of the chromosome through the last site, so empty
+ *      bins get rows of ".".  Every BED window gets a row, and a site in
+ *      overlapping BED windows is added to each.  Sites outside all BED
+ *      windows are ignored.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    bin_row(bins_t *bins, matrix_out_t outs[], size_t out_count,
+		row_t *row, size_t min_calls)
+
+{
+    size_t      o,
+		w;
+    int64_t     bin_start;
+    window_t    *window = bins->windows;
+    bool        inside = false;
+    
+    if ( bins->bed_fp == NULL )
+    {
+	if ( (bins->window_count == 0) ||
+	     (strcmp(window->chrom, row->chrom) != 0) )
+	{
+	    if ( bins->window_count > 0 )
+		flush_window(bins, outs, out_count, 0);
+	    strcpy(window->chrom, row->chrom);
+	    window->start = 1;
+	    window->end = bins->size;
+	    bins->window_count = 1;
+	}
+	bin_start = (row->pos - 1) / bins->size * bins->size + 1;
+	while ( window->start < bin_start )
+	{
+	    flush_window(bins, outs, out_count, 0);
+	    window->start += bins->size;
+	    window->end += bins->size;
+	}
+    }
+    else
+    {
+	while ( bins->have_next &&
+		(key_cmp(bins->next.chrom, bins->next.start,
+			 row->chrom, row->pos) <= 0) )
+	{
+	    open_window(bins, outs, out_count);
+	    bins->have_next = next_bed_window(bins);
+	}
+	while ( (bins->window_count > 0) &&
+		(key_cmp(row->chrom, row->pos, bins->windows[0].chrom,
+			 bins->windows[0].end) > 0) )
+	    close_window(bins, outs, out_count);
+    }
+    
+    /* Open windows after the first may end before the row */
+    for (w = 0; w < bins->window_count; ++w)
+	inside |= in_window(&bins->windows[w], row);
+    if ( !inside )
+	return;
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	if ( row_calls(&outs[o], row) >= min_calls )
+	{
+	    for (w = 0; w < bins->window_count; ++w)
+		if ( in_window(&bins->windows[w], row) )
+		    bin_add(&outs[o], row, w);
+	    if ( outs[o].stats != NULL )
+		stats_row(&outs[o], row);
+	}
+	else
+	    ++outs[o].dropped_rows;
+    }
+}
+
+
+/* Chroms compare as for the merge, so BED "1" matches VCF "chr1" */
+bool    in_window(window_t *window, row_t *row)
+
+{
+    return (key_cmp(row->chrom, row->pos,
+		    window->chrom, window->start) >= 0) &&
+	   (key_cmp(row->chrom, row->pos, window->chrom, window->end) <= 0);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Accumulate one row into an output's sums for window w
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    bin_add(matrix_out_t *out, row_t *row, size_t w)
+
+{
+    size_t      c,
+		s;
+    uint64_t    *ref_sum = out->bin_sum + w * BIN_VALUES * out->count,
+		*alt_sum = ref_sum + out->count,
+		*ref_alt_sum = ref_sum + 2 * out->count;
+    uint32_t    *ref_calls = out->bin_calls + w * BIN_VALUES * out->count,
+		*alt_calls = ref_calls + out->count,
+		*ref_alt_calls = ref_calls + 2 * out->count;
+    
+    for (c = 0; c < out->count; ++c)
+    {
+	s = out->column[c];
+	ref_sum[c] += row->ref[s] != DEPTH_MISSING ? row->ref[s] : 0;
+	ref_calls[c] += row->ref[s] != DEPTH_MISSING;
+	alt_sum[c] += row->alt[s] != DEPTH_MISSING ? row->alt[s] : 0;
+	alt_calls[c] += row->alt[s] != DEPTH_MISSING;
+	ref_alt_sum[c] += row->ref_alt[s] != DEPTH_MISSING ? row->ref_alt[s] : 0;
+	ref_alt_calls[c] += row->ref_alt[s] != DEPTH_MISSING;
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open bins->next as the last window, with zero sums
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    open_window(bins_t *bins, matrix_out_t outs[], size_t out_count)
+
+{
+    size_t  o,
+	    values,
+	    w = bins->window_count;
+    
+    if ( w == bins->window_max )
+    {
+	bins->window_max *= 2;
+	bins->windows = (window_t *)realloc(bins->windows,
+				bins->window_max * sizeof(window_t));
+	for (o = 0; o < out_count; ++o)
+	{
+	    values = bins->window_max * BIN_VALUES * outs[o].count;
+	    outs[o].bin_sum = (uint64_t *)realloc(outs[o].bin_sum,
+						  values * sizeof(uint64_t));
+	    outs[o].bin_calls = (uint32_t *)realloc(outs[o].bin_calls,
+						    values * sizeof(uint32_t));
+	    if ( (outs[o].bin_sum == NULL) || (outs[o].bin_calls == NULL) )
+		break;
+	}
+	if ( (bins->windows == NULL) || (o < out_count) )
+	{
+	    fprintf(stderr, "open_window(): Could not allocate windows.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+    }
+    
+    bins->windows[w] = bins->next;
+    for (o = 0; o < out_count; ++o)
+    {
+	values = BIN_VALUES * outs[o].count;
+	memset(outs[o].bin_sum + w * values, 0, values * sizeof(uint64_t));
+	memset(outs[o].bin_calls + w * values, 0, values * sizeof(uint32_t));
+    }
+    ++bins->window_count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the first open window and drop it, moving the others and
+ *      their sums down one slot
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    close_window(bins_t *bins, matrix_out_t outs[], size_t out_count)
+
+{
+    size_t  o,
+	    values,
+	    moved = bins->window_count - 1;
+    
+    flush_window(bins, outs, out_count, 0);
+    memmove(bins->windows, bins->windows + 1, moved * sizeof(window_t));
+    for (o = 0; o < out_count; ++o)
+    {
+	values = BIN_VALUES * outs[o].count;
+	memmove(outs[o].bin_sum, outs[o].bin_sum + values,
+		moved * values * sizeof(uint64_t));
+	memmove(outs[o].bin_calls, outs[o].bin_calls + values,
+		moved * values * sizeof(uint32_t));
+    }
+    bins->window_count = moved;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write window w to every output and reset its sums
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    flush_window(bins_t *bins, matrix_out_t outs[], size_t out_count,
+		     size_t w)
+
+{
+    size_t      o,
+		values;
+    char        *ids = NULL;
+    window_t    *window = &bins->windows[w];
+    
+    if ( bins->annot != NULL )
+	ids = annot_query(bins->annot, window->chrom, window->start,
+			  window->end);
+    for (o = 0; o < out_count; ++o)
+    {
+	write_window_row(&outs[o], window, w);
+	if ( ids != NULL )
+	    fprintf(outs[o].annot_fp, "%s\t%" PRId64 "\t%" PRId64 "\t%s\n",
+		    window->chrom, window->start, window->end, ids);
+	values = BIN_VALUES * outs[o].count;
+	memset(outs[o].bin_sum + w * values, 0, values * sizeof(uint64_t));
+	memset(outs[o].bin_calls + w * values, 0, values * sizeof(uint32_t));
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write window w's row to an output's ref, alt, and ref+alt
+ *      matrices.  Samples with no values in the window are written as ".".
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_window_row(matrix_out_t *out, window_t *window, size_t w)
+
+{
+    FILE        *fps[BIN_VALUES] = { out->ref_fp, out->alt_fp, out->ref_alt_fp };
+    size_t      v,
+		c;
+    uint64_t    *sum = out->bin_sum + w * BIN_VALUES * out->count;
+    uint32_t    *calls = out->bin_calls + w * BIN_VALUES * out->count;
+    
+    for (v = 0; v < BIN_VALUES; ++v)
+    {
+	fprintf(fps[v], "%s\t%" PRId64 "\t%" PRId64 "\t",
+		window->chrom, window->start, window->end);
+	for (c = 0; c < out->count; ++c)
+	{
+	    if ( calls[v * out->count + c] == 0 )
+		putc('.', fps[v]);
+	    else
+		put_count(sum[v * out->count + c], fps[v]);
+	    putc('\t', fps[v]);
+	}
+	putc('\n', fps[v]);
+    }
+    ++out->rows;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next BED interval into bins->next.  BED starts are
+ *      0-based, so the window is start + 1 through end.  Header lines
+ *      (#, track, browser) are skipped.  Intervals must be sorted by
+ *      start, like the VCFs, but may overlap.  Returns false at EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    next_bed_window(bins_t *bins)
+
+{
+    char    chrom[CHROM_MAX_CHARS + 1],
+	    field[32],
+	    *end;
+    size_t  len;
+    int     delim;
+    int64_t start,
+	    stop;
+    
+    while ( true )
+    {
+	delim = xt_tsv_read_field(bins->bed_fp, chrom, CHROM_MAX_CHARS, &len);
+	if ( (delim == EOF) && (len == 0) )
+	    return false;
+	if ( (*chrom != '#') && (strncmp(chrom, "track", 5) != 0) &&
+	     (strncmp(chrom, "browser", 7) != 0) && (len > 0) )
+	    break;
+	while ( (delim != '\n') && (delim != EOF) )
+	    delim = getc(bins->bed_fp);
+    }
+    
+    if ( (delim != '\t') ||
+	 (xt_tsv_read_field(bins->bed_fp, field, 31, &len) != '\t') ||
+	 ((start = strtoll(field, &end, 10)) < 0) || (*end != '\0') ||
+	 ((delim = xt_tsv_read_field(bins->bed_fp, field, 31, &len)) == EOF &&
+	  len == 0) ||
+	 ((stop = strtoll(field, &end, 10)) <= start) || (*end != '\0') )
+    {
+	fprintf(stderr, "ad-matrix: Bad interval in %s after %s %" PRId64
+		" %" PRId64 ".\n", bins->bed_filename, bins->next.chrom,
+		bins->next.start - 1, bins->next.end);
+	exit(EX_DATAERR);
+    }
+    while ( (delim != '\n') && (delim != EOF) )
+	delim = getc(bins->bed_fp);
+    
+    if ( (*bins->next.chrom != '\0') &&
+	 (key_cmp(chrom, start + 1, bins->next.chrom, bins->next.start) < 0) )
+    {
+	fprintf(stderr, "ad-matrix: %s is not sorted at %s %" PRId64 ".\n",
+		bins->bed_filename, chrom, start);
+	exit(EX_DATAERR);
+    }
+    
+    strcpy(bins->next.chrom, chrom);
+    bins->next.start = start + 1;
+    bins->next.end = stop;
+    return true;
+}
@@ -0,0 +1,629 @@
+/***************************************************************************
+ *  Description:
+ *      Checkpoint and resume for long merges.  At each checkpoint every
+ *      output pipe is closed, so that each output is a series of
+ *      complete xz streams (which xz -d reads as one), and reopened for
+ *      append.  The checkpoint records the size of each output, the
+ *      offset of each sample's current call, the last row key, the
+ *      per-output row counts and --stats counters, and --gvcf blocks.
+ *
+ *      --resume checks that the checkpoint is for the same VCFs and
+ *      outputs, then truncates the outputs back to the recorded sizes,
+ *      discarding anything written after the checkpoint, and restarts
+ *      the merge from the recorded cursors.  Nothing is truncated
+ *      unless the whole checkpoint matches the run.
+ *
+ *      <stem>-checkpoint.tsv is replaced atomically with rename(), and
+ *      removed when the merge completes.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Set up checkpointing for the merge writing matrix_stem.  With
+ *      --resume, read the output paths and sizes from an existing
+ *      checkpoint, for checkpoint_restore() to check and truncate.
+ *      If there is no checkpoint, opts->resume is cleared and
+ *      the merge starts from the beginning, so a preempted job can
+ *      simply be rerun with the same command.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    checkpoint_open(checkpoint_t *ckpt, char *matrix_stem,
+			file_list_t *file_list, FILE *sites_fp,
+			matrix_opts_t *opts)
+
+{
+    char    path[PATH_MAX + 1];
+    size_t  c;
+    
+    memset(ckpt, 0, sizeof(*ckpt));
+    ckpt->interval = opts->checkpoint ? opts->checkpoint_interval : -1;
+    ckpt->last = time(NULL);
+    snprintf(ckpt->filename, PATH_MAX, "%s-checkpoint.tsv", matrix_stem);
+    snprintf(ckpt->temp_filename, PATH_MAX, "%s-checkpoint.tsv.tmp",
+	     matrix_stem);
+    
+    /* Cursors are restored by seeking */
+    for (c = 0; c < file_list->count; ++c)
+    {
+	if ( ftello(file_list->fp[c]) == -1 )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot checkpoint %s: not seekable.\n",
+		    file_list->filename[c]);
+	    exit(EX_USAGE);
+	}
+    }
+    if ( (sites_fp != NULL) && (ftello(sites_fp) == -1) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot checkpoint %s: not seekable.\n",
+		opts->sites_filename);
+	exit(EX_USAGE);
+    }
+    
+    /* A stale checkpoint would not match the new outputs */
+    if ( ! opts->resume )
+    {
+	checkpoint_close(ckpt);
+	return;
+    }
+    if ( (ckpt->fp = fopen(ckpt->filename, "r")) == NULL )
+    {
+	if ( errno != ENOENT )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    ckpt->filename, strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	printf("No checkpoint %s, starting from the beginning.\n",
+	       ckpt->filename);
+	opts->resume = false;
+	return;
+    }
+    
+    checkpoint_expect(ckpt, "ad-matrix-checkpoint");
+    checkpoint_expect(ckpt, CHECKPOINT_VERSION);
+    ckpt->file_count = checkpoint_int(ckpt);
+    ckpt->paths = (char **)calloc(ckpt->file_count, sizeof(char *));
+    ckpt->sizes = (int64_t *)calloc(ckpt->file_count, sizeof(int64_t));
+    if ( (ckpt->paths == NULL) || (ckpt->sizes == NULL) )
+    {
+	fprintf(stderr, "checkpoint_open(): Could not allocate outputs.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < ckpt->file_count; ++c)
+    {
+	checkpoint_expect(ckpt, "file");
+	checkpoint_string(ckpt, path, PATH_MAX);
+	ckpt->sizes[c] = checkpoint_int(ckpt);
+	if ( (ckpt->paths[c] = strdup(path)) == NULL )
+	{
+	    fprintf(stderr, "checkpoint_open(): Could not allocate path.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+    }
+    printf("Resuming from %s.\n", ckpt->filename);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Restore the merge state saved by checkpoint_write() once the
+ *      outputs are set up.  Replaces reading the first call of each
+ *      sample.  Once all of the checkpoint matches the run, truncate
+ *      the outputs and open their pipes to append.  Returns the number
+ *      of rows merged before the checkpoint.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  checkpoint_restore(checkpoint_t *ckpt, file_list_t *file_list,
+			   matrix_out_t outs[], size_t out_count,
+			   row_t *row, FILE *sites_fp)
+
+{
+    char        path[PATH_MAX + 1];
+    size_t      rows,
+		c,
+		o,
+		file_count = 0;
+    int64_t     offset;
+    int         bin;
+    FILE        **pipes[OUT_PIPES_MAX];
+    char        *suffixes[OUT_PIPES_MAX];
+    ref_block_t *block;
+    stats_t     *stats;
+    
+    /* The outputs must be the ones checkpointed */
+    for (o = 0; o < out_count; ++o)
+	file_count += out_pipes(&outs[o], pipes, suffixes);
+    checkpoint_expect(ckpt, "rows");
+    rows = checkpoint_int(ckpt);
+    checkpoint_expect(ckpt, "key");
+    checkpoint_string(ckpt, row->chrom, CHROM_MAX_CHARS);
+    row->pos = checkpoint_int(ckpt);
+    
+    if ( sites_fp != NULL )
+    {
+	checkpoint_expect(ckpt, "sites");
+	fseeko(sites_fp, checkpoint_int(ckpt), SEEK_SET);
+    }
+    
+    checkpoint_expect(ckpt, "samples");
+    if ( (checkpoint_int(ckpt) != (int64_t)file_list->count) ||
+	 (file_count != ckpt->file_count) )
+	checkpoint_mismatch(ckpt);
+    for (c = 0; c < file_list->count; ++c)
+    {
+	checkpoint_expect(ckpt, "vcf");
+	checkpoint_string(ckpt, path, PATH_MAX);
+	if ( strcmp(path, file_list->filename[c]) != 0 )
+	    checkpoint_mismatch(ckpt);
+	offset = checkpoint_int(ckpt);
+	if ( offset == -1 )
+	{
+	    fclose(file_list->fp[c]);
+	    file_list->fp[c] = NULL;
+	    --file_list->open_count;
+	}
+	else
+	{
+	    fseeko(file_list->fp[c], offset, SEEK_SET);
+	    if ( bl_vcf_read_ss_call(&file_list->call[c], file_list->fp[c],
+		    BL_VCF_FIELD_ALL) != BL_READ_OK )
+	    {
+		fprintf(stderr, "ad-matrix: Failed to read VCF call from %s.\n",
+			file_list->filename[c]);
+		exit(EX_DATAERR);
+	    }
+	}
+    
+	if ( file_list->block != NULL )
+	{
+	    block = &file_list->block[c];
+	    checkpoint_string(ckpt, block->chrom, CHROM_MAX_CHARS);
+	    block->end = checkpoint_int(ckpt);
+	    block->cell.ref = checkpoint_int(ckpt);
+	    block->cell.alt = checkpoint_int(ckpt);
+	    block->cell.dp = checkpoint_int(ckpt);
+	    block->cell.gq = checkpoint_int(ckpt);
+	    block->cell.min_dp = checkpoint_int(ckpt);
+	}
+    }
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	checkpoint_expect(ckpt, "out");
+	checkpoint_string(ckpt, path, PATH_MAX);
+	if ( strcmp(path, outs[o].stem) != 0 )
+	    checkpoint_mismatch(ckpt);
+	outs[o].rows = checkpoint_int(ckpt);
+	outs[o].dropped_rows = checkpoint_int(ckpt);
+	if ( (stats = outs[o].stats) == NULL )
+	    continue;
+    
+	checkpoint_expect(ckpt, "stats");
+	stats->sites = checkpoint_int(ckpt);
+	for (c = 0; c < outs[o].count; ++c)
+	{
+	    stats->calls[c] = checkpoint_int(ckpt);
+	    stats->depth_calls[c] = checkpoint_int(ckpt);
+	    stats->depth_sum[c] = checkpoint_int(ckpt);
+	    stats->ab_calls[c] = checkpoint_int(ckpt);
+	    stats->ab_sum[c] = checkpoint_double(ckpt);
+	    for (bin = 0; bin < STATS_DEPTH_BINS; ++bin)
+		stats->depth_hist[c * STATS_DEPTH_BINS + bin] =
+		    checkpoint_int(ckpt);
+	}
+    }
+    checkpoint_expect(ckpt, "end");
+    fclose(ckpt->fp);
+    ckpt->fp = NULL;
+    
+    checkpoint_truncate(ckpt, outs, out_count);
+    return rows;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Truncate the outputs of this run to their sizes in the
+ *      checkpoint and open their pipes to append.  Every checkpointed
+ *      path must be one of this run's <stem>-*.tsv.xz outputs, and
+ *      every output must be checkpointed, so only they are truncated.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    checkpoint_truncate(checkpoint_t *ckpt, matrix_out_t outs[],
+			    size_t out_count)
+
+{
+    char    path[PATH_MAX + 1];
+    FILE    **pipes[OUT_PIPES_MAX];
+    char    *suffixes[OUT_PIPES_MAX];
+    size_t  o,
+	    p,
+	    f,
+	    pipe_count,
+	    matched = 0;
+    
+    /* Check all before truncating any */
+    for (o = 0; o < out_count; ++o)
+    {
+	pipe_count = out_pipes(&outs[o], pipes, suffixes);
+	for (p = 0; p < pipe_count; ++p)
+	{
+	    snprintf(path, PATH_MAX, "%s-%s.tsv.xz", outs[o].stem, suffixes[p]);
+	    for (f = 0; (f < ckpt->file_count) &&
+			(strcmp(ckpt->paths[f], path) != 0); ++f)
+		;
+	    if ( f == ckpt->file_count )
+		checkpoint_mismatch(ckpt);
+	    ++matched;
+	}
+    }
+    if ( matched != ckpt->file_count )
+	checkpoint_mismatch(ckpt);
+    
+    for (f = 0; f < ckpt->file_count; ++f)
+    {
+	if ( truncate(ckpt->paths[f], ckpt->sizes[f]) != 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot truncate %s: %s\n",
+		    ckpt->paths[f], strerror(errno));
+	    exit(EX_CANTCREAT);
+	}
+	free(ckpt->paths[f]);
+    }
+    free(ckpt->paths);
+    free(ckpt->sizes);
+    ckpt->paths = NULL;
+    ckpt->sizes = NULL;
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	pipe_count = out_pipes(&outs[o], pipes, suffixes);
+	for (p = 0; p < pipe_count; ++p)
+	    *pipes[p] = open_xz_pipe(outs[o].stem, suffixes[p], true);
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write a checkpoint after the row at row->chrom/row->pos.  All
+ *      output pipes are closed and reopened for append, so this is
+ *      only done every ckpt->interval seconds.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    checkpoint_write(checkpoint_t *ckpt, file_list_t *file_list,
+			 matrix_out_t outs[], size_t out_count,
+			 row_t *row, FILE *sites_fp, size_t rows)
+
+{
+    char        *temp_filename = ckpt->temp_filename,
+		path[PATH_MAX + 1];
+    size_t      c,
+		o,
+		p,
+		pipe_count,
+		file_count = 0;
+    int         bin;
+    FILE        *fp,
+		**pipes[OUT_PIPES_MAX];
+    char        *suffixes[OUT_PIPES_MAX];
+    struct stat st;
+    ref_block_t *block;
+    stats_t     *stats;
+    
+    if ( (fp = fopen(temp_filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		temp_filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    
+    /* End the current xz stream of each output and note its size */
+    for (o = 0; o < out_count; ++o)
+	file_count += out_pipes(&outs[o], pipes, suffixes);
+    fprintf(fp, "ad-matrix-checkpoint\t%s\t%zu\n", CHECKPOINT_VERSION,
+	    file_count);
+    for (o = 0; o < out_count; ++o)
+    {
+	pipe_count = out_pipes(&outs[o], pipes, suffixes);
+	for (p = 0; p < pipe_count; ++p)
+	{
+	    pclose(*pipes[p]);
+	    snprintf(path, PATH_MAX, "%s-%s.tsv.xz", outs[o].stem, suffixes[p]);
+	    if ( stat(path, &st) != 0 )
+	    {
+		fprintf(stderr, "ad-matrix: Cannot stat %s: %s\n",
+			path, strerror(errno));
+		exit(EX_IOERR);
+	    }
+	    fprintf(fp, "file\t%s\t%jd\n", path, (intmax_t)st.st_size);
+	    *pipes[p] = open_xz_pipe(outs[o].stem, suffixes[p], true);
+	}
+    }
+    
+    fprintf(fp, "rows\t%zu\n", rows);
+    fprintf(fp, "key\t%s\t%" PRId64 "\n", row->chrom, row->pos);
+    if ( sites_fp != NULL )
+	fprintf(fp, "sites\t%jd\n", (intmax_t)ftello(sites_fp));
+    
+    fprintf(fp, "samples\t%zu\n", file_list->count);
+    for (c = 0; c < file_list->count; ++c)
+    {
+	fprintf(fp, "vcf\t%s\t%jd", file_list->filename[c],
+		(intmax_t)(file_list->fp[c] == NULL ? -1 :
+			   call_offset(file_list->fp[c])));
+	if ( file_list->block != NULL )
+	{
+	    block = &file_list->block[c];
+	    fprintf(fp, "\t%s\t%" PRId64 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32
+		    "\t%" PRIu32 "\t%" PRIu32, block->chrom, block->end,
+		    block->cell.ref, block->cell.alt, block->cell.dp,
+		    block->cell.gq, block->cell.min_dp);
+	}
+	putc('\n', fp);
+    }
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	fprintf(fp, "out\t%s\t%zu\t%zu\n", outs[o].stem,
+		outs[o].rows, outs[o].dropped_rows);
+	if ( (stats = outs[o].stats) == NULL )
+	    continue;
+	fprintf(fp, "stats\t%" PRIu64 "\n", stats->sites);
+	for (c = 0; c < outs[o].count; ++c)
+	{
+	    fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+		    "\t%.17g", stats->calls[c], stats->depth_calls[c],
+		    stats->depth_sum[c], stats->ab_calls[c], stats->ab_sum[c]);
+	    for (bin = 0; bin < STATS_DEPTH_BINS; ++bin)
+		fprintf(fp, "\t%" PRIu64,
+			stats->depth_hist[c * STATS_DEPTH_BINS + bin]);
+	    putc('\n', fp);
+	}
+    }
+    fprintf(fp, "end\n");
+    
+    if ( (fflush(fp) != 0) || (fsync(fileno(fp)) != 0) || (fclose(fp) != 0) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot write %s: %s\n",
+		temp_filename, strerror(errno));
+	exit(EX_IOERR);
+    }
+    if ( rename(temp_filename, ckpt->filename) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Cannot rename %s: %s\n",
+		temp_filename, strerror(errno));
+	exit(EX_IOERR);
+    }
+    fprintf(stderr, "Checkpoint at %s %" PRId64 ", %zu rows.\n",
+	    row->chrom, row->pos, rows);
+    ckpt->last = time(NULL);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return true if a checkpoint is due
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    checkpoint_due(checkpoint_t *ckpt)
+
+{
+    return (ckpt->interval >= 0) && (time(NULL) - ckpt->last >= ckpt->interval);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Remove the checkpoint of a completed merge
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    checkpoint_close(checkpoint_t *ckpt)
+
+{
+    if ( (unlink(ckpt->filename) != 0) && (errno != ENOENT) )
+	fprintf(stderr, "ad-matrix: Cannot remove %s: %s\n",
+		ckpt->filename, strerror(errno));
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      List the xz pipes of an output, including the --stats site
+ *      pipe, as pointers so that they can be reopened, with their
+ *      filename suffixes.  Returns the number of
+ *      pipes, at most OUT_PIPES_MAX.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  out_pipes(matrix_out_t *out, FILE **pipes[], char *suffixes[])
+
+{
+    size_t  p,
+	    count = 0;
+    
+    for (p = 0; p < out->suffix_count; ++p)
+    {
+	pipes[count] = out_pipe(out, out->suffixes[p]);
+	suffixes[count++] = out->suffixes[p];
+    }
+    if ( out->stats != NULL )
+    {
+	pipes[count] = &out->stats->site_fp;
+	suffixes[count++] = "site-stats";
+    }
+    return count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the offset of the line just read from fp, i.e. of the
+ *      current call.  fp is left where it was.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+off_t   call_offset(FILE *fp)
+
+{
+    char    buff[4096];
+    off_t   end,
+	    lo,
+	    hi;
+    size_t  len;
+    
+    end = ftello(fp);
+    
+    /* Search back from before the newline ending the call */
+    for (hi = end - 1; hi > 0; hi = lo)
+    {
+	lo = hi > (off_t)sizeof(buff) ? hi - (off_t)sizeof(buff) : 0;
+	fseeko(fp, lo, SEEK_SET);
+	for (len = fread(buff, 1, hi - lo, fp); len > 0; --len)
+	{
+	    if ( buff[len - 1] == '\n' )
+	    {
+		fseeko(fp, end, SEEK_SET);
+		return lo + len;
+	    }
+	}
+    }
+    fseeko(fp, end, SEEK_SET);
+    return 0;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Checkpoint field readers.  Any deviation from the format written
+ *      by checkpoint_write() is fatal.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    checkpoint_string(checkpoint_t *ckpt, char *buff, size_t max)
+
+{
+    size_t  len;
+    
+    if ( xt_tsv_read_field(ckpt->fp, buff, max, &len) == EOF )
+    {
+	fprintf(stderr, "ad-matrix: %s is truncated.\n", ckpt->filename);
+	exit(EX_DATAERR);
+    }
+}
+
+
+void    checkpoint_expect(checkpoint_t *ckpt, char *keyword)
+
+{
+    char    buff[CHECKPOINT_FIELD_MAX + 1];
+    
+    checkpoint_string(ckpt, buff, CHECKPOINT_FIELD_MAX);
+    if ( strcmp(buff, keyword) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Expected %s in %s, found %s.\n",
+		keyword, ckpt->filename, buff);
+	exit(EX_DATAERR);
+    }
+}
+
+
+int64_t checkpoint_int(checkpoint_t *ckpt)
+
+{
+    char    buff[CHECKPOINT_FIELD_MAX + 1],
+	    *end;
+    int64_t value;
+    
+    checkpoint_string(ckpt, buff, CHECKPOINT_FIELD_MAX);
+    value = strtoll(buff, &end, 10);
+    if ( (*end != '\0') || (end == buff) )
+    {
+	fprintf(stderr, "ad-matrix: Bad number %s in %s.\n",
+		buff, ckpt->filename);
+	exit(EX_DATAERR);
+    }
+    return value;
+}
+
+
+double  checkpoint_double(checkpoint_t *ckpt)
+
+{
+    char    buff[CHECKPOINT_FIELD_MAX + 1],
+	    *end;
+    double  value;
+    
+    checkpoint_string(ckpt, buff, CHECKPOINT_FIELD_MAX);
+    value = strtod(buff, &end);
+    if ( (*end != '\0') || (end == buff) )
+    {
+	fprintf(stderr, "ad-matrix: Bad number %s in %s.\n",
+		buff, ckpt->filename);
+	exit(EX_DATAERR);
+    }
+    return value;
+}
+
+
+void    checkpoint_mismatch(checkpoint_t *ckpt)
+
+{
+    fprintf(stderr, "ad-matrix: %s is for a different VCF list or options.\n",
+	    ckpt->filename);
+    fprintf(stderr, "Resume with the same arguments as the original run.\n");
+    exit(EX_USAGE);
+}
@@ -0,0 +1,1358 @@
+/***************************************************************************
+ *  Description:
+ *      The merge engine: opening the VCF list, selecting samples, and
+ *      merging the calls into rows with merge_open()/merge_next().
+ *      Shared by the ad-matrix command and libadmatrix.a, so nothing
+ *      here exits or uses the command's outputs.  Errors are reported
+ *      by fatal(), so that library callers get a status.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+#include <biolibc/biostring.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Read a list of VCF files from filename and open all files with
+ *      the given fopen() mode.  If opts->samples is not NULL, only the
+ *      samples it selects are kept, and those selected by
+ *      opts->exclude_samples are then removed.  With cohorts, only
+ *      samples belonging to at least one cohort are kept, and each
+ *      cohort's columns are resolved to file_list indexes.  Files not
+ *      kept are never opened.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2021-02-09  Jason Bacon Begin
+ *  2026-10-17  agent       Sample selection and cohorts, open only the
+ *                          files kept, report errors with fatal()
+ ***************************************************************************/
+
+void    open_files(char *list_filename, file_list_t *file_list, char *mode,
+		   matrix_opts_t *opts)
+
+{
+    FILE        *fp;
+    char        *temp_filename;
+    size_t      actual_len,
+		list_count,
+		c,
+		s,
+		k,
+		*kept_index;
+    bool        *selected,
+		*cohort_selected = NULL;
+    int         delim;
+    
+    if ( (fp = fopen(list_filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		list_filename, strerror(errno));
+	fatal(EX_DATAERR);
+    }
+    
+    if ( (temp_filename = malloc(PATH_MAX + 1)) == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate temp filename.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    
+    // Count VCF filenames
+    list_count = 0;
+    while ( fgets(temp_filename, PATH_MAX, fp) != NULL )
+	++list_count;
+    if ( ! opts->quiet )
+	printf("%zu VCF files.\n", list_count);
+    
+    /*
+     *  Allocate list and read VCF filenames.  count is kept to the
+     *  entries set so far, so close_files() can clean up after an error.
+     */
+    file_list->count = 0;
+    file_list->filename = (char **)calloc(list_count, sizeof(char *));
+    if ( file_list->filename == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    file_list->fp = (FILE **)calloc(list_count, sizeof(FILE *));
+    if ( file_list->fp == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    file_list->list_index = (size_t *)malloc(list_count * sizeof(size_t));
+    if ( file_list->list_index == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    file_list->layout = (format_layout_t *)calloc(list_count,
+						   sizeof(format_layout_t));
+    if ( file_list->layout == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    file_list->group = (char **)calloc(list_count, sizeof(char *));
+    if ( file_list->group == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    rewind(fp);
+    for (c = 0; c < list_count; ++c)
+    {
+	/* Filename, optional group, ignore any other columns */
+	delim = xt_tsv_read_field(fp, temp_filename, PATH_MAX, &actual_len);
+	if ( (file_list->filename[c] = strdup(temp_filename)) == NULL )
+	{
+	    fprintf(stderr,
+		    "open_files(): Error allocating filename[%zu]\n", c);
+	    fatal(EX_UNAVAILABLE);
+	}
+	file_list->count = c + 1;
+	if ( delim == '\t' )
+	{
+	    delim = xt_tsv_read_field(fp, temp_filename, PATH_MAX, &actual_len);
+	    if ( (actual_len > 0) &&
+		 ((file_list->group[c] = strdup(temp_filename)) == NULL) )
+	    {
+		fprintf(stderr,
+			"open_files(): Error allocating group[%zu]\n", c);
+		fatal(EX_UNAVAILABLE);
+	    }
+	}
+	while ( (delim != '\n') && (delim != EOF) )
+	    delim = getc(fp);
+    }
+    fclose(fp);
+    free(temp_filename);
+    
+    // Select samples
+    if ( (selected = (bool *)malloc(list_count * sizeof(bool))) == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < list_count; ++c)
+	selected[c] = (opts->samples == NULL);
+    if ( opts->samples != NULL )
+	select_samples(opts->samples, file_list->filename, NULL, list_count,
+		       selected, true);
+    if ( opts->exclude_samples != NULL )
+	select_samples(opts->exclude_samples, file_list->filename, NULL,
+		       list_count, selected, false);
+    
+    // Cohorts are drawn from the selected samples, open only their union
+    if ( opts->cohort_count > 0 )
+    {
+	cohort_selected = (bool *)calloc(opts->cohort_count * list_count,
+					 sizeof(bool));
+	if ( cohort_selected == NULL )
+	{
+	    fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+	for (k = 0; k < opts->cohort_count; ++k)
+	{
+	    select_samples(opts->cohorts[k].spec, file_list->filename, NULL,
+			   list_count, cohort_selected + k * list_count, true);
+	    for (c = 0; c < list_count; ++c)
+		cohort_selected[k * list_count + c] &= selected[c];
+	}
+	for (c = 0; c < list_count; ++c)
+	{
+	    selected[c] = false;
+	    for (k = 0; k < opts->cohort_count; ++k)
+		selected[c] |= cohort_selected[k * list_count + c];
+	}
+    }
+    
+    // Drop unselected filenames and open the rest
+    if ( (kept_index = (size_t *)malloc(list_count * sizeof(size_t))) == NULL )
+    {
+	fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    for (c = s = 0; c < list_count; ++c)
+    {
+	if ( ! selected[c] )
+	{
+	    free(file_list->filename[c]);
+	    free(file_list->group[c]);
+	    file_list->filename[c] = file_list->group[c] = NULL;
+	    continue;
+	}
+	kept_index[c] = s;
+	if ( s != c )
+	{
+	    file_list->filename[s] = file_list->filename[c];
+	    file_list->group[s] = file_list->group[c];
+	    file_list->filename[c] = file_list->group[c] = NULL;
+	}
+	file_list->list_index[s] = c + 1;
+	if ( (file_list->fp[s] = fopen(file_list->filename[s], mode)) == NULL )
+	{
+	    fprintf(stderr, "open_file_list(): Cannot open %s: %s\n",
+		    file_list->filename[s], strerror(errno));
+	    free(cohort_selected);
+	    free(kept_index);
+	    free(selected);
+	    fatal(EX_UNAVAILABLE);   // FIXME: Tailor to mode?
+	}
+	++s;
+    }        
+    file_list->count = s;
+    if ( file_list->count == 0 )
+    {
+	fprintf(stderr, "ad-matrix: No samples selected.\n");
+	fatal(EX_USAGE);
+    }
+    
+    for (k = 0; k < opts->cohort_count; ++k)
+    {
+	opts->cohorts[k].column = (size_t *)malloc(file_list->count *
+						   sizeof(size_t));
+	if ( opts->cohorts[k].column == NULL )
+	{
+	    fprintf(stderr, "open_files(): Cannot allocate array.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+	for (c = s = 0; c < list_count; ++c)
+	    if ( cohort_selected[k * list_count + c] )
+		opts->cohorts[k].column[s++] = kept_index[c];
+	if ( (opts->cohorts[k].count = s) == 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Cohort %s has no samples.\n",
+		    opts->cohorts[k].name);
+	    fatal(EX_USAGE);
+	}
+	if ( ! opts->quiet )
+	    printf("Cohort %s: %zu samples.\n", opts->cohorts[k].name, s);
+    }
+    free(cohort_selected);
+    free(kept_index);
+    free(selected);
+    if ( opts->quiet )
+	return;
+    if ( file_list->count < list_count )
+	printf("%zu samples selected.\n", file_list->count);
+    puts("All files opened.");
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Close any files still open and free a list read by open_files()
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    close_files(file_list_t *file_list)
+
+{
+    size_t  c;
+    
+    /* Also after an error in open_files(), with entries still NULL */
+    for (c = 0; c < file_list->count; ++c)
+    {
+	if ( file_list->fp[c] != NULL )
+	    fclose(file_list->fp[c]);
+	free(file_list->filename[c]);
+	free(file_list->group[c]);
+	free(file_list->layout[c].format);
+    }
+    free(file_list->fp);
+    free(file_list->filename);
+    free(file_list->group);
+    free(file_list->layout);
+    free(file_list->list_index);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Set selected[] to value for each sample named in spec, a comma-
+ *      separated list of 1-based list indexes (N or N-M) and sample
+ *      names.  A name matches the filename as listed, its basename, or
+ *      its basename without ".vcf".  If spec is @FILE, items are read
+ *      from FILE, one per line.
+ *
+ *      Indexes are positions in filenames[], unless list_index is not
+ *      NULL, in which case they match list_index[], e.g. the VCF list
+ *      indexes of the columns of a matrix set, which --samples,
+ *      --reorder-columns, or merge-matrices may leave in any order.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    select_samples(char *spec, char *filenames[], size_t list_index[],
+		       size_t count, bool selected[], bool value)
+
+{
+    FILE    *fp;
+    char    *items,
+	    *item,
+	    *p,
+	    line[PATH_MAX + 1];
+    size_t  len;
+    
+    if ( *spec == '@' )
+    {
+	if ( (fp = fopen(spec + 1, "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    spec + 1, strerror(errno));
+	    fatal(EX_NOINPUT);
+	}
+	while ( fgets(line, PATH_MAX + 1, fp) != NULL )
+	{
+	    len = strcspn(line, "\r\n");
+	    line[len] = '\0';
+	    if ( len > 0 )
+		select_sample(line, filenames, list_index, count, selected,
+			      value);
+	}
+	fclose(fp);
+	return;
+    }
+    
+    if ( (items = strdup(spec)) == NULL )
+    {
+	fprintf(stderr, "select_samples(): Cannot allocate items.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    for (p = items; (item = strsep(&p, ",")) != NULL; )
+	if ( *item != '\0' )
+	    select_sample(item, filenames, list_index, count, selected,
+			  value);
+    free(items);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Apply one item of a sample selection.  See select_samples().
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    select_sample(char *item, char *filenames[], size_t list_index[],
+		      size_t count, bool selected[], bool value)
+
+{
+    unsigned long   first,
+		    last;
+    char            *end,
+		    *base;
+    size_t          c,
+		    len;
+    bool            found = false;
+    
+    if ( isdigit((unsigned char)*item) )
+    {
+	first = last = strtoul(item, &end, 10);
+	if ( (*end == '-') && isdigit((unsigned char)end[1]) )
+	    last = strtoul(end + 1, &end, 10);
+	if ( (*end == '\0') && (list_index != NULL) )
+	{
+	    for (c = 0; c < count; ++c)
+	    {
+		if ( (list_index[c] >= first) && (list_index[c] <= last) )
+		{
+		    selected[c] = value;
+		    found = true;
+		}
+	    }
+	    if ( ! found )
+	    {
+		fprintf(stderr, "ad-matrix: No column has list index %s.\n",
+			item);
+		fatal(EX_USAGE);
+	    }
+	    return;
+	}
+	else if ( *end == '\0' )
+	{
+	    if ( (first < 1) || (last < first) || (last > count) )
+	    {
+		fprintf(stderr, "ad-matrix: Sample index %s out of range 1-%zu.\n",
+			item, count);
+		fatal(EX_USAGE);
+	    }
+	    for (c = first - 1; c < last; ++c)
+		selected[c] = value;
+	    return;
+	}
+    }
+    
+    /* Not an index or range, so match by name */
+    for (c = 0; c < count; ++c)
+    {
+	if ( (base = strrchr(filenames[c], '/')) == NULL )
+	    base = filenames[c];
+	else
+	    ++base;
+	len = strlen(base);
+	if ( (len > 4) && (strcmp(base + len - 4, ".vcf") == 0) )
+	    len -= 4;
+	if ( (strcmp(filenames[c], item) == 0) || (strcmp(base, item) == 0) ||
+	     ((strncmp(base, item, len) == 0) && (item[len] == '\0')) )
+	{
+	    selected[c] = value;
+	    found = true;
+	}
+    }
+    if ( ! found )
+    {
+	fprintf(stderr, "ad-matrix: No sample matches \"%s\".\n", item);
+	fatal(EX_USAGE);
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the list index and name of row column s.  Columns of
+ *      existing matrices (--append, merge-matrices) follow the VCF
+ *      samples in the row, and VCF samples are numbered after them,
+ *      or as the column they replace (replace-column).
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  column_index(file_list_t *file_list, size_t s)
+
+{
+    matrix_in_t *base;
+    
+    if ( file_list->base_count == 0 )
+	return file_list->list_index[s];
+    else if ( (base = column_base(file_list, s)) != NULL )
+	return base->index_offset + base->list_index[s - base->first];
+    else
+	return file_list->index_base + file_list->list_index[s];
+}
+
+
+char    *column_name(file_list_t *file_list, size_t s)
+
+{
+    matrix_in_t *base;
+    
+    if ( (base = column_base(file_list, s)) != NULL )
+	return base->name[s - base->first];
+    else
+	return file_list->filename[s];
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Set up the merge of an opened file list: call buffers, existing
+ *      matrices (--append, merge-matrices) as more cursors supplying
+ *      the columns after the VCF samples, the row buffer, and the site
+ *      whitelist.  The first calls are read by merge_start(), unless
+ *      resuming from a checkpoint.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    merge_open(merge_t *merge, file_list_t *file_list, matrix_opts_t *opts)
+
+{
+    size_t  c;
+    
+    merge->file_list = file_list;
+    merge->opts = opts;
+    merge->skip_contig = NULL;
+    merge->shards = NULL;
+    merge->outs = NULL;
+    merge->out_count = 0;
+    merge->base_row = false;
+    
+    file_list->call = (bl_vcf_t *)malloc(file_list->count * sizeof(bl_vcf_t));
+    if ( (file_list->call == NULL) && (file_list->count != 0) )
+    {
+	fprintf(stderr, "merge_open(): Could not allocate vcf_call array.\n");
+	fprintf(stderr, "Size = %zu\n", file_list->count * sizeof(bl_vcf_t));
+	fatal(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < file_list->count; ++c)
+	bl_vcf_init(&file_list->call[c]);
+    
+    file_list->block = NULL;
+    if ( opts->gvcf && ((file_list->block = (ref_block_t *)
+	    calloc(file_list->count, sizeof(ref_block_t))) == NULL) )
+    {
+	fprintf(stderr, "merge_open(): Could not allocate ref blocks.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    
+    merge->total = file_list->count +
+		   open_bases(file_list, opts->base_stems, opts->base_count,
+			      opts->base_list_filename);
+    
+    /*
+     *  Depths for the current row are buffered so that each output can
+     *  apply its own site filter and pick out its own columns.
+     */
+    row_init(&merge->row, merge->total);
+    for (c = file_list->count; c < merge->total; ++c)
+	merge->row.alt[c] = DEPTH_MISSING;
+    
+    merge->sites_fp = NULL;
+    if ( (opts->sites_filename != NULL) &&
+	 ((merge->sites_fp = fopen(opts->sites_filename, "r")) == NULL) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		opts->sites_filename, strerror(errno));
+	fatal(EX_NOINPUT);
+    }
+    
+    /* Whitelisted sites are output unconditionally */
+    merge->min_calls = merge->sites_fp == NULL ? opts->min_calls : 0;
+    file_list->open_count = file_list->count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the first call from each sample, and skip to the start of
+ *      a planned shard
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    merge_start(merge_t *merge)
+
+{
+    file_list_t *file_list = merge->file_list;
+    region_t    *region = merge->opts->region;
+    size_t      c;
+    
+    if ( ! merge->opts->quiet )
+	puts("Reading first call from each sample...");
+    for (c = 0; c < file_list->count; ++c)
+    {
+	if ( bl_vcf_read_ss_call(&file_list->call[c], file_list->fp[c],
+		BL_VCF_FIELD_ALL) == BL_READ_OK )
+	{
+#ifdef DEBUG
+	    debug_call(file_list, c, stderr);
+#endif
+	}
+	else
+	{
+	    fprintf(stderr,
+		    "merge_start(): Failed to read VCF call from %s.\n",
+		    file_list->filename[c]);
+	    fatal(EX_DATAERR);
+	}
+    }
+    if ( ! merge->opts->quiet )
+	puts("First calls read.");
+    
+    /* A planned shard starts partway, found as with --sites */
+    if ( (region != NULL) && (*region->start_chrom != '\0') )
+	for (c = 0; c < file_list->count; ++c)
+	    if ( file_list->fp[c] != NULL )
+		skip_to_site(file_list, c, region->start_chrom,
+			     region->start_pos);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge the next row into merge->row.  Returns false when done.
+ *
+ *      The row is at the lowest chromosome/position among the current
+ *      calls, or at the next whitelisted site.  Samples without a call
+ *      there get DEPTH_MISSING.  The next call is read for each sample
+ *      that was output, so the row is valid until the next call.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    merge_next(merge_t *merge)
+
+{
+    file_list_t *file_list = merge->file_list;
+    matrix_opts_t   *opts = merge->opts;
+    row_t       *row = &merge->row;
+    size_t      c;
+    bool        have_key;
+    int         cmp;
+    
+    /*
+     *  With a whitelist, keep going after every sample hits EOF, since
+     *  the remaining sites still get (missing) rows.
+     */
+    while ( (merge->sites_fp != NULL) || (file_list->open_count > 0) ||
+	    bases_have_rows(file_list) )
+    {
+	if ( merge->sites_fp != NULL )
+	{
+	    /*
+	     *  The whitelist drives the merge.  Every site gets a row,
+	     *  even if no sample has a call there.
+	     */
+	    if ( ! next_site(merge->sites_fp, opts->sites_filename,
+			     row->chrom, &row->pos) )
+		return false;
+	    for (c = 0; c < file_list->count; ++c)
+		if ( file_list->fp[c] != NULL )
+		    skip_to_site(file_list, c, row->chrom, row->pos);
+	}
+	else
+	{
+	    if ( (have_key = (file_list->open_count > 0)) )
+		low_key(file_list, row->chrom, &row->pos);
+	    bases_low_key(file_list, row, have_key);
+	    
+	    /* Contigs with a reusable shard are skipped */
+	    if ( (merge->skip_contig != NULL) &&
+		 merge->skip_contig(merge, row->chrom) )
+		continue;
+	}
+	
+	/* Planned shards end where the next begins */
+	if ( opts->region != NULL )
+	{
+	    if ( (cmp = region_cmp(opts->region, row->chrom, row->pos)) > 0 )
+		return false;
+	    else if ( cmp < 0 )
+		continue;   // Whitelisted site before the shard
+	}
+	
+	/* Collect row for low pos, read next call for represented samples */
+	collect_row(file_list, row, &opts->mask);
+	merge->base_row = collect_bases(file_list, row);
+	return true;
+    }
+    return false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Release everything merge_open() set up
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    merge_close(merge_t *merge)
+
+{
+    file_list_t *file_list = merge->file_list;
+    size_t      c;
+    
+    if ( merge->sites_fp != NULL )
+	fclose(merge->sites_fp);
+    close_bases(file_list);
+    row_free(&merge->row);
+    for (c = 0; (file_list->call != NULL) && (c < file_list->count); ++c)
+	bl_vcf_free(&file_list->call[c]);
+    free(file_list->call);
+    free(file_list->block);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Find the lowest chrom/pos among the current calls of all open
+ *      samples.  chrom must have room for CHROM_MAX_CHARS + 1 chars.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    low_key(file_list_t *file_list, char *chrom, int64_t *pos)
+
+{
+    size_t  c;
+    int     chr_cmp;
+    char    *low_chrom;
+    int64_t low_pos;
+    
+    /* Skip over finished sample files */
+    for (c = 0; file_list->fp[c] == NULL; ++c)
+	;
+    
+    /* Assume first sample has lowest position than scan the rest */
+    low_pos = BL_VCF_POS(&file_list->call[c]);
+    low_chrom = BL_VCF_CHROM(&file_list->call[c]);
+    for (c = c + 1; c < file_list->count; ++c)
+    {
+	chr_cmp = bl_chrom_name_cmp(BL_VCF_CHROM(&file_list->call[c]),
+				    low_chrom);
+	if ( (file_list->fp[c] != NULL) && ((chr_cmp < 0) ||
+		((chr_cmp == 0) &&
+		 (BL_VCF_POS(&file_list->call[c]) < low_pos))) )
+	{
+	    low_pos = BL_VCF_POS(&file_list->call[c]);
+	    low_chrom = BL_VCF_CHROM(&file_list->call[c]);
+	}
+    }
+    
+    /*
+     *  low_chrom points into a call buffer that is overwritten by
+     *  collect_row(), so keep a copy.  Only changes once per chromosome.
+     */
+    if ( strcmp(chrom, low_chrom) != 0 )
+	snprintf(chrom, CHROM_MAX_CHARS + 1, "%s", low_chrom);
+    *pos = low_pos;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next site from a whitelist into chrom/pos, which must
+ *      hold the previous site (or "" for the first).  Returns false at
+ *      EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    next_site(FILE *sites_fp, char *sites_filename,
+		  char *chrom, int64_t *pos)
+
+{
+    char    site_chrom[CHROM_MAX_CHARS + 1];
+    int64_t site_pos;
+    int     status;
+    
+    status = read_key(sites_fp, site_chrom, CHROM_MAX_CHARS, &site_pos);
+    if ( status == BL_READ_EOF )
+	return false;
+    else if ( status != BL_READ_OK )
+    {
+	fprintf(stderr, "ad-matrix: Bad site in %s after %s %" PRId64 ".\n",
+		sites_filename, chrom, *pos);
+	fatal(EX_DATAERR);
+    }
+    if ( (*chrom != '\0') && (key_cmp(site_chrom, site_pos, chrom, *pos) <= 0) )
+    {
+	fprintf(stderr, "ad-matrix: %s is not sorted: %s %" PRId64
+		" follows %s %" PRId64 ".\n", sites_filename,
+		site_chrom, site_pos, chrom, *pos);
+	fatal(EX_DATAERR);
+    }
+    strcpy(chrom, site_chrom);
+    *pos = site_pos;
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Allocate the depth arrays of a row for count samples
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    row_init(row_t *row, size_t count)
+
+{
+    *row->chrom = '\0';
+    row->pos = 0;
+    row->ref = (depth_t *)malloc(count * sizeof(depth_t));
+    row->alt = (depth_t *)malloc(count * sizeof(depth_t));
+    row->ref_alt = (depth_t *)malloc(count * sizeof(depth_t));
+    if ( (row->ref == NULL) || (row->alt == NULL) || (row->ref_alt == NULL) )
+    {
+	fprintf(stderr, "row_init(): Could not allocate row arrays.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+}
+
+
+void    row_free(row_t *row)
+
+{
+    free(row->ref);
+    free(row->alt);
+    free(row->ref_alt);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Fill the depth arrays for the row at row->chrom/row->pos and
+ *      advance every sample that has a call there.  With --gvcf, samples
+ *      without a call there get the depth of a reference block covering
+ *      the site, if any.  Returns the number of unmasked calls.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  collect_row(file_list_t *file_list, row_t *row, cell_mask_t *mask)
+
+{
+    size_t      c,
+		called = 0;
+    bl_vcf_t    *call;
+    cell_t      cell;
+    bool        masking = mask_enabled(mask);
+    
+    for (c = 0; c < file_list->count; ++c)
+    {
+	call = &file_list->call[c];
+	if ( (file_list->fp[c] != NULL) && (BL_VCF_POS(call) == row->pos) &&
+	     (strcmp(BL_VCF_CHROM(call), row->chrom) == 0) )
+	{
+	    update_format_layout(&file_list->layout[c], BL_VCF_FORMAT(call));
+	    parse_call(BL_VCF_SINGLE_SAMPLE(call), &file_list->layout[c], &cell);
+	    if ( file_list->block != NULL )
+		take_ref_block(file_list, c, &cell);
+	    next_call(file_list, c);
+	}
+	else if ( (file_list->block != NULL) &&
+		  in_ref_block(&file_list->block[c], row->chrom, row->pos) )
+	    cell = file_list->block[c].cell;
+	else
+	{
+	    row->ref[c] = row->alt[c] = row->ref_alt[c] = DEPTH_MISSING;
+	    continue;
+	}
+	
+	if ( masking && cell_masked(&cell, mask) )
+	    row->ref[c] = row->alt[c] = row->ref_alt[c] = DEPTH_MISSING;
+	else
+	{
+	    row->ref[c] = cell.ref;
+	    row->alt[c] = cell.alt;
+	    row->ref_alt[c] = cell.dp;
+	    ++called;
+	}
+    }
+    return called;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next call for sample c.  Close the file and return
+ *      false at EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    next_call(file_list_t *file_list, size_t c)
+
+{
+    if ( bl_vcf_read_ss_call(&file_list->call[c], file_list->fp[c],
+	    BL_VCF_FIELD_ALL) == BL_READ_EOF )
+    {
+	fprintf(stderr, "Closing %zu %s\n", c, file_list->filename[c]);
+	fclose(file_list->fp[c]);
+	file_list->fp[c] = NULL;
+	--file_list->open_count;
+	return false;
+    }
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Advance sample c to its first call at or after chrom/pos.
+ *
+ *      Whitelists are often much sparser than the VCFs, so rather than
+ *      parsing every call in between, peek at the CHROM and POS of the
+ *      next few lines, then gallop forward with exponentially growing
+ *      seeks until we pass the site and bisect back to it.  Only the
+ *      call finally landed on is fully parsed.  Dense whitelists are
+ *      handled by the sequential peeks and never seek.  Streams that
+ *      cannot seek (pipes) are read sequentially.
+ *
+ *      With --gvcf, the last call before the site may be a reference
+ *      block covering it, so the start of the last line seen below the
+ *      site is kept in prev, and only that line is parsed in addition.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    skip_to_site(file_list_t *file_list, size_t c,
+		     char *chrom, int64_t pos)
+
+{
+    FILE    *fp = file_list->fp[c];
+    bl_vcf_t    *call = &file_list->call[c];
+    char    key_chrom[CHROM_MAX_CHARS + 1];
+    int64_t key_pos;
+    off_t   lo, hi, mid, line_start, step,
+	    prev = -1;
+    int     peeks;
+    
+    if ( key_cmp(BL_VCF_CHROM(call), BL_VCF_POS(call), chrom, pos) >= 0 )
+	return;
+    
+    if ( (lo = ftello(fp)) == -1 )
+    {
+	do
+	{
+	    if ( file_list->block != NULL )
+		skip_ref_block(file_list, c, chrom, pos);
+	}   while ( next_call(file_list, c) &&
+		    (key_cmp(BL_VCF_CHROM(call), BL_VCF_POS(call),
+			     chrom, pos) < 0) );
+	return;
+    }
+    
+    /*
+     *  Invariant from here on: lo is the start of a line and every line
+     *  before it has a key below the site.
+     */
+    for (peeks = 0; peeks < GALLOP_LINEAR_PEEKS; ++peeks)
+    {
+	if ( (read_key(fp, key_chrom, CHROM_MAX_CHARS, &key_pos) != BL_READ_OK)
+	     || (key_cmp(key_chrom, key_pos, chrom, pos) >= 0) )
+	{
+	    land_on_site(file_list, c, prev, lo, chrom, pos);
+	    return;
+	}
+	prev = lo;
+	lo = ftello(fp);
+    }
+    
+    /* Gallop until we land on or past the site, or hit EOF */
+    for (step = GALLOP_MIN_STEP; ; step *= 2)
+    {
+	if ( (line_start = sync_line(fp, lo + step)) == -1 )
+	{
+	    hi = lo + step;
+	    break;
+	}
+	if ( (read_key(fp, key_chrom, CHROM_MAX_CHARS, &key_pos) != BL_READ_OK)
+	     || (key_cmp(key_chrom, key_pos, chrom, pos) >= 0) )
+	{
+	    hi = line_start;
+	    break;
+	}
+	prev = line_start;
+	lo = ftello(fp);
+    }
+    
+    /* Bisect back to within a few buffers of the site */
+    while ( hi - lo > GALLOP_SCAN_BYTES )
+    {
+	mid = lo + (hi - lo) / 2;
+	line_start = sync_line(fp, mid);
+	if ( (line_start == -1) || (line_start >= hi) )
+	    hi = mid;
+	else if ( (read_key(fp, key_chrom, CHROM_MAX_CHARS, &key_pos)
+		    != BL_READ_OK) ||
+		  (key_cmp(key_chrom, key_pos, chrom, pos) >= 0) )
+	    hi = line_start;
+	else
+	{
+	    prev = line_start;
+	    lo = ftello(fp);
+	}
+    }
+    
+    /* Linear scan for the first line at or after the site */
+    fseeko(fp, lo, SEEK_SET);
+    while ( true )
+    {
+	line_start = ftello(fp);
+	if ( (read_key(fp, key_chrom, CHROM_MAX_CHARS, &key_pos)
+		!= BL_READ_OK) ||
+	     (key_cmp(key_chrom, key_pos, chrom, pos) >= 0) )
+	    break;
+	prev = line_start;
+    }
+    land_on_site(file_list, c, prev, line_start, chrom, pos);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Finish skip_to_site(): read the call starting at line_start, the
+ *      first at or after chrom/pos.  With --gvcf, first check the last
+ *      call before it for a reference block covering the site.  That is
+ *      the line at prev, or the current call if prev is -1.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    land_on_site(file_list_t *file_list, size_t c, off_t prev,
+		     off_t line_start, char *chrom, int64_t pos)
+
+{
+    FILE    *fp = file_list->fp[c];
+    
+    if ( file_list->block != NULL )
+    {
+	if ( prev != -1 )
+	{
+	    fseeko(fp, prev, SEEK_SET);
+	    if ( ! next_call(file_list, c) )
+		return;
+	}
+	skip_ref_block(file_list, c, chrom, pos);
+    }
+    fseeko(fp, line_start, SEEK_SET);
+    next_call(file_list, c);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Seek to the first line starting at or after offset.  Returns the
+ *      offset of the line, or -1 if there is none.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+off_t   sync_line(FILE *fp, off_t offset)
+
+{
+    int     ch;
+    
+    if ( offset == 0 )
+    {
+	rewind(fp);
+	return 0;
+    }
+    
+    /* Back up one so that we stay put if offset is already a line start */
+    if ( fseeko(fp, offset - 1, SEEK_SET) != 0 )
+	return -1;
+    while ( ((ch = getc(fp)) != '\n') && (ch != EOF) )
+	;
+    if ( (ch == EOF) || ((ch = getc(fp)) == EOF) )
+	return -1;
+    ungetc(ch, fp);
+    return ftello(fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read CHROM and POS from the start of a line and discard the rest.
+ *      Used to peek at VCF calls without parsing them, and to read site
+ *      lists.  Header and comment lines are skipped.
+ *
+ *  Returns:
+ *      BL_READ_OK, BL_READ_EOF, or BL_READ_TRUNCATED for a malformed line
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     read_key(FILE *fp, char *chrom, size_t chrom_max, int64_t *pos)
+
+{
+    int     ch;
+    size_t  len;
+    
+    while ( (ch = getc(fp)) == '#' )
+	while ( ((ch = getc(fp)) != '\n') && (ch != EOF) )
+	    ;
+    if ( ch == EOF )
+	return BL_READ_EOF;
+    ungetc(ch, fp);
+    
+    if ( xt_tsv_read_field(fp, chrom, chrom_max, &len) != '\t' )
+	return BL_READ_TRUNCATED;
+    
+    *pos = 0;
+    while ( isdigit(ch = getc(fp)) )
+	*pos = *pos * 10 + ch - '0';
+    while ( (ch != '\n') && (ch != EOF) )
+	ch = getc(fp);
+    return BL_READ_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Compare two chrom/pos keys in VCF sort order
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     key_cmp(char *chrom1, int64_t pos1, char *chrom2, int64_t pos2)
+
+{
+    int     chr_cmp;
+    
+    if ( (chr_cmp = bl_chrom_name_cmp(chrom1, chrom2)) != 0 )
+	return chr_cmp;
+    return pos1 < pos2 ? -1 : pos1 > pos2;
+}
+
+
+#ifdef DEBUG
+void    debug_call(file_list_t *file_list, size_t c, FILE *fp)
+
+{
+    if ( file_list->fp[c] != NULL )
+	fprintf(fp, "%zu %s %s %" PRId64 " %s\n",
+		c, file_list->filename[c],
+		BL_VCF_CHROM(&file_list->call[c]),
+		BL_VCF_POS(&file_list->call[c]),
+		BL_VCF_SINGLE_SAMPLE(&file_list->call[c]));
+    else
+	fprintf(fp, "%zu %s EOF\n", c, file_list->filename[c]);
+}
+#endif
+
+
+/***************************************************************************
+ *  Description:
+ *      Convert a depth string to depth_t.  Anything that is not a
+ *      number, such as ".", is returned as DEPTH_MISSING.  *end is set
+ *      to the first character not converted, as with strtoul().
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+depth_t parse_depth(char *str, char **end)
+
+{
+    unsigned long   depth;
+    
+    if ( isdigit((unsigned char)*str) )
+    {
+	depth = strtoul(str, end, 10);
+	return depth >= DEPTH_MISSING ? DEPTH_MISSING - 1 : depth;
+    }
+    *end = str;
+    return DEPTH_MISSING;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Locate the AD, DP, GQ, and MIN_DP keys in a FORMAT string.  The layout
+ *      is cached per sample, so this is only a strcmp() unless the
+ *      FORMAT changes from the previous call.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    update_format_layout(format_layout_t *layout, char *format)
+
+{
+    char    *key;
+    size_t  len;
+    int     field;
+    
+    if ( (layout->format != NULL) && (strcmp(layout->format, format) == 0) )
+	return;
+    
+    free(layout->format);
+    if ( (layout->format = strdup(format)) == NULL )
+    {
+	fprintf(stderr, "update_format_layout(): Cannot allocate format.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    layout->ad = layout->dp = layout->gq = layout->min_dp = -1;
+    for (field = 0, key = format; *key != '\0'; ++field)
+    {
+	len = strcspn(key, ":");
+	if ( len == 2 )
+	{
+	    if ( memcmp(key, "AD", 2) == 0 )
+		layout->ad = field;
+	    else if ( memcmp(key, "DP", 2) == 0 )
+		layout->dp = field;
+	    else if ( memcmp(key, "GQ", 2) == 0 )
+		layout->gq = field;
+	}
+	else if ( (len == 6) && (memcmp(key, "MIN_DP", 6) == 0) )
+	    layout->min_dp = field;
+	key += len;
+	if ( *key == ':' )
+	    ++key;
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Extract ref depth, total alt depth, DP, and GQ from a single
+ *      sample field.  If DP is not present, it is taken as the sum of
+ *      the AD values.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    parse_call(char *sample, format_layout_t *layout, cell_t *cell)
+
+{
+    char    *p,
+	    *end;
+    depth_t depth;
+    int     field;
+    
+    cell->ref = cell->alt = cell->dp = cell->gq = cell->min_dp = DEPTH_MISSING;
+    for (field = 0, p = sample; ; ++field)
+    {
+	if ( field == layout->ad )
+	{
+	    cell->ref = parse_depth(p, &end);
+	    if ( cell->ref != DEPTH_MISSING )
+	    {
+		/* Sum depths of all alt alleles */
+		cell->alt = 0;
+		while ( *end == ',' )
+		{
+		    if ( (depth = parse_depth(end + 1, &end)) == DEPTH_MISSING )
+		    {
+			cell->alt = DEPTH_MISSING;
+			break;
+		    }
+		    cell->alt += depth;
+		}
+	    }
+	}
+	else if ( field == layout->dp )
+	    cell->dp = parse_depth(p, &end);
+	else if ( field == layout->gq )
+	    cell->gq = parse_depth(p, &end);
+	else if ( field == layout->min_dp )
+	    cell->min_dp = parse_depth(p, &end);
+	
+	p += strcspn(p, ":");
+	if ( *p == '\0' )
+	    break;
+	++p;
+    }
+    
+    if ( (cell->dp == DEPTH_MISSING) && (cell->ref != DEPTH_MISSING) &&
+	 (cell->alt != DEPTH_MISSING) )
+	cell->dp = cell->ref + cell->alt;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return true if any cell mask is set
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    mask_enabled(cell_mask_t *mask)
+
+{
+    return (mask->min_dp != 0) || (mask->min_gq != 0) ||
+	   (mask->min_ref_alt != 0) || (mask->max_ref_alt != DEPTH_MISSING);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return true if a call fails any enabled mask.  Calls lacking a
+ *      value needed by a mask are masked.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    cell_masked(cell_t *cell, cell_mask_t *mask)
+
+{
+    depth_t ref_alt;
+    
+    if ( (mask->min_dp != 0) &&
+	 ((cell->dp == DEPTH_MISSING) || (cell->dp < mask->min_dp)) )
+	return true;
+    if ( (mask->min_gq != 0) &&
+	 ((cell->gq == DEPTH_MISSING) || (cell->gq < mask->min_gq)) )
+	return true;
+    if ( (mask->min_ref_alt != 0) || (mask->max_ref_alt != DEPTH_MISSING) )
+    {
+	if ( (cell->ref == DEPTH_MISSING) || (cell->alt == DEPTH_MISSING) )
+	    return true;
+	ref_alt = cell->ref + cell->alt;
+	if ( (ref_alt < mask->min_ref_alt) || (ref_alt > mask->max_ref_alt) )
+	    return true;
+    }
+    return false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Compare chrom/pos to a shard: < 0 before it, 0 in it, > 0 after
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     region_cmp(region_t *region, char *chrom, int64_t pos)
+
+{
+    if ( (*region->start_chrom != '\0') &&
+	 (key_cmp(chrom, pos, region->start_chrom, region->start_pos) < 0) )
+	return -1;
+    if ( (*region->end_chrom != '\0') &&
+	 (key_cmp(chrom, pos, region->end_chrom, region->end_pos) >= 0) )
+	return 1;
+    return 0;
+}
@@ -0,0 +1,151 @@
+/***************************************************************************
+ *  Description:
+ *      gVCF reference block expansion.  A record with END= in INFO and
+ *      no real ALT allele (<NON_REF>, <*>, or .) covers POS through END.
+ *      Each sample keeps its active block, so any merged site inside it
+ *      gets the block's depth instead of ".".
+ *
+ *      Block depth is MIN_DP if present, else DP.  If the block has no
+ *      AD, ref depth is taken to be the block depth and alt depth 0.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Return END of a reference block record, or 0 if call is not a
+ *      reference block.  Only looks at ALT and INFO, so it is cheap
+ *      enough to run on records that are otherwise skipped.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int64_t ref_block_end(bl_vcf_t *call)
+
+{
+    char    *alt = BL_VCF_ALT(call),
+	    *p,
+	    *end;
+    int64_t block_end;
+    
+    if ( (strcmp(alt, "<NON_REF>") != 0) && (strcmp(alt, "<*>") != 0) &&
+	 (strcmp(alt, ".") != 0) )
+	return 0;
+    
+    for (p = BL_VCF_INFO(call); *p != '\0'; )
+    {
+	if ( memcmp(p, "END=", 4) == 0 )
+	{
+	    block_end = strtoll(p + 4, &end, 10);
+	    if ( ((*end != ';') && (*end != '\0')) ||
+		 (block_end < BL_VCF_POS(call)) )
+	    {
+		fprintf(stderr, "ad-matrix: Bad END in %s %" PRId64 ".\n",
+			BL_VCF_CHROM(call), BL_VCF_POS(call));
+		fatal(EX_DATAERR);
+	    }
+	    return block_end;
+	}
+	p += strcspn(p, ";");
+	if ( *p == ';' )
+	    ++p;
+    }
+    return 0;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Called with the parsed cell of sample c's current call.  If the
+ *      call is a reference block, fill in its block depths and make it
+ *      the sample's active block.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    take_ref_block(file_list_t *file_list, size_t c, cell_t *cell)
+
+{
+    bl_vcf_t    *call = &file_list->call[c];
+    ref_block_t *block = &file_list->block[c];
+    int64_t     end;
+    
+    if ( (end = ref_block_end(call)) == 0 )
+	return;
+    
+    if ( cell->min_dp != DEPTH_MISSING )
+	cell->dp = cell->min_dp;
+    if ( (cell->ref == DEPTH_MISSING) && (cell->dp != DEPTH_MISSING) )
+    {
+	cell->ref = cell->dp;
+	cell->alt = 0;
+    }
+    
+    if ( strcmp(block->chrom, BL_VCF_CHROM(call)) != 0 )
+	snprintf(block->chrom, CHROM_MAX_CHARS + 1, "%s", BL_VCF_CHROM(call));
+    block->end = end;
+    block->cell = *cell;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return true if chrom/pos is inside the active block.  Blocks only
+ *      need to be checked against the block end, since sites arrive in
+ *      order and the block's own record was at or before pos.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    in_ref_block(ref_block_t *block, char *chrom, int64_t pos)
+
+{
+    return (pos <= block->end) && (strcmp(block->chrom, chrom) == 0);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Called by skip_to_site() for a call before chrom/pos that is about
+ *      to be skipped.  If it is a reference block reaching chrom/pos,
+ *      parse it and make it the active block.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    skip_ref_block(file_list_t *file_list, size_t c,
+		       char *chrom, int64_t pos)
+
+{
+    bl_vcf_t    *call = &file_list->call[c];
+    cell_t      cell;
+    
+    if ( (ref_block_end(call) < pos) ||
+	 (strcmp(BL_VCF_CHROM(call), chrom) != 0) )
+	return;
+    update_format_layout(&file_list->layout[c], BL_VCF_FORMAT(call));
+    parse_call(BL_VCF_SINGLE_SAMPLE(call), &file_list->layout[c], &cell);
+    take_ref_block(file_list, c, &cell);
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix import: rewrite a matrix set written without --index,
+ *      e.g. by an older ad-matrix, as an indexed one, so that it can be
+ *      read with ad-matrix query without rebuilding it from the VCFs.
+ *
+ *      This is merge-matrices of a single input with --index.  The
+ *      input's ref and ref+alt matrices are decompressed by separate xz
+ *      processes while their rows are paired and parsed, and the output
+ *      is compressed by two more, so the import runs at about the speed
+ *      of xz.  Rows and columns are unchanged, so the output matrices
+ *      decompress to the same text as the input, unless the columns
+ *      are reordered with --reorder-columns (see reorder.c).
+ *
+ *      Sets from before ad-matrix wrote <stem>-columns.tsv are read
+ *      with their columns numbered in VCF list order, and named from
+ *      the original VCF list if given with --list (see matrix-in.c).
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     import_matrix(int argc, char *argv[])
+
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    int             arg;
+    bool            reorder = false;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.mask.max_ref_alt = DEPTH_MISSING;
+    opts.min_calls = 1;
+    opts.index = true;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--stats") == 0 )
+	    opts.stats = true;
+	else if ( strcmp(argv[arg], "--reorder-columns") == 0 )
+	    reorder = true;
+	else if ( (strcmp(argv[arg], "--list") == 0) && (arg + 1 < argc) )
+	    opts.base_list_filename = argv[++arg];
+	else
+	    import_usage(argv);
+    }
+    
+    if ( argc - arg != 2 )
+	import_usage(argv);
+    if ( strcmp(argv[arg], argv[arg + 1]) == 0 )
+    {
+	fprintf(stderr, "ad-matrix: Input matrix %s cannot be overwritten.\n",
+		argv[arg + 1]);
+	exit(EX_USAGE);
+    }
+    opts.base_stems = &argv[arg];
+    opts.base_count = 1;
+    if ( reorder )
+	opts.column_order = reorder_columns(argv[arg]);
+    
+    memset(&file_list, 0, sizeof(file_list));
+    build_matrix(&file_list, argv[arg + 1], &opts);
+    free(opts.column_order);
+    return EX_OK;
+}
+
+
+void    import_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s import [options] input-stem matrix-output-stem\n", argv[0]);
+    fprintf(stderr, "Rewrite the matrix set input-stem-*, written without --index, with a\n");
+    fprintf(stderr, "row-block index for ad-matrix query (see ad-matrix --index).\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --stats          Also write QC statistics (see ad-matrix --stats)\n");
+    fprintf(stderr, "  --list FILE      The VCF list input-stem was built from, to name its\n");
+    fprintf(stderr, "                   columns if it has no input-stem-columns.tsv, as written\n");
+    fprintf(stderr, "                   by older versions.  Such columns are otherwise named\n");
+    fprintf(stderr, "                   by their numbers.  Ignored if input-stem-columns.tsv\n");
+    fprintf(stderr, "                   exists.\n");
+    fprintf(stderr, "  --reorder-columns\n");
+    fprintf(stderr, "                   Order the sample columns so that samples with similar\n");
+    fprintf(stderr, "                   call presence are adjacent, which compresses better.\n");
+    fprintf(stderr, "                   The order is listed in matrix-output-stem-columns.tsv.\n");
+    fprintf(stderr, "                   With more than %d columns, each next column is the\n", REORDER_NEIGHBORS);
+    fprintf(stderr, "                   best of the %d nearest in presence-bitmap order.\n", 2 * REORDER_NEIGHBORS);
+    exit(EX_USAGE);
+}
@@ -0,0 +1,293 @@
+/***************************************************************************
+ *  Description:
+ *      --index: write a row-block index of an output, so that a region
+ *      can be read without decompressing the whole matrix (see query.c).
+ *
+ *      Rows are written in blocks of one contig and at most about
+ *      INDEX_BLOCK_CELLS cells.  Each block is a separate xz stream of
+ *      the ref and ref+alt matrices, so it can be decompressed alone,
+ *      while xz -dc still reads the whole file as before.  The streams
+ *      are ended like a checkpoint ends them, by closing the pipes and
+ *      reopening them to append.
+ *
+ *      <stem>-index.tsv has one line per block:
+ *      CHROM FIRST_POS LAST_POS ROWS REF_OFFSET REF_BYTES
+ *      REF+ALT_OFFSET REF+ALT_BYTES, offsets and sizes being those of
+ *      the block's xz streams in the matrix files, followed by the
+ *      block's zone map: CALLS (cells with a call), MAX_DEPTH (ref+alt),
+ *      MAX_ROW_CALLS, and ROW_CALLS_GE, a comma-separated list of the
+ *      most calls in a row with ref+alt >= 1, 2, 4, ... 32768.  A query
+ *      filtering rows can skip a block whose zone map rules them out,
+ *      without decompressing it.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+static char *Index_suffixes[INDEX_MATRICES] = { "ref", "ref+alt" };
+
+void    index_open(matrix_out_t *out)
+
+{
+    index_t *index;
+    char    filename[PATH_MAX + 1];
+    
+    if ( (index = (index_t *)calloc(1, sizeof(index_t))) == NULL )
+    {
+	fprintf(stderr, "index_open(): Could not allocate index.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    snprintf(filename, PATH_MAX, "%s-index.tsv", out->stem);
+    if ( (index->fp = fopen(filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    fprintf(index->fp, "#CHROM\tFIRST_POS\tLAST_POS\tROWS"
+	    "\tREF_OFFSET\tREF_BYTES\tREF+ALT_OFFSET\tREF+ALT_BYTES"
+	    "\tCALLS\tMAX_DEPTH\tMAX_ROW_CALLS\tROW_CALLS_GE\n");
+    index->block_rows = out->count >= INDEX_BLOCK_CELLS ? 1 :
+			INDEX_BLOCK_CELLS / out->count;
+    out->index = index;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Note a row about to be written, first ending the block if the
+ *      row cannot go in it, and add it to the block's zone map
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    index_row(matrix_out_t *out, row_t *row)
+
+{
+    index_block_t   *block = &out->index->block;
+    size_t          c,
+		    calls = 0,
+		    at_level[ZONE_LEVELS] = { 0 };
+    depth_t         depth;
+    int             k;
+    
+    if ( (block->rows == out->index->block_rows) ||
+	 ((block->rows > 0) && (strcmp(block->chrom, row->chrom) != 0)) )
+	index_end_block(out, true);
+    if ( block->rows++ == 0 )
+    {
+	strcpy(block->chrom, row->chrom);
+	block->first_pos = row->pos;
+	block->calls = block->max_depth = block->max_row_calls = 0;
+	memset(block->row_calls_ge, 0, sizeof(block->row_calls_ge));
+    }
+    block->last_pos = row->pos;
+    
+    /* Count calls at each depth level, then calls at or above each */
+    for (c = 0; c < out->count; ++c)
+    {
+	depth = row->ref_alt[out->column[c]];
+	if ( (depth == DEPTH_MISSING) &&
+	     (row->ref[out->column[c]] == DEPTH_MISSING) )
+	    continue;
+	++calls;
+	if ( (depth == DEPTH_MISSING) || (depth == 0) )
+	    continue;
+	if ( depth > block->max_depth )
+	    block->max_depth = depth;
+	++at_level[zone_level(depth)];
+    }
+    block->calls += calls;
+    if ( calls > block->max_row_calls )
+	block->max_row_calls = calls;
+    for (k = ZONE_LEVELS - 1; k >= 0; --k)
+    {
+	if ( k < ZONE_LEVELS - 1 )
+	    at_level[k] += at_level[k + 1];
+	if ( at_level[k] > block->row_calls_ge[k] )
+	    block->row_calls_ge[k] = at_level[k];
+    }
+}
+
+
+/* Zone map level of a depth >= 1: floor(log2(depth)), at most the last */
+int     zone_level(depth_t depth)
+
+{
+    int     k;
+    
+    for (k = 0; (k < ZONE_LEVELS - 1) && (depth >> (k + 1)) != 0; ++k)
+	;
+    return k;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      End the xz streams of the current block and write its index
+ *      line.  The next block's streams are started if reopen.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    index_end_block(matrix_out_t *out, bool reopen)
+
+{
+    index_block_t   *block = &out->index->block;
+    FILE            **fp;
+    char            path[PATH_MAX + 1];
+    struct stat     st;
+    size_t          m;
+    
+    if ( block->rows == 0 )
+	return;
+    for (m = 0; m < INDEX_MATRICES; ++m)
+    {
+	fp = out_pipe(out, Index_suffixes[m]);
+	pclose(*fp);
+	*fp = NULL;
+	snprintf(path, PATH_MAX, "%s-%s.tsv.xz", out->stem,
+		 Index_suffixes[m]);
+	if ( stat(path, &st) != 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot stat %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_IOERR);
+	}
+	block->bytes[m] = st.st_size - block->offset[m];
+	if ( reopen )
+	    *fp = open_xz_pipe(out->stem, Index_suffixes[m], true);
+    }
+    index_write(out->index->fp, block);
+    
+    for (m = 0; m < INDEX_MATRICES; ++m)
+	block->offset[m] += block->bytes[m];
+    block->rows = 0;
+}
+
+
+void    index_write(FILE *fp, index_block_t *block)
+
+{
+    size_t  m;
+    int     k;
+    
+    fprintf(fp, "%s\t%" PRId64 "\t%" PRId64 "\t%zu", block->chrom,
+	    block->first_pos, block->last_pos, block->rows);
+    for (m = 0; m < INDEX_MATRICES; ++m)
+	fprintf(fp, "\t%jd\t%jd", (intmax_t)block->offset[m],
+		(intmax_t)block->bytes[m]);
+    fprintf(fp, "\t%" PRIu64 "\t%" PRIu32 "\t%zu", block->calls,
+	    block->max_depth, block->max_row_calls);
+    for (k = 0; k < ZONE_LEVELS; ++k)
+	fprintf(fp, "%c%zu", k == 0 ? '\t' : ',', block->row_calls_ge[k]);
+    putc('\n', fp);
+}
+
+
+/* End the last block, leaving the pipes closed */
+void    index_close(matrix_out_t *out)
+
+{
+    index_end_block(out, false);
+    fclose(out->index->fp);
+    free(out->index);
+    out->index = NULL;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next block line of an index.  Returns false at EOF.
+ *      block->zone is false if the line has no zone map.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    index_read(FILE *fp, char *filename, index_block_t *block)
+
+{
+    char    line[CHROM_MAX_CHARS + (INDEX_LINE_NUMS + ZONE_LINE_NUMS +
+		 ZONE_LEVELS) * 24],
+	    *p,
+	    *field,
+	    *end;
+    int64_t nums[INDEX_LINE_NUMS + ZONE_LINE_NUMS];
+    size_t  n,
+	    m;
+    int     k;
+    
+    do
+	if ( fgets(line, sizeof(line), fp) == NULL )
+	    return false;
+    while ( *line == '#' );
+    
+    line[strcspn(line, "\n")] = '\0';
+    p = line;
+    strsep(&p, "\t");      // CHROM, left in line
+    for (n = 0; (n < INDEX_LINE_NUMS + ZONE_LINE_NUMS) && (p != NULL); ++n)
+    {
+	field = strsep(&p, "\t");
+	nums[n] = strtoll(field, &end, 10);
+	if ( (end == field) || (*end != '\0') )
+	{
+	    n = 0;  // Malformed
+	    break;
+	}
+    }
+    
+    /* Zone map levels, if the line has a zone map */
+    block->zone = (n == INDEX_LINE_NUMS + ZONE_LINE_NUMS) && (p != NULL);
+    for (k = 0; block->zone && (k < ZONE_LEVELS); ++k)
+    {
+	block->row_calls_ge[k] = strtoull(p, &end, 10);
+	if ( (end == p) || (*end != (k < ZONE_LEVELS - 1 ? ',' : '\0')) )
+	    break;
+	p = end + 1;
+    }
+    
+    if ( (block->zone ? k < ZONE_LEVELS :
+			(n != INDEX_LINE_NUMS) || (p != NULL)) ||
+	 (strlen(line) > CHROM_MAX_CHARS) )
+    {
+	fprintf(stderr, "ad-matrix: Malformed line in %s.\n", filename);
+	exit(EX_DATAERR);
+    }
+    strcpy(block->chrom, line);
+    block->first_pos = nums[0];
+    block->last_pos = nums[1];
+    block->rows = nums[2];
+    for (m = 0; m < INDEX_MATRICES; ++m)
+    {
+	block->offset[m] = nums[3 + 2 * m];
+	block->bytes[m] = nums[4 + 2 * m];
+    }
+    if ( block->zone )
+    {
+	block->calls = nums[INDEX_LINE_NUMS];
+	block->max_depth = nums[INDEX_LINE_NUMS + 1];
+	block->max_row_calls = nums[INDEX_LINE_NUMS + 2];
+    }
+    return true;
+}
@@ -0,0 +1,289 @@
+/***************************************************************************
+ *  Description:
+ *      The libadmatrix API (see admatrix.h), a row-block iterator over
+ *      the merge engine of engine.c.  The command's outputs are one
+ *      consumer of the same merge_next() rows.
+ *
+ *      The engine reports errors with fatal().  Each API function that
+ *      runs it sets Fatal_jmp, so fatal() returns the status to it
+ *      instead of exiting.  Fatal_jmp is per thread, so that iterators
+ *      used by different threads unwind to their own callers.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+#include "admatrix.h"
+
+struct admatrix_iter
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    region_t        region;
+    merge_t         merge;
+    bool            open,           // merge_open() started
+		    pending,        // merge.row not yet returned
+		    done;
+    size_t          block_rows;
+    char            chrom[CHROM_MAX_CHARS + 1];
+    int64_t         *pos;
+    depth_t         *ref,
+		    *alt,
+		    *ref_alt;
+};
+
+/* Not exported from libadmatrix.a, like the struct */
+static size_t fill_block(admatrix_t *am);
+    
+static _Thread_local jmp_buf    *Fatal_jmp = NULL;
+    
+/***************************************************************************
+ *  Description:
+ *      Report a fatal error.  Exit with status, or return it from the
+ *      library function running, if any.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+    
+void    fatal(int status)
+    
+{
+    jmp_buf *env = Fatal_jmp;
+    
+    if ( env != NULL )
+    {
+	Fatal_jmp = NULL;
+	longjmp(*env, status);
+    }
+    exit(status);
+}
+
+
+void    admatrix_opts_init(admatrix_opts_t *opts)
+
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->max_ref_alt = ADMATRIX_MISSING;
+    opts->min_calls = 1;
+    opts->block_rows = ADMATRIX_BLOCK_ROWS;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open the VCFs listed in list_filename and read the first calls.
+ *      On success, *am is set to the new iterator.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     admatrix_open(admatrix_t **am, const char *list_filename,
+		      const admatrix_opts_t *opts)
+
+{
+    admatrix_t  *iter;
+    jmp_buf     env;
+    int         status;
+    
+    *am = NULL;
+    if ( (iter = (admatrix_t *)calloc(1, sizeof(admatrix_t))) == NULL )
+	return EX_UNAVAILABLE;
+    iter->opts.mask.min_dp = opts->min_dp;
+    iter->opts.mask.min_gq = opts->min_gq;
+    iter->opts.mask.min_ref_alt = opts->min_ref_alt;
+    iter->opts.mask.max_ref_alt = opts->max_ref_alt;
+    iter->opts.min_calls = opts->min_calls;
+    iter->opts.samples = (char *)opts->samples;
+    iter->opts.exclude_samples = (char *)opts->exclude_samples;
+    iter->opts.sites_filename = (char *)opts->sites_filename;
+    iter->opts.gvcf = opts->gvcf;
+    iter->opts.quiet = true;
+    if ( (opts->start_chrom != NULL) || (opts->end_chrom != NULL) )
+    {
+	snprintf(iter->region.start_chrom, CHROM_MAX_CHARS + 1, "%s",
+		 opts->start_chrom == NULL ? "" : opts->start_chrom);
+	snprintf(iter->region.end_chrom, CHROM_MAX_CHARS + 1, "%s",
+		 opts->end_chrom == NULL ? "" : opts->end_chrom);
+	iter->region.start_pos = opts->start_pos;
+	iter->region.end_pos = opts->end_pos;
+	iter->opts.region = &iter->region;
+    }
+    iter->block_rows = opts->block_rows == 0 ? ADMATRIX_BLOCK_ROWS :
+		      opts->block_rows;
+    
+    /* Whatever was set up is released as by admatrix_close() */
+    if ( (status = setjmp(env)) != 0 )
+    {
+	admatrix_close(iter);
+	return status;
+    }
+    Fatal_jmp = &env;
+    open_files((char *)list_filename, &iter->file_list, "r", &iter->opts);
+    iter->open = true;
+    merge_open(&iter->merge, &iter->file_list, &iter->opts);
+    merge_start(&iter->merge);
+    
+    iter->pos = (int64_t *)malloc(iter->block_rows * sizeof(int64_t));
+    iter->ref = (depth_t *)malloc(iter->block_rows * iter->file_list.count *
+				 sizeof(depth_t));
+    iter->alt = (depth_t *)malloc(iter->block_rows * iter->file_list.count *
+				 sizeof(depth_t));
+    iter->ref_alt = (depth_t *)malloc(iter->block_rows * iter->file_list.count *
+				     sizeof(depth_t));
+    if ( (iter->pos == NULL) || (iter->ref == NULL) || (iter->alt == NULL) ||
+	 (iter->ref_alt == NULL) )
+    {
+	fprintf(stderr, "admatrix_open(): Could not allocate block.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    Fatal_jmp = NULL;
+    *am = iter;
+    return EX_OK;
+}
+
+
+size_t  admatrix_columns(admatrix_t *am)
+
+{
+    return am->file_list.count;
+}
+
+
+/* Sample of column c, as the VCF filename and 1-based index in the list */
+const char  *admatrix_column_name(admatrix_t *am, size_t c)
+
+{
+    return column_name(&am->file_list, c);
+}
+
+
+size_t  admatrix_column_index(admatrix_t *am, size_t c)
+
+{
+    return column_index(&am->file_list, c);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge up to block_rows more rows into block.  A block ends early
+ *      at the end of a contig.  block->rows is 0 at the end of the
+ *      merge.  Rows with fewer than min_calls unmasked calls are
+ *      dropped, unless a sites whitelist is used.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     admatrix_read_block(admatrix_t *am, admatrix_block_t *block)
+
+{
+    jmp_buf     env;
+    int         status;
+    
+    /* setjmp() alone here, so no local is live across the longjmp() */
+    if ( (status = setjmp(env)) != 0 )
+    {
+	am->done = true;
+	return status;
+    }
+    Fatal_jmp = &env;
+    block->rows = fill_block(am);
+    Fatal_jmp = NULL;
+    
+    block->chrom = am->chrom;
+    block->columns = am->file_list.count;
+    block->pos = am->pos;
+    block->ref = am->ref;
+    block->alt = am->alt;
+    block->ref_alt = am->ref_alt;
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge the rows of admatrix_read_block() into the iterator's
+ *      arrays and return how many
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+static size_t fill_block(admatrix_t *am)
+
+{
+    row_t       *row = &am->merge.row;
+    size_t      count = am->file_list.count,
+		rows = 0,
+		calls,
+		c;
+    
+    while ( (rows < am->block_rows) && ! am->done )
+    {
+	if ( ! am->pending )
+	{
+	    if ( ! merge_next(&am->merge) )
+	    {
+		am->done = true;
+		break;
+	    }
+	    for (c = calls = 0; c < count; ++c)
+		calls += (row->ref[c] != DEPTH_MISSING) ||
+			 (row->ref_alt[c] != DEPTH_MISSING);
+	    if ( calls < am->merge.min_calls )
+		continue;
+	}
+    
+	/* Keep a row on the next contig for the next block */
+	if ( (rows > 0) && (strcmp(row->chrom, am->chrom) != 0) )
+	{
+	    am->pending = true;
+	    break;
+	}
+	am->pending = false;
+	if ( rows == 0 )
+	    strcpy(am->chrom, row->chrom);
+	am->pos[rows] = row->pos;
+	memcpy(am->ref + rows * count, row->ref, count * sizeof(depth_t));
+	memcpy(am->alt + rows * count, row->alt, count * sizeof(depth_t));
+	memcpy(am->ref_alt + rows * count, row->ref_alt,
+	       count * sizeof(depth_t));
+	++rows;
+    }
+    return rows;
+}
+
+
+void    admatrix_close(admatrix_t *am)
+
+{
+    if ( am == NULL )
+	return;
+    if ( am->open )
+	merge_close(&am->merge);
+    close_files(&am->file_list);
+    free(am->pos);
+    free(am->ref);
+    free(am->alt);
+    free(am->ref_alt);
+    free(am);
+}
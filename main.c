@@ -0,0 +1,239 @@
+/***************************************************************************
+ *  Description:
+ *      Generate a matrix of allelic-depths from single-sample VCF files
+ *
+ *      Command-line front end.  The merge itself is in libadmatrix
+ *      (see admatrix.h), so that it can be embedded.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2021-02-09  Jason Bacon Begin
+ *  2026-10-17  agent       Move main() here from ad-matrix.c, add the
+ *                          options and subcommands
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     main(int argc,char *argv[])
+
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    region_t        region;
+    char            *list_filename,
+		    *matrix_filename_stem,
+		    *plan_filename = NULL;
+    size_t          shard = 0;
+    int             arg,
+		    first_arg = 1;
+    
+    if ( (argc > 1) && (strcmp(argv[1], "merge-matrices") == 0) )
+	return merge_matrices(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "replace-column") == 0) )
+	return replace_column(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "plan") == 0) )
+	return plan_shards(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "concat") == 0) )
+	return concat_shards(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "paste") == 0) )
+	return paste_matrices(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "shm-cat") == 0) )
+	return shm_cat(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "serve") == 0) )
+	return serve_cache(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "request") == 0) )
+	return serve_client(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "query") == 0) )
+	return query_matrix(argc, argv);
+    if ( (argc > 1) && (strcmp(argv[1], "import") == 0) )
+	return import_matrix(argc, argv);
+    
+    /* ad-matrix run is a plain merge, normally of one shard of a plan */
+    if ( (argc > 1) && (strcmp(argv[1], "run") == 0) )
+	first_arg = 2;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.mask.max_ref_alt = DEPTH_MISSING;
+    opts.min_calls = 1;
+    opts.shm_timeout = SHM_TIMEOUT;
+    
+    for (arg = first_arg; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--min-dp") == 0 )
+	    opts.mask.min_dp = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-gq") == 0 )
+	    opts.mask.min_gq = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-ref-alt") == 0 )
+	    opts.mask.min_ref_alt = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--max-ref-alt") == 0 )
+	    opts.mask.max_ref_alt = depth_arg(argv, ++arg);
+	else if ( (strcmp(argv[arg], "--sites") == 0) && (arg + 1 < argc) )
+	    opts.sites_filename = argv[++arg];
+	else if ( (strcmp(argv[arg], "--samples") == 0) && (arg + 1 < argc) )
+	    opts.samples = argv[++arg];
+	else if ( (strcmp(argv[arg], "--exclude-samples") == 0) &&
+		  (arg + 1 < argc) )
+	    opts.exclude_samples = argv[++arg];
+	else if ( (strcmp(argv[arg], "--cohort") == 0) && (arg + 1 < argc) )
+	    add_cohort(&opts, argv[++arg]);
+	else if ( strcmp(argv[arg], "--min-calls") == 0 )
+	    opts.min_calls = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--bin-size") == 0 )
+	    opts.bin_size = depth_arg(argv, ++arg);
+	else if ( (strcmp(argv[arg], "--bins") == 0) && (arg + 1 < argc) )
+	    opts.bins_filename = argv[++arg];
+	else if ( strcmp(argv[arg], "--stats") == 0 )
+	    opts.stats = true;
+	else if ( strcmp(argv[arg], "--gvcf") == 0 )
+	    opts.gvcf = true;
+	else if ( (strcmp(argv[arg], "--annotate") == 0) && (arg + 1 < argc) )
+	    opts.annotate_filename = argv[++arg];
+	else if ( strcmp(argv[arg], "--checkpoint") == 0 )
+	{
+	    opts.checkpoint = true;
+	    opts.checkpoint_interval = depth_arg(argv, ++arg);
+	}
+	else if ( strcmp(argv[arg], "--resume") == 0 )
+	    opts.resume = true;
+	else if ( strcmp(argv[arg], "--incremental") == 0 )
+	    opts.incremental = true;
+	else if ( (strcmp(argv[arg], "--plan") == 0) && (arg + 1 < argc) )
+	    plan_filename = argv[++arg];
+	else if ( strcmp(argv[arg], "--shard") == 0 )
+	    shard = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--procs") == 0 )
+	    opts.procs = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--index") == 0 )
+	    opts.index = true;
+	else if ( (strcmp(argv[arg], "--shm") == 0) && (arg + 1 < argc) )
+	    opts.shm_name = argv[++arg];
+	else if ( strcmp(argv[arg], "--shm-timeout") == 0 )
+	    opts.shm_timeout = depth_arg(argv, ++arg);
+	else if ( (strcmp(argv[arg], "--append") == 0) && (arg + 1 < argc) )
+	{
+	    opts.base_stems = &argv[++arg];
+	    opts.base_count = 1;
+	}
+	else if ( (strcmp(argv[arg], "--aggregate") == 0) && (arg + 1 < argc) )
+	{
+	    ++arg;
+	    if ( strcmp(argv[arg], "sum") == 0 )
+		opts.aggregate = AGGREGATE_SUM;
+	    else if ( strcmp(argv[arg], "called") == 0 )
+		opts.aggregate = AGGREGATE_CALLED;
+	    else
+		usage(argv);
+	}
+	else
+	    usage(argv);
+    }
+    
+    if ( argc - arg != 2 )
+	usage(argv);
+    if ( (opts.bin_size != 0) && (opts.bins_filename != NULL) )
+    {
+	fprintf(stderr, "ad-matrix: --bin-size and --bins are exclusive.\n");
+	exit(EX_USAGE);
+    }
+    if ( BINNING(&opts) && (opts.aggregate != AGGREGATE_NONE) )
+    {
+	fprintf(stderr, "ad-matrix: --aggregate cannot be used with binning.\n");
+	exit(EX_USAGE);
+    }
+    list_filename = argv[arg];
+    matrix_filename_stem = argv[arg + 1];
+    if ( (opts.base_count != 0) &&
+	 ((opts.cohort_count != 0) || (opts.aggregate != AGGREGATE_NONE) ||
+	  BINNING(&opts) || (opts.sites_filename != NULL)) )
+    {
+	fprintf(stderr, "ad-matrix: --append cannot be used with --cohort, "
+		"--aggregate, --sites, or binning.\n");
+	exit(EX_USAGE);
+    }
+    if ( (opts.base_count != 0) &&
+	 (strcmp(opts.base_stems[0], matrix_filename_stem) == 0) )
+    {
+	fprintf(stderr, "ad-matrix: --append matrix cannot be overwritten.\n");
+	exit(EX_USAGE);
+    }
+    if ( (opts.checkpoint || opts.resume) &&
+	 ((opts.base_count != 0) || BINNING(&opts)) )
+    {
+	fprintf(stderr, "ad-matrix: --checkpoint and --resume cannot be used "
+		"with --append or binning.\n");
+	exit(EX_USAGE);
+    }
+    if ( opts.incremental &&
+	 ((opts.base_count != 0) || BINNING(&opts) || opts.stats ||
+	  (opts.sites_filename != NULL) || opts.checkpoint || opts.resume) )
+    {
+	fprintf(stderr, "ad-matrix: --incremental cannot be used with --append, "
+		"binning, --stats, --sites,\n--checkpoint, or --resume.\n");
+	exit(EX_USAGE);
+    }
+    if ( (plan_filename == NULL) != (shard == 0) )
+    {
+	fprintf(stderr, "ad-matrix: --plan and --shard go together.\n");
+	exit(EX_USAGE);
+    }
+    if ( (plan_filename != NULL) &&
+	 ((opts.base_count != 0) || BINNING(&opts) || opts.stats ||
+	  opts.incremental) )
+    {
+	fprintf(stderr, "ad-matrix: --shard cannot be used with --append, "
+		"binning, --stats, or --incremental.\n");
+	exit(EX_USAGE);
+    }
+    if ( plan_filename != NULL )
+    {
+	read_region(&region, plan_filename, shard);
+	opts.region = &region;
+    }
+    if ( opts.procs == 1 )
+	opts.procs = 0;
+    if ( (opts.procs != 0) &&
+	 ((opts.base_count != 0) || BINNING(&opts) || opts.stats ||
+	  opts.incremental || opts.checkpoint || opts.resume ||
+	  (plan_filename != NULL)) )
+    {
+	fprintf(stderr, "ad-matrix: --procs cannot be used with --append, "
+		"binning, --stats, --incremental,\ncheckpoints, or --shard.\n");
+	exit(EX_USAGE);
+    }
+    if ( (opts.shm_name != NULL) &&
+	 ((opts.cohort_count != 0) || (opts.aggregate != AGGREGATE_NONE) ||
+	  BINNING(&opts) || opts.incremental || opts.resume ||
+	  (opts.procs != 0)) )
+    {
+	fprintf(stderr, "ad-matrix: --shm cannot be used with --cohort, "
+		"--aggregate, binning,\n--incremental, --resume, or --procs.\n");
+	exit(EX_USAGE);
+    }
+    if ( opts.index &&
+	 ((opts.aggregate != AGGREGATE_NONE) || BINNING(&opts) ||
+	  opts.incremental || opts.checkpoint || opts.resume ||
+	  (opts.procs != 0)) )
+    {
+	fprintf(stderr, "ad-matrix: --index cannot be used with --aggregate, "
+		"binning, --incremental,\ncheckpoints, or --procs.\n");
+	exit(EX_USAGE);
+    }
+    
+    open_files(list_filename, &file_list, "r", &opts);
+    if ( opts.procs != 0 )
+	run_procs(&file_list, matrix_filename_stem, &opts);
+    else
+	build_matrix(&file_list, matrix_filename_stem, &opts);
+    return EX_OK;
+}
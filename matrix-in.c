@@ -0,0 +1,586 @@
+/***************************************************************************
+ *  Description:
+ *      Read back an existing matrix set (<stem>-ref.tsv.xz,
+ *      <stem>-ref+alt.tsv.xz, and <stem>-columns.tsv) one row at a time,
+ *      so that it can be merged with new VCFs like another cursor.
+ *
+ *      Sets written by older versions of ad-matrix have no columns
+ *      file.  Their columns are the VCF list in order, so they are
+ *      numbered 1 to the width of the first row, and named from the
+ *      VCF list if one is given, otherwise by their numbers.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Open a matrix set, load its column list, and read the first row
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    matrix_in_open(matrix_in_t *in, char *stem, char *list_filename)
+
+{
+    matrix_in_columns(in, stem, list_filename);
+    in->ref = (depth_t *)malloc(in->count * sizeof(depth_t));
+    in->ref_alt = (depth_t *)malloc(in->count * sizeof(depth_t));
+    if ( (in->ref == NULL) || (in->ref_alt == NULL) )
+    {
+	fprintf(stderr, "matrix_in_open(): Could not allocate row.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    in->ref_fp = open_xz_reader(stem, "ref");
+    in->ref_alt_fp = open_xz_reader(stem, "ref+alt");
+    matrix_in_read(in);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Load the column list of a matrix set from <stem>-columns.tsv,
+ *      or if there is none, from list_filename or the first row (see
+ *      legacy_columns())
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    matrix_in_columns(matrix_in_t *in, char *stem, char *list_filename)
+
+{
+    char    filename[PATH_MAX + 1],
+	    index[32],
+	    name[PATH_MAX + 1],
+	    *end;
+    FILE    *fp;
+    size_t  len,
+	    max = 64;
+    int     delim;
+    
+    memset(in, 0, sizeof(*in));
+    in->stem = stem;
+    
+    snprintf(filename, PATH_MAX, "%s-columns.tsv", stem);
+    if ( (fp = fopen(filename, "r")) == NULL )
+    {
+	if ( errno == ENOENT )
+	{
+	    legacy_columns(in, stem, list_filename);
+	    return;
+	}
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	fatal(EX_NOINPUT);
+    }
+    in->list_index = (size_t *)malloc(max * sizeof(size_t));
+    in->name = (char **)malloc(max * sizeof(char *));
+    while ( (delim = xt_tsv_read_field(fp, index, 31, &len)) != EOF )
+    {
+	if ( in->count == max )
+	{
+	    max *= 2;
+	    in->list_index = (size_t *)realloc(in->list_index,
+					       max * sizeof(size_t));
+	    in->name = (char **)realloc(in->name, max * sizeof(char *));
+	}
+	if ( (in->list_index == NULL) || (in->name == NULL) )
+	{
+	    fprintf(stderr,
+		    "matrix_in_columns(): Could not allocate columns.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+	in->list_index[in->count] = strtoul(index, &end, 10);
+	if ( (delim != '\t') || (*end != '\0') || (len == 0) ||
+	     (xt_tsv_read_field(fp, name, PATH_MAX, &len) != '\n') )
+	{
+	    fprintf(stderr, "ad-matrix: %s is not a sample column list.\n",
+		    filename);
+	    fatal(EX_DATAERR);
+	}
+	if ( (in->name[in->count] = strdup(name)) == NULL )
+	{
+	    fprintf(stderr, "matrix_in_columns(): Could not allocate name.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+	if ( in->list_index[in->count] > in->max_index )
+	    in->max_index = in->list_index[in->count];
+	++in->count;
+    }
+    fclose(fp);
+    if ( in->count == 0 )
+    {
+	fprintf(stderr, "ad-matrix: %s is empty.\n", filename);
+	fatal(EX_DATAERR);
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Set up the column list of a matrix set with no columns file.
+ *      The columns are the VCF list of the build, in order, so column
+ *      c is list index c + 1.  It is named by the VCF filename from
+ *      list_filename, or by its number if list_filename is NULL.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    legacy_columns(matrix_in_t *in, char *stem, char *list_filename)
+
+{
+    FILE    *fp;
+    char    name[PATH_MAX + 1];
+    size_t  tabs = 0,
+	    len,
+	    c;
+    int     ch,
+	    delim;
+    
+    /* CHROM, POS, and each cell are followed by a tab */
+    fp = open_xz_reader(stem, "ref");
+    while ( ((ch = getc(fp)) != EOF) && (ch != '\n') )
+	tabs += ch == '\t';
+    pclose(fp);
+    if ( tabs < 3 )
+    {
+	fprintf(stderr, "ad-matrix: %s-columns.tsv is missing, and the first "
+		"row of %s-ref.tsv.xz has no columns.\n", stem, stem);
+	fatal(EX_DATAERR);
+    }
+    in->count = in->max_index = tabs - 2;
+    in->list_index = (size_t *)malloc(in->count * sizeof(size_t));
+    in->name = (char **)malloc(in->count * sizeof(char *));
+    if ( (in->list_index == NULL) || (in->name == NULL) )
+    {
+	fprintf(stderr, "legacy_columns(): Could not allocate columns.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    
+    fp = NULL;
+    if ( (list_filename != NULL) &&
+	 ((fp = fopen(list_filename, "r")) == NULL) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		list_filename, strerror(errno));
+	fatal(EX_NOINPUT);
+    }
+    for (c = 0; c < in->count; ++c)
+    {
+	in->list_index[c] = c + 1;
+	if ( fp == NULL )
+	    snprintf(name, PATH_MAX, "%zu", c + 1);
+	else
+	{
+	    /* Filename, optionally followed by a group (see open_files()) */
+	    delim = xt_tsv_read_field(fp, name, PATH_MAX, &len);
+	    if ( delim == '\t' )
+		while ( ((ch = getc(fp)) != EOF) && (ch != '\n') )
+		    ;
+	    else if ( delim != '\n' )
+		break;
+	}
+	if ( (in->name[c] = strdup(name)) == NULL )
+	{
+	    fprintf(stderr, "legacy_columns(): Could not allocate name.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+    }
+    if ( fp != NULL )
+    {
+	if ( (c < in->count) || (xt_tsv_read_field(fp, name, PATH_MAX,
+						   &len) != EOF) )
+	{
+	    fprintf(stderr, "ad-matrix: %s does not list the %zu samples of "
+		    "%s.\n", list_filename, in->count, stem);
+	    fatal(EX_DATAERR);
+	}
+	fclose(fp);
+    }
+    fprintf(stderr, "%s: No columns file, %zu columns numbered in order.\n",
+	    stem, in->count);
+}
+
+
+void    matrix_in_close(matrix_in_t *in)
+
+{
+    size_t  c;
+    
+    pclose(in->ref_fp);
+    pclose(in->ref_alt_fp);
+    fprintf(stderr, "%s: %zu rows read.\n", in->stem, in->rows);
+    for (c = 0; c < in->count; ++c)
+	free(in->name[c]);
+    free(in->name);
+    free(in->list_index);
+    free(in->ref);
+    free(in->ref_alt);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open a pipe from xz reading <stem>-<suffix>.tsv.xz
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+FILE    *open_xz_reader(char *stem, char *suffix)
+
+{
+    char    filename[PATH_MAX + 1],
+	    cmd[PATH_MAX + 1];
+    FILE    *fp;
+    
+    snprintf(filename, PATH_MAX, "%s-%s.tsv.xz", stem, suffix);
+    if ( access(filename, R_OK) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	fatal(EX_NOINPUT);
+    }
+    snprintf(cmd, PATH_MAX, "xz -dc %s-%s.tsv.xz", stem, suffix);
+    if ( (fp = popen(cmd, "r")) == NULL )
+    {
+	fprintf(stderr, "Cannot open %s: %s\n", cmd, strerror(errno));
+	fatal(EX_NOINPUT);
+    }
+    return fp;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next row of both matrices.  Returns false at EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    matrix_in_read(matrix_in_t *in)
+
+{
+    char    chrom[CHROM_MAX_CHARS + 1],
+	    ref_alt_chrom[CHROM_MAX_CHARS + 1];
+    int64_t pos,
+	    ref_alt_pos;
+    int     status,
+	    ref_alt_status;
+    size_t  c;
+    
+    status = read_row_key(in->ref_fp, chrom, &pos);
+    ref_alt_status = read_row_key(in->ref_alt_fp, ref_alt_chrom, &ref_alt_pos);
+    if ( (status == BL_READ_EOF) && (ref_alt_status == BL_READ_EOF) )
+    {
+	in->have_row = false;
+	return false;
+    }
+    if ( (status != BL_READ_OK) || (ref_alt_status != BL_READ_OK) ||
+	 (pos != ref_alt_pos) || (strcmp(chrom, ref_alt_chrom) != 0) )
+    {
+	fprintf(stderr, "ad-matrix: %s ref and ref+alt matrices differ "
+		"at row %zu.\n", in->stem, in->rows + 1);
+	fatal(EX_DATAERR);
+    }
+    if ( in->have_row && (key_cmp(chrom, pos, in->chrom, in->pos) <= 0) )
+    {
+	fprintf(stderr, "ad-matrix: %s is not sorted: %s %" PRId64
+		" follows %s %" PRId64 ".\n", in->stem, chrom, pos,
+		in->chrom, in->pos);
+	fatal(EX_DATAERR);
+    }
+    
+    for (c = 0; c < in->count; ++c)
+    {
+	if ( (read_depth(in->ref_fp, &in->ref[c]) != '\t') ||
+	     (read_depth(in->ref_alt_fp, &in->ref_alt[c]) != '\t') )
+	    break;
+    }
+    if ( (c < in->count) || (getc(in->ref_fp) != '\n') ||
+	 (getc(in->ref_alt_fp) != '\n') )
+    {
+	fprintf(stderr, "ad-matrix: %s row %zu does not have %zu columns.\n",
+		in->stem, in->rows + 1, in->count);
+	fatal(EX_DATAERR);
+    }
+    
+    if ( strcmp(in->chrom, chrom) != 0 )
+	strcpy(in->chrom, chrom);
+    in->pos = pos;
+    in->have_row = true;
+    ++in->rows;
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the CHROM and POS columns of a matrix row.  Returns
+ *      BL_READ_OK, BL_READ_EOF, or BL_READ_TRUNCATED.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     read_row_key(FILE *fp, char *chrom, int64_t *pos)
+
+{
+    char    pos_str[32],
+	    *end;
+    size_t  len;
+    int     delim;
+    
+    delim = xt_tsv_read_field(fp, chrom, CHROM_MAX_CHARS, &len);
+    if ( (delim == EOF) && (len == 0) )
+	return BL_READ_EOF;
+    if ( (delim != '\t') ||
+	 (xt_tsv_read_field(fp, pos_str, 31, &len) != '\t') )
+	return BL_READ_TRUNCATED;
+    *pos = strtoll(pos_str, &end, 10);
+    if ( (*end != '\0') || (len == 0) )
+	return BL_READ_TRUNCATED;
+    return BL_READ_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read one matrix cell, "." or a decimal depth.  Returns the
+ *      character following it.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     read_depth(FILE *fp, depth_t *depth)
+
+{
+    int         ch;
+    uint64_t    value = 0;
+    bool        digits = false;
+    
+    if ( (ch = getc(fp)) == '.' )
+    {
+	*depth = DEPTH_MISSING;
+	return getc(fp);
+    }
+    for (; (ch >= '0') && (ch <= '9'); ch = getc(fp))
+    {
+	value = value * 10 + ch - '0';
+	digits = true;
+    }
+    if ( ! digits )
+	return EOF;
+    *depth = value >= DEPTH_MISSING ? DEPTH_MISSING - 1 : value;
+    return ch;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      If the current matrix row is at row->chrom/row->pos, copy it to
+ *      row columns in->first .. in->first + in->count - 1 and read the
+ *      next row, otherwise mark those columns missing.  Returns true if
+ *      the matrix had the row.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    matrix_in_collect(matrix_in_t *in, row_t *row)
+
+{
+    size_t  c;
+    
+    if ( in->have_row && (in->pos == row->pos) &&
+	 (strcmp(in->chrom, row->chrom) == 0) )
+    {
+	memcpy(row->ref + in->first, in->ref, in->count * sizeof(depth_t));
+	memcpy(row->ref_alt + in->first, in->ref_alt,
+	       in->count * sizeof(depth_t));
+	matrix_in_read(in);
+	return true;
+    }
+    for (c = in->first; c < in->first + in->count; ++c)
+	row->ref[c] = row->ref_alt[c] = DEPTH_MISSING;
+    return false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open the existing matrices to be merged with the VCFs.  Their
+ *      columns follow the VCF samples in the row, in the order given,
+ *      and their list indexes are offset to follow one another, with
+ *      the VCF samples numbered last.  Returns the number of columns
+ *      added.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  open_bases(file_list_t *file_list, char *stems[], size_t count,
+		   char *list_filename)
+
+{
+    size_t      b,
+		columns = 0,
+		index_offset = 0;
+    matrix_in_t *base;
+    
+    file_list->base_count = count;
+    file_list->index_base = 0;
+    if ( count == 0 )
+    {
+	file_list->base = NULL;
+	return 0;
+    }
+    if ( (file_list->base = (matrix_in_t *)malloc(count *
+	    sizeof(matrix_in_t))) == NULL )
+    {
+	fprintf(stderr, "open_bases(): Could not allocate matrices.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    for (b = 0; b < count; ++b)
+    {
+	base = &file_list->base[b];
+	matrix_in_open(base, stems[b], list_filename);
+	base->first = file_list->count + columns;
+	base->index_offset = index_offset;
+	columns += base->count;
+	index_offset += base->max_index;
+    }
+    file_list->index_base = index_offset;
+    return columns;
+}
+
+
+void    close_bases(file_list_t *file_list)
+
+{
+    size_t  b;
+    
+    for (b = 0; b < file_list->base_count; ++b)
+	matrix_in_close(&file_list->base[b]);
+    free(file_list->base);
+    file_list->base = NULL;
+    file_list->base_count = 0;
+}
+
+
+bool    bases_have_rows(file_list_t *file_list)
+
+{
+    size_t  b;
+    
+    for (b = 0; b < file_list->base_count; ++b)
+	if ( file_list->base[b].have_row )
+	    return true;
+    return false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Lower row->chrom/row->pos to the lowest current matrix row.  If
+ *      have_key is false, row holds no key yet.  Returns true if row
+ *      holds a key afterward.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    bases_low_key(file_list_t *file_list, row_t *row, bool have_key)
+
+{
+    size_t      b;
+    matrix_in_t *base;
+    
+    for (b = 0; b < file_list->base_count; ++b)
+    {
+	base = &file_list->base[b];
+	if ( base->have_row && ( ! have_key ||
+	     (key_cmp(base->chrom, base->pos, row->chrom, row->pos) < 0)) )
+	{
+	    if ( strcmp(row->chrom, base->chrom) != 0 )
+		strcpy(row->chrom, base->chrom);
+	    row->pos = base->pos;
+	    have_key = true;
+	}
+    }
+    return have_key;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Fill the row columns of every existing matrix.  Returns true if
+ *      any of them had the row.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    collect_bases(file_list_t *file_list, row_t *row)
+
+{
+    size_t  b;
+    bool    found = false;
+    
+    for (b = 0; b < file_list->base_count; ++b)
+	found |= matrix_in_collect(&file_list->base[b], row);
+    return found;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the existing matrix supplying row column s, or NULL if s
+ *      is a VCF sample
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+matrix_in_t *column_base(file_list_t *file_list, size_t s)
+
+{
+    size_t  b;
+    
+    for (b = 0; b < file_list->base_count; ++b)
+	if ( s < file_list->base[b].first + file_list->base[b].count )
+	    return s >= file_list->base[b].first ? &file_list->base[b] : NULL;
+    return NULL;
+}
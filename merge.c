@@ -0,0 +1,80 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix merge-matrices: combine matrix sets built separately,
+ *      e.g. per sequencing batch, into one.  Rows are merged by CHROM
+ *      and POS, the sample columns of the inputs are concatenated, and
+ *      sites missing from an input are "." in its columns.
+ *
+ *      This is build_matrix() with no VCFs and every input read as an
+ *      existing matrix, as with --append.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     merge_matrices(int argc, char *argv[])
+
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    char            *matrix_filename_stem;
+    int             arg,
+		    c;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.mask.max_ref_alt = DEPTH_MISSING;
+    opts.min_calls = 1;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--stats") == 0 )
+	    opts.stats = true;
+	else if ( (strcmp(argv[arg], "--annotate") == 0) && (arg + 1 < argc) )
+	    opts.annotate_filename = argv[++arg];
+	else
+	    merge_usage(argv);
+    }
+    
+    if ( argc - arg < 3 )
+	merge_usage(argv);
+    matrix_filename_stem = argv[arg];
+    opts.base_stems = &argv[arg + 1];
+    opts.base_count = argc - arg - 1;
+    for (c = arg + 1; c < argc; ++c)
+    {
+	if ( strcmp(argv[c], matrix_filename_stem) == 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Input matrix %s cannot be overwritten.\n",
+		    argv[c]);
+	    exit(EX_USAGE);
+	}
+    }
+    
+    memset(&file_list, 0, sizeof(file_list));
+    build_matrix(&file_list, matrix_filename_stem, &opts);
+    return EX_OK;
+}
+
+
+void    merge_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s merge-matrices [options] matrix-output-stem input-stem input-stem ...\n", argv[0]);
+    fprintf(stderr, "Merge the matrix sets input-stem-*, concatenating their columns.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --stats          Also write QC statistics (see ad-matrix --stats)\n");
+    fprintf(stderr, "  --annotate FILE  Also write annotation IDs (see ad-matrix --annotate)\n");
+    exit(EX_USAGE);
+}
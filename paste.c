@@ -0,0 +1,338 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix paste: join partial matrix sets built from disjoint
+ *      sample blocks of one VCF list, e.g. ad-matrix --samples 1-500 on
+ *      one node and --samples 501-1000 on another, into one wide set.
+ *      Rows are the union of the partials' rows, merged by key, and
+ *      rows missing from a partial are filled in its columns.
+ *
+ *      Unlike merge-matrices, values are not parsed: each partial's row
+ *      is copied as text after its key, so paste runs at the speed of
+ *      xz.  Each input is decompressed by its own xz process, so the
+ *      partials are read in parallel.  Binned and annotated sets can
+ *      be pasted, as long as all partials were built with the same
+ *      options.  The columns files are concatenated unchanged, since
+ *      their list indexes are already into the common VCF list.
+ *
+ *      Aggregated sets are rejected: a group with samples in more than
+ *      one partial would get a column from each, with partial sums.
+ *      They are recognized by their columns files, which list group
+ *      names and sizes instead of list indexes.
+ *
+ *      With --gvcf, a site called only in other partials would get
+ *      reference block depths in a full run, but is filled with ".", so
+ *      gVCF partials should be built with a common --sites list.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     paste_matrices(int argc, char *argv[])
+
+{
+    static char *all_suffixes[] = { "called", "ref", "alt", "ref+alt", "annot" };
+    char        *matrix_stem,
+		*suffixes[OUT_SUFFIXES_MAX],
+		*low_chrom,
+		filename[PATH_MAX + 1];
+    partial_t   *partials,
+		*low;
+    FILE        *out_fps[OUT_SUFFIXES_MAX],
+		*columns_fp;
+    size_t      partial_count,
+		suffix_count = 0,
+		key_fields = 2,
+		rows = 0,
+		p,
+		s,
+		c;
+    int64_t     low_pos;
+    
+    if ( argc < 5 )
+	paste_usage(argv);
+    matrix_stem = argv[2];
+    partial_count = argc - 3;
+    for (p = 0; p < partial_count; ++p)
+    {
+	if ( strcmp(argv[p + 3], matrix_stem) == 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Input matrix %s cannot be overwritten.\n",
+		    matrix_stem);
+	    exit(EX_USAGE);
+	}
+    }
+    
+    /* The first partial decides which matrices there are */
+    for (s = 0; s < sizeof(all_suffixes) / sizeof(*all_suffixes); ++s)
+    {
+	snprintf(filename, PATH_MAX, "%s-%s.tsv.xz", argv[3], all_suffixes[s]);
+	if ( access(filename, R_OK) == 0 )
+	    suffixes[suffix_count++] = all_suffixes[s];
+	if ( suffix_count == OUT_SUFFIXES_MAX )
+	    break;
+    }
+    if ( (suffix_count == 0) || (strcmp(suffixes[0], "annot") == 0) )
+    {
+	fprintf(stderr, "ad-matrix: No matrices named %s-*.tsv.xz.\n", argv[3]);
+	exit(EX_NOINPUT);
+    }
+    
+    /* Binned rows are keyed by CHROM START END, and have an alt matrix */
+    for (s = 0; s < suffix_count; ++s)
+	if ( strcmp(suffixes[s], "alt") == 0 )
+	    key_fields = 3;
+    
+    partials = (partial_t *)calloc(partial_count, sizeof(partial_t));
+    if ( partials == NULL )
+    {
+	fprintf(stderr, "paste_matrices(): Could not allocate partials.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    snprintf(filename, PATH_MAX, "%s-columns.tsv", matrix_stem);
+    if ( (columns_fp = fopen(filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    for (p = 0; p < partial_count; ++p)
+    {
+	partial_open(&partials[p], argv[p + 3], suffixes, suffix_count,
+		     columns_fp);
+	partial_read(&partials[p], suffix_count, key_fields);
+    }
+    fclose(columns_fp);
+    for (s = 0; s < suffix_count; ++s)
+	out_fps[s] = open_xz_pipe(matrix_stem, suffixes[s], false);
+    
+    while ( true )
+    {
+	low = NULL;
+	for (p = 0; p < partial_count; ++p)
+	    if ( partials[p].have_row && ((low == NULL) ||
+		 (key_cmp(partials[p].chrom, partials[p].pos,
+			  low->chrom, low->pos) < 0)) )
+		low = &partials[p];
+	if ( low == NULL )
+	    break;
+	low_chrom = low->chrom;
+	low_pos = low->pos;
+    
+	for (s = 0; s < suffix_count; ++s)
+	{
+	    /* One annotation line per row, the same in every partial */
+	    if ( strcmp(suffixes[s], "annot") == 0 )
+	    {
+		fputs(low->line[s], out_fps[s]);
+		putc('\n', out_fps[s]);
+		continue;
+	    }
+	    fwrite(low->line[s], 1, low->values[s] - low->line[s], out_fps[s]);
+	    for (p = 0; p < partial_count; ++p)
+	    {
+		if ( partials[p].have_row &&
+		     (key_cmp(partials[p].chrom, partials[p].pos,
+			      low_chrom, low_pos) == 0) )
+		    fputs(partials[p].values[s], out_fps[s]);
+		else
+		    for (c = 0; c < partials[p].count; ++c)
+			fputs(".\t", out_fps[s]);
+	    }
+	    putc('\n', out_fps[s]);
+	}
+    
+	/* low is read last, since low_chrom points into it */
+	for (p = 0; p < partial_count; ++p)
+	    if ( (&partials[p] != low) && partials[p].have_row &&
+		 (key_cmp(partials[p].chrom, partials[p].pos,
+			  low_chrom, low_pos) == 0) )
+		partial_read(&partials[p], suffix_count, key_fields);
+	partial_read(low, suffix_count, key_fields);
+    
+	if ( ++rows % 100000 == 0 )
+	    fprintf(stderr, "%zu\r", rows);
+    }
+    
+    for (s = 0; s < suffix_count; ++s)
+	pclose(out_fps[s]);
+    for (p = 0; p < partial_count; ++p)
+	partial_close(&partials[p], suffix_count);
+    free(partials);
+    printf("%zu rows written to %s-*.\n", rows, matrix_stem);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open the matrices of a partial, and append its columns file to
+ *      columns_fp, counting its columns.  Each line must start with a
+ *      list index, not a group name, since groups cannot be pasted.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    partial_open(partial_t *partial, char *stem, char *suffixes[],
+		     size_t suffix_count, FILE *columns_fp)
+
+{
+    char    filename[PATH_MAX + 1],
+	    *line = NULL,
+	    *end;
+    FILE    *fp;
+    size_t  line_max = 0,
+	    s;
+    
+    partial->stem = stem;
+    snprintf(filename, PATH_MAX, "%s-columns.tsv", stem);
+    if ( (fp = fopen(filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    while ( getline(&line, &line_max, fp) != -1 )
+    {
+	strtoul(line, &end, 10);
+	if ( (end == line) || (*end != '\t') )
+	{
+	    fprintf(stderr, "ad-matrix: %s is aggregated.  Paste partials built\n"
+		    "without --aggregate, since groups may span partials.\n",
+		    stem);
+	    exit(EX_DATAERR);
+	}
+	fputs(line, columns_fp);
+	++partial->count;
+    }
+    free(line);
+    fclose(fp);
+    if ( partial->count == 0 )
+    {
+	fprintf(stderr, "ad-matrix: %s is empty.\n", filename);
+	exit(EX_DATAERR);
+    }
+    
+    for (s = 0; s < suffix_count; ++s)
+	partial->fp[s] = open_xz_reader(stem, suffixes[s]);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the next row of every matrix of a partial, and its key.
+ *      Sets have_row to false at EOF.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    partial_read(partial_t *partial, size_t suffix_count, size_t key_fields)
+
+{
+    char    *p,
+	    *end;
+    size_t  s,
+	    f,
+	    key_len = 0;
+    ssize_t len;
+    
+    for (s = 0; s < suffix_count; ++s)
+    {
+	if ( (len = getline(&partial->line[s], &partial->line_max[s],
+			    partial->fp[s])) == -1 )
+	{
+	    if ( s != 0 )
+		paste_mismatch(partial);
+	    partial->have_row = false;
+	    return false;
+	}
+	if ( partial->line[s][len - 1] == '\n' )
+	    partial->line[s][len - 1] = '\0';
+    
+	/* Values start after the key, CHROM POS or CHROM START END */
+	for (p = partial->line[s], f = 0; (f < key_fields) && (*p != '\0'); ++p)
+	    if ( *p == '\t' )
+		++f;
+	if ( f < key_fields )
+	{
+	    fprintf(stderr, "ad-matrix: Malformed row %zu in %s-*.tsv.xz.\n",
+		    partial->rows + 1, partial->stem);
+	    exit(EX_DATAERR);
+	}
+	partial->values[s] = p;
+    
+	/* Every matrix of a set has the same rows */
+	if ( s == 0 )
+	    key_len = p - partial->line[s];
+	else if ( strncmp(partial->line[s], partial->line[0], key_len) != 0 )
+	    paste_mismatch(partial);
+    }
+    
+    p = strchr(partial->line[0], '\t');
+    if ( p - partial->line[0] > CHROM_MAX_CHARS )
+    {
+	fprintf(stderr, "ad-matrix: CHROM too long in %s.\n", partial->stem);
+	exit(EX_DATAERR);
+    }
+    memcpy(partial->chrom, partial->line[0], p - partial->line[0]);
+    partial->chrom[p - partial->line[0]] = '\0';
+    partial->pos = strtoll(p + 1, &end, 10);
+    ++partial->rows;
+    partial->have_row = true;
+    return true;
+}
+
+
+void    paste_mismatch(partial_t *partial)
+
+{
+    fprintf(stderr, "ad-matrix: Matrices of %s differ at row %zu.\n",
+	    partial->stem, partial->rows + 1);
+    exit(EX_DATAERR);
+}
+
+
+void    partial_close(partial_t *partial, size_t suffix_count)
+
+{
+    size_t  s;
+    
+    for (s = 0; s < suffix_count; ++s)
+    {
+	pclose(partial->fp[s]);
+	free(partial->line[s]);
+    }
+    fprintf(stderr, "%s: %zu rows read.\n", partial->stem, partial->rows);
+}
+
+
+void    paste_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s paste matrix-output-stem partial-stem partial-stem ...\n", argv[0]);
+    fprintf(stderr, "Join matrix sets built from disjoint samples of the same VCF list, e.g. with\n");
+    fprintf(stderr, "--samples on separate nodes, side by side.  Rows are the union of the\n");
+    fprintf(stderr, "partials' rows, with \".\" for samples of a partial missing the row.\n");
+    fprintf(stderr, "All partials must be built with the same options, and without --aggregate.\n");
+    fprintf(stderr, "Build --gvcf partials with a common --sites list, so that reference blocks\n");
+    fprintf(stderr, "fill every partial's rows.\n");
+    exit(EX_USAGE);
+}
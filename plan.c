@@ -0,0 +1,788 @@
+/***************************************************************************
+ *  Description:
+ *      Multi-node runs.  ad-matrix plan splits the genome into shards of
+ *      about equal work, ad-matrix run --shard I merges one of them, and
+ *      ad-matrix concat joins the shard outputs.  Shards are ordinary
+ *      processes on any host that sees the VCFs, so no scheduler is
+ *      needed, and may run in any order.
+ *
+ *      Work is the number of VCF bytes to parse, which varies widely
+ *      along the genome, so equal-length regions are badly unbalanced.
+ *      The planner samples the CHROM and POS of a few hundred lines at
+ *      evenly spaced offsets of each VCF, which maps keys to offsets,
+ *      and places shard boundaries at quantiles of the bytes summed
+ *      over all VCFs.
+ *
+ *      A shard is the half-open key range from its start to the start
+ *      of the next.  run seeks each VCF to the start as with --sites and
+ *      stops at the end, so the shard outputs are consecutive pieces of
+ *      the full outputs.  Those are complete xz streams, so concat is
+ *      lossless.  With --index, each shard indexes its own files, and
+ *      concat rebases the offsets onto the joined files.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     plan_shards(int argc, char *argv[])
+
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    density_t       *densities;
+    plan_point_t    *bounds;
+    FILE            *fp;
+    char            *plan_filename;
+    size_t          c,
+		    s,
+		    bound_count,
+		    shard_count,
+		    samples = PLAN_SAMPLES;
+    double          total,
+		    bytes,
+		    calls,
+		    start_bytes,
+		    end_bytes;
+    int             arg;
+    
+    memset(&opts, 0, sizeof(opts));
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--samples-per-file") == 0 )
+	    samples = depth_arg(argv, ++arg);
+	else
+	    plan_usage(argv);
+    }
+    if ( (argc - arg != 3) || (samples == 0) )
+	plan_usage(argv);
+    shard_count = depth_arg(argv, arg + 1);
+    plan_filename = argv[arg + 2];
+    if ( shard_count == 0 )
+	plan_usage(argv);
+    
+    open_files(argv[arg], &file_list, "r", &opts);
+    densities = sample_densities(&file_list, samples);
+    if ( (bounds = (plan_point_t *)malloc(shard_count * sizeof(plan_point_t)))
+	 == NULL )
+    {
+	fprintf(stderr, "plan_shards(): Could not allocate boundaries.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    bound_count = plan_bounds(densities, file_list.count, shard_count, bounds);
+    total = 0;
+    for (c = 0; c < file_list.count; ++c)
+	total += density_bytes(&densities[c], NULL, 0);
+    
+    if ( (fp = fopen(plan_filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		plan_filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    fprintf(fp, "#SHARD\tSTART_CHROM\tSTART_POS\tEND_CHROM\tEND_POS\tCALLS\tBYTES\n");
+    for (s = 0; s <= bound_count; ++s)
+    {
+	bytes = calls = 0;
+	for (c = 0; c < file_list.count; ++c)
+	{
+	    if ( densities[c].count == 0 )
+		continue;
+	    start_bytes = s == 0 ? 0 : density_bytes(&densities[c],
+			    bounds[s - 1].chrom, bounds[s - 1].pos);
+	    end_bytes = density_bytes(&densities[c],
+			    s == bound_count ? NULL : bounds[s].chrom,
+			    s == bound_count ? 0 : bounds[s].pos);
+	    bytes += end_bytes - start_bytes;
+	    calls += (end_bytes - start_bytes) / densities[c].line_bytes;
+	}
+	if ( s == 0 )
+	    fprintf(fp, "%zu\t.\t0", s + 1);
+	else
+	    fprintf(fp, "%zu\t%s\t%" PRId64, s + 1,
+		    bounds[s - 1].chrom, bounds[s - 1].pos);
+	if ( s == bound_count )
+	    fprintf(fp, "\t.\t0");
+	else
+	    fprintf(fp, "\t%s\t%" PRId64, bounds[s].chrom, bounds[s].pos);
+	fprintf(fp, "\t%.0f\t%.0f\n", calls, bytes);
+    }
+    if ( fclose(fp) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Error writing %s: %s\n",
+		plan_filename, strerror(errno));
+	exit(EX_IOERR);
+    }
+    printf("%zu shards of about %.0f MiB of VCF written to %s.\n",
+	   bound_count + 1, total / (bound_count + 1) / 1048576, plan_filename);
+    
+    free_densities(densities, file_list.count);
+    free(bounds);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Sample the density of every VCF of a list, closing them
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+density_t   *sample_densities(file_list_t *file_list, size_t samples)
+
+{
+    density_t   *densities;
+    size_t      c;
+    
+    densities = (density_t *)malloc(file_list->count * sizeof(density_t));
+    if ( densities == NULL )
+    {
+	fprintf(stderr, "sample_densities(): Could not allocate densities.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < file_list->count; ++c)
+    {
+	sample_density(&densities[c], file_list->fp[c],
+		       file_list->filename[c], samples);
+	fclose(file_list->fp[c]);
+	file_list->fp[c] = NULL;
+    }
+    return densities;
+}
+
+
+void    free_densities(density_t *densities, size_t count)
+
+{
+    size_t  c,
+	    s;
+    
+    for (c = 0; c < count; ++c)
+    {
+	for (s = 0; s < densities[c].count; ++s)
+	    free(densities[c].points[s].chrom);
+	free(densities[c].points);
+    }
+    free(densities);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Choose the start keys of shards 2 to shard_count, any sampled
+ *      line being a candidate.  Boundary i is the candidate where the
+ *      bytes before it come closest to i / shard_count of the total.
+ *      Bytes before a key never decrease, so bisect.  Boundaries must
+ *      strictly increase, so small inputs may get fewer shards than
+ *      requested.  Returns the number of boundaries, one less than
+ *      the number of shards.  bounds share chrom with densities.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  plan_bounds(density_t densities[], size_t count, size_t shard_count,
+		    plan_point_t bounds[])
+
+{
+    plan_point_t    *points;
+    size_t          c,
+		    s,
+		    p,
+		    lo,
+		    hi,
+		    mid,
+		    point_count = 0,
+		    bound_count = 0;
+    double          total = 0,
+		    target;
+    
+    for (c = 0; c < count; ++c)
+    {
+	total += density_bytes(&densities[c], NULL, 0);
+	point_count += densities[c].count;
+    }
+    if ( (points = (plan_point_t *)malloc(point_count * sizeof(plan_point_t)))
+	 == NULL )
+    {
+	fprintf(stderr, "plan_bounds(): Could not allocate boundaries.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = 0, p = 0; c < count; ++c)
+	for (s = 0; s < densities[c].count; ++s)
+	    points[p++] = densities[c].points[s];
+    qsort(points, point_count, sizeof(plan_point_t), point_cmp);
+    
+    lo = 1;     // The lowest key would give an empty first shard
+    for (s = 1; s < shard_count; ++s)
+    {
+	target = total * s / shard_count;
+	hi = point_count;
+	p = lo;
+	while ( p < hi )
+	{
+	    mid = p + (hi - p) / 2;
+	    if ( plan_bytes(densities, count, &points[mid]) < target )
+		p = mid + 1;
+	    else
+		hi = mid;
+	}
+	
+	/* The candidate before may be closer */
+	if ( (p > lo) && ((p == point_count) ||
+	     (target - plan_bytes(densities, count, &points[p - 1]) <
+	      plan_bytes(densities, count, &points[p]) - target)) )
+	    --p;
+	while ( (p < point_count) && (bound_count > 0) &&
+		(point_cmp(&points[p], &bounds[bound_count - 1]) <= 0) )
+	    ++p;
+	if ( p >= point_count )
+	    break;
+	bounds[bound_count++] = points[p];
+	lo = p + 1;
+    }
+    free(points);
+    return bound_count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Set region to shard s (0-based) of the shards between bounds
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    bound_region(region_t *region, plan_point_t bounds[],
+		     size_t bound_count, size_t s)
+
+{
+    if ( s == 0 )
+	*region->start_chrom = '\0';
+    else
+	snprintf(region->start_chrom, CHROM_MAX_CHARS + 1, "%s",
+		 bounds[s - 1].chrom);
+    region->start_pos = s == 0 ? 0 : bounds[s - 1].pos;
+    if ( s == bound_count )
+	*region->end_chrom = '\0';
+    else
+	snprintf(region->end_chrom, CHROM_MAX_CHARS + 1, "%s",
+		 bounds[s].chrom);
+    region->end_pos = s == bound_count ? 0 : bounds[s].pos;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Sample the keys of about samples call lines of a VCF at evenly
+ *      spaced offsets, and the mean length of a call line
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    sample_density(density_t *density, FILE *fp, char *filename,
+		       size_t samples)
+
+{
+    char    chrom[CHROM_MAX_CHARS + 1];
+    int64_t pos;
+    off_t   line_start,
+	    line_bytes = 0;
+    size_t  s;
+    int     ch;
+    plan_point_t    *point;
+    
+    if ( (fseeko(fp, 0, SEEK_END) != 0) || ((density->size = ftello(fp)) == -1) )
+    {
+	fprintf(stderr, "ad-matrix: %s is not seekable.  Plans need VCF files.\n",
+		filename);
+	exit(EX_USAGE);
+    }
+    density->points = (plan_point_t *)malloc(samples * sizeof(plan_point_t));
+    if ( density->points == NULL )
+    {
+	fprintf(stderr, "sample_density(): Could not allocate points.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    density->count = 0;
+    for (s = 0; s < samples; ++s)
+    {
+	if ( (line_start = sync_line(fp, density->size * s / samples)) == -1 )
+	    break;
+    
+	/* Offsets are of call lines, so skip any header */
+	while ( (ch = getc(fp)) == '#' )
+	    while ( ((ch = getc(fp)) != '\n') && (ch != EOF) )
+		;
+	if ( ch == EOF )
+	    break;
+	ungetc(ch, fp);
+	line_start = ftello(fp);
+    
+	/* Lines longer than the spacing are sampled more than once */
+	if ( (density->count > 0) &&
+	     (line_start == density->points[density->count - 1].offset) )
+	    continue;
+	if ( read_key(fp, chrom, CHROM_MAX_CHARS, &pos) != BL_READ_OK )
+	    break;
+	point = &density->points[density->count++];
+	if ( (point->chrom = strdup(chrom)) == NULL )
+	{
+	    fprintf(stderr, "sample_density(): Could not allocate chrom.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+	point->pos = pos;
+	point->offset = line_start;
+	line_bytes += ftello(fp) - line_start;
+    }
+    if ( density->count > 0 )
+	density->line_bytes = (double)line_bytes / density->count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Estimate the bytes of calls in a VCF before chrom/pos, or in
+ *      total if chrom is NULL.  Keys between two sampled lines on the
+ *      same chromosome are interpolated by position, others are placed
+ *      halfway between.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+double  density_bytes(density_t *density, char *chrom, int64_t pos)
+
+{
+    plan_point_t    *prev,
+		    *next;
+    off_t           first,
+		    next_offset;
+    size_t          lo,
+		    hi,
+		    mid;
+    
+    if ( density->count == 0 )
+	return 0;
+    first = density->points[0].offset;
+    if ( chrom == NULL )
+	return density->size - first;
+    
+    /* First sampled line at or after the key */
+    lo = 0;
+    hi = density->count;
+    while ( lo < hi )
+    {
+	mid = lo + (hi - lo) / 2;
+	if ( key_cmp(density->points[mid].chrom, density->points[mid].pos,
+		     chrom, pos) < 0 )
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if ( lo == 0 )
+	return 0;
+    
+    prev = &density->points[lo - 1];
+    if ( lo == density->count )
+	return (prev->offset + density->size) / 2.0 - first;
+    next = &density->points[lo];
+    next_offset = next->offset;
+    if ( key_cmp(next->chrom, next->pos, chrom, pos) == 0 )
+	return next_offset - first;
+    if ( (strcmp(prev->chrom, chrom) == 0) && (strcmp(next->chrom, chrom) == 0) )
+	return prev->offset - first + (double)(next_offset - prev->offset) *
+	       (pos - prev->pos) / (next->pos - prev->pos);
+    return (prev->offset + next_offset) / 2.0 - first;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Estimate the bytes of calls before key, summed over all VCFs
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+double  plan_bytes(density_t densities[], size_t count, plan_point_t *key)
+
+{
+    double  bytes = 0;
+    size_t  c;
+    
+    for (c = 0; c < count; ++c)
+	bytes += density_bytes(&densities[c], key->chrom, key->pos);
+    return bytes;
+}
+
+
+int     point_cmp(const void *p1, const void *p2)
+
+{
+    plan_point_t    *point1 = (plan_point_t *)p1,
+		    *point2 = (plan_point_t *)p2;
+    
+    return key_cmp(point1->chrom, point1->pos, point2->chrom, point2->pos);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the key range of a shard from a plan.  An empty chrom is
+ *      an open end.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    read_region(region_t *region, char *plan_filename, size_t shard)
+
+{
+    FILE    *fp;
+    char    field[CHROM_MAX_CHARS + 1],
+	    *end;
+    size_t  len,
+	    fields;
+    int     delim;
+    
+    if ( (fp = fopen(plan_filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		plan_filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    while ( (delim = xt_tsv_read_field(fp, field, CHROM_MAX_CHARS, &len))
+	    != EOF )
+    {
+	if ( (*field == '#') || (strtoul(field, &end, 10) != shard) )
+	{
+	    while ( (delim != '\n') && (delim != EOF) )
+		delim = getc(fp);
+	    continue;
+	}
+	for (fields = 1; (delim == '\t') && (fields < 5); ++fields)
+	{
+	    delim = xt_tsv_read_field(fp, field, CHROM_MAX_CHARS, &len);
+	    if ( fields == 1 )
+		snprintf(region->start_chrom, CHROM_MAX_CHARS + 1, "%s",
+			 strcmp(field, ".") == 0 ? "" : field);
+	    else if ( fields == 2 )
+		region->start_pos = strtoll(field, &end, 10);
+	    else if ( fields == 3 )
+		snprintf(region->end_chrom, CHROM_MAX_CHARS + 1, "%s",
+			 strcmp(field, ".") == 0 ? "" : field);
+	    else
+		region->end_pos = strtoll(field, &end, 10);
+	}
+	fclose(fp);
+	if ( fields < 5 )
+	{
+	    fprintf(stderr, "ad-matrix: Shard %zu of %s is truncated.\n",
+		    shard, plan_filename);
+	    exit(EX_DATAERR);
+	}
+	if ( *region->start_chrom == '\0' )
+	    printf("Shard %zu: start", shard);
+	else
+	    printf("Shard %zu: %s %" PRId64, shard,
+		   region->start_chrom, region->start_pos);
+	if ( *region->end_chrom == '\0' )
+	    puts(" to end.");
+	else
+	    printf(" to before %s %" PRId64 ".\n",
+		   region->end_chrom, region->end_pos);
+	return;
+    }
+    fprintf(stderr, "ad-matrix: No shard %zu in %s.\n", shard, plan_filename);
+    exit(EX_DATAERR);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      ad-matrix concat: join the outputs of the shards of a plan, in
+ *      plan order.  Every <stem>-*.tsv.xz of the first shard is
+ *      concatenated over all shards, and the columns files, which must
+ *      be identical, are copied.  Indexes are joined by concat_index().
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     concat_shards(int argc, char *argv[])
+
+{
+    glob_t  matrices,
+	    columns,
+	    indexes;
+    char    pattern[PATH_MAX + 1],
+	    *matrix_stem,
+	    **shard_stems;
+    size_t  shard_count,
+	    s,
+	    f;
+    
+    if ( argc < 4 )
+	concat_usage(argv);
+    matrix_stem = argv[2];
+    shard_stems = &argv[3];
+    shard_count = argc - 3;
+    for (s = 0; s < shard_count; ++s)
+    {
+	if ( strcmp(shard_stems[s], matrix_stem) == 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Input matrix %s cannot be overwritten.\n",
+		    shard_stems[s]);
+	    exit(EX_USAGE);
+	}
+    }
+    
+    /* Cohort outputs are <stem>-NAME-*, so include them */
+    snprintf(pattern, PATH_MAX, "%s-*.tsv.xz", shard_stems[0]);
+    if ( glob(pattern, 0, NULL, &matrices) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: No matrices match %s.\n", pattern);
+	exit(EX_NOINPUT);
+    }
+    snprintf(pattern, PATH_MAX, "%s-*columns.tsv", shard_stems[0]);
+    if ( glob(pattern, 0, NULL, &columns) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: No columns files match %s.\n", pattern);
+	exit(EX_NOINPUT);
+    }
+    
+    for (f = 0; f < columns.gl_pathc; ++f)
+	concat_file(matrix_stem, shard_stems, shard_count,
+		    columns.gl_pathv[f] + strlen(shard_stems[0]), true);
+    for (f = 0; f < matrices.gl_pathc; ++f)
+	concat_file(matrix_stem, shard_stems, shard_count,
+		    matrices.gl_pathv[f] + strlen(shard_stems[0]), false);
+    
+    /* --index shards, one index per output */
+    snprintf(pattern, PATH_MAX, "%s-*index.tsv", shard_stems[0]);
+    if ( glob(pattern, 0, NULL, &indexes) == 0 )
+    {
+	for (f = 0; f < indexes.gl_pathc; ++f)
+	    concat_index(matrix_stem, shard_stems, shard_count,
+			 indexes.gl_pathv[f] + strlen(shard_stems[0]));
+	globfree(&indexes);
+    }
+    printf("%zu shards, %zu matrices written to %s-*.\n",
+	   shard_count, matrices.gl_pathc, matrix_stem);
+    globfree(&matrices);
+    globfree(&columns);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write <matrix_stem><suffix> from <shard_stem><suffix> of every
+ *      shard: concatenated, or copied from the first if same, after
+ *      checking that all are identical.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    concat_file(char *matrix_stem, char *shard_stems[], size_t shard_count,
+		    char *suffix, bool same)
+
+{
+    char    path[PATH_MAX + 1],
+	    buff[65536],
+	    first_buff[65536];
+    FILE    *out_fp,
+	    *shard_fp,
+	    *first_fp = NULL;
+    size_t  s,
+	    len;
+    
+    snprintf(path, PATH_MAX, "%s%s", matrix_stem, suffix);
+    if ( (out_fp = fopen(path, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		path, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    for (s = 0; s < shard_count; ++s)
+    {
+	snprintf(path, PATH_MAX, "%s%s", shard_stems[s], suffix);
+	if ( (shard_fp = fopen(path, "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	if ( ! same )
+	{
+	    while ( (len = fread(buff, 1, sizeof(buff), shard_fp)) > 0 )
+		fwrite(buff, 1, len, out_fp);
+	}
+	else if ( s == 0 )
+	    first_fp = shard_fp;
+	else
+	{
+	    rewind(first_fp);
+	    while ( ((len = fread(buff, 1, sizeof(buff), shard_fp)) > 0) &&
+		    (fread(first_buff, 1, len, first_fp) == len) &&
+		    (memcmp(buff, first_buff, len) == 0) )
+		;
+	    if ( (len != 0) || (getc(first_fp) != EOF) )
+	    {
+		fprintf(stderr, "ad-matrix: %s differs from the first shard.\n",
+			path);
+		exit(EX_DATAERR);
+	    }
+	}
+	if ( shard_fp != first_fp )
+	    fclose(shard_fp);
+    }
+    if ( same )
+    {
+	rewind(first_fp);
+	while ( (len = fread(buff, 1, sizeof(buff), first_fp)) > 0 )
+	    fwrite(buff, 1, len, out_fp);
+	fclose(first_fp);
+    }
+    if ( fclose(out_fp) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Error writing %s%s: %s\n",
+		matrix_stem, suffix, strerror(errno));
+	exit(EX_IOERR);
+    }
+}
+
+
+void    plan_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s plan [options] filename-with-list-of-VCFs shard-count plan-file\n", argv[0]);
+    fprintf(stderr, "Split the merge of the VCFs into up to shard-count shards of about equal\n");
+    fprintf(stderr, "work, written to plan-file (SHARD, START_CHROM, START_POS, END_CHROM, and\n");
+    fprintf(stderr, "END_POS of the first key past the shard, \".\" for open ends, and estimated\n");
+    fprintf(stderr, "VCF CALLS and BYTES).  CALLS is summed over samples, an upper bound on rows.\n");
+    fprintf(stderr, "Run each shard with ad-matrix run --plan plan-file --shard N, then join them\n");
+    fprintf(stderr, "with ad-matrix concat.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --samples-per-file N\n");
+    fprintf(stderr, "                   Lines sampled from each VCF [%d]\n", PLAN_SAMPLES);
+    exit(EX_USAGE);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the index <matrix_stem><suffix> from those of every shard.
+ *      Each shard's offsets are into its own matrices, so they are
+ *      moved past the shard matrices before it in the joined files.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    concat_index(char *matrix_stem, char *shard_stems[], size_t shard_count,
+		     char *suffix)
+
+{
+    static char *matrix_suffixes[INDEX_MATRICES] = { "ref", "ref+alt" };
+    char        path[PATH_MAX + 1],
+		header[1024];
+    FILE        *out_fp,
+		*shard_fp;
+    off_t       base[INDEX_MATRICES] = { 0 };
+    size_t      s,
+		m,
+		prefix_len = strlen(suffix) - strlen("index.tsv");
+    struct stat st;
+    index_block_t   block;
+    
+    snprintf(path, PATH_MAX, "%s%s", matrix_stem, suffix);
+    if ( (out_fp = fopen(path, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		path, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    for (s = 0; s < shard_count; ++s)
+    {
+	snprintf(path, PATH_MAX, "%s%s", shard_stems[s], suffix);
+	if ( (shard_fp = fopen(path, "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	if ( (s == 0) && (fgets(header, sizeof(header), shard_fp) != NULL) &&
+	     (*header == '#') )
+	    fputs(header, out_fp);
+	rewind(shard_fp);
+	while ( index_read(shard_fp, path, &block) )
+	{
+	    for (m = 0; m < INDEX_MATRICES; ++m)
+		block.offset[m] += base[m];
+	    index_write(out_fp, &block);
+	}
+	fclose(shard_fp);
+    
+	for (m = 0; m < INDEX_MATRICES; ++m)
+	{
+	    snprintf(path, PATH_MAX, "%s%.*s%s.tsv.xz", shard_stems[s],
+		     (int)prefix_len, suffix, matrix_suffixes[m]);
+	    if ( stat(path, &st) != 0 )
+	    {
+		fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+			path, strerror(errno));
+		exit(EX_NOINPUT);
+	    }
+	    base[m] += st.st_size;
+	}
+    }
+    if ( fclose(out_fp) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Error writing %s%s: %s\n",
+		matrix_stem, suffix, strerror(errno));
+	exit(EX_IOERR);
+    }
+}
+
+
+void    concat_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s concat matrix-output-stem shard-stem ...\n", argv[0]);
+    fprintf(stderr, "Join the matrix sets shard-stem-* written by ad-matrix run --shard, listed\n");
+    fprintf(stderr, "in plan order.  Indexes of shards run with --index are joined too.\n");
+    exit(EX_USAGE);
+}
@@ -0,0 +1,284 @@
+/***************************************************************************
+ *  Description:
+ *      --procs N: merge on N cores with forked worker processes instead
+ *      of threads, so a crash in one region cannot take down the others
+ *      and nothing linked needs to be thread-safe.
+ *
+ *      The VCFs are split as by ad-matrix plan, into more shards than
+ *      workers so that a slow shard does not leave cores idle.  Each
+ *      worker is a plain build_matrix() of one shard, as with run
+ *      --shard, writing compressed fragments under <stem>-procs/.  The
+ *      parent appends each shard's fragments to the outputs as soon as
+ *      it and every shard before it are done, so the outputs are
+ *      written in order while later shards are still running.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+void    run_procs(file_list_t *file_list, char *matrix_stem,
+		  matrix_opts_t *opts)
+
+{
+    density_t       *densities;
+    plan_point_t    *bounds;
+    region_t        region;
+    char            dir[PATH_MAX + 1];
+    pid_t           *pids,
+		    pid;
+    bool            *done;
+    size_t          shard_count,
+		    bound_count,
+		    next_start = 0,
+		    next_write = 0,
+		    running = 0,
+		    s;
+    int             status;
+    
+    /* Sampling closes the VCFs, and each worker opens its own */
+    densities = sample_densities(file_list, PLAN_SAMPLES);
+    shard_count = opts->procs * PROCS_SHARDS_PER_PROC;
+    if ( (bounds = (plan_point_t *)malloc(shard_count * sizeof(plan_point_t)))
+	 == NULL )
+    {
+	fprintf(stderr, "run_procs(): Could not allocate boundaries.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    bound_count = plan_bounds(densities, file_list->count, shard_count, bounds);
+    shard_count = bound_count + 1;
+    printf("%zu shards on %zu processes.\n", shard_count, opts->procs);
+    
+    pids = (pid_t *)calloc(shard_count, sizeof(pid_t));
+    done = (bool *)calloc(shard_count, sizeof(bool));
+    if ( (pids == NULL) || (done == NULL) )
+    {
+	fprintf(stderr, "run_procs(): Could not allocate workers.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    snprintf(dir, PATH_MAX, "%s-procs", matrix_stem);
+    if ( (mkdir(dir, 0777) != 0) && (errno != EEXIST) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		dir, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    fflush(stdout);
+    
+    while ( next_write < shard_count )
+    {
+	while ( (running < opts->procs) && (next_start < shard_count) )
+	{
+	    bound_region(&region, bounds, bound_count, next_start);
+	    if ( (pid = fork()) == -1 )
+	    {
+		fprintf(stderr, "ad-matrix: Cannot fork: %s\n", strerror(errno));
+		stop_workers(pids, done, next_start);
+		exit(EX_OSERR);
+	    }
+	    if ( pid == 0 )
+		run_worker(file_list, dir, next_start, &region, opts);
+	    pids[next_start++] = pid;
+	    ++running;
+	}
+    
+	if ( (pid = wait(&status)) == -1 )
+	{
+	    fprintf(stderr, "ad-matrix: wait() failed: %s\n", strerror(errno));
+	    exit(EX_OSERR);
+	}
+	for (s = 0; (s < next_start) && (pids[s] != pid); ++s)
+	    ;
+	if ( s == next_start )
+	    continue;
+	--running;
+	if ( ! WIFEXITED(status) || (WEXITSTATUS(status) != EX_OK) )
+	{
+	    bound_region(&region, bounds, bound_count, s);
+	    fprintf(stderr, "ad-matrix: Worker for shard %zu (%s %" PRId64
+		    " to %s %" PRId64 ") failed.\n", s + 1,
+		    *region.start_chrom == '\0' ? "start" : region.start_chrom,
+		    region.start_pos,
+		    *region.end_chrom == '\0' ? "end" : region.end_chrom,
+		    region.end_pos);
+	    done[s] = true;
+	    stop_workers(pids, done, next_start);
+	    exit(EX_SOFTWARE);
+	}
+	done[s] = true;
+    
+	/* Append every shard finished in order so far */
+	while ( (next_write < shard_count) && done[next_write] )
+	{
+	    append_fragments(matrix_stem, dir, next_write);
+	    ++next_write;
+	}
+    }
+    rmdir(dir);
+    
+    free(pids);
+    free(done);
+    free(bounds);
+    free_densities(densities, file_list->count);
+    fprintf(stderr, "Done!\n");
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge one shard in a forked worker, writing <dir>/<shard>-*,
+ *      and exit
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    run_worker(file_list_t *file_list, char *dir, size_t shard,
+		   region_t *region, matrix_opts_t *opts)
+
+{
+    char    stem[PATH_MAX + 1];
+    size_t  c;
+    
+    for (c = 0; c < file_list->count; ++c)
+    {
+	if ( (file_list->fp[c] = fopen(file_list->filename[c], "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    file_list->filename[c], strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+    }
+    
+    /* Progress is reported by the parent */
+    if ( freopen("/dev/null", "w", stdout) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot redirect worker output: %s\n",
+		strerror(errno));
+	_exit(EX_OSERR);
+    }
+    snprintf(stem, PATH_MAX, "%s/%zu", dir, shard);
+    opts->region = region;
+    opts->procs = 0;
+    build_matrix(file_list, stem, opts);
+    exit(EX_OK);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Append the fragments of a finished shard to the outputs and
+ *      remove them.  The columns files of all shards are the same, so
+ *      the first is kept.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    append_fragments(char *matrix_stem, char *dir, size_t shard)
+
+{
+    glob_t  fragments;
+    char    pattern[PATH_MAX + 1],
+	    path[PATH_MAX + 1],
+	    buff[65536],
+	    *suffix;
+    FILE    *out_fp,
+	    *fragment_fp;
+    size_t  f,
+	    prefix_len,
+	    len;
+    
+    snprintf(pattern, PATH_MAX, "%s/%zu-*", dir, shard);
+    prefix_len = strlen(pattern) - 2;
+    if ( glob(pattern, 0, NULL, &fragments) != 0 )
+    {
+	fprintf(stderr, "ad-matrix: Shard %zu has no output in %s.\n",
+		shard + 1, dir);
+	exit(EX_SOFTWARE);
+    }
+    for (f = 0; f < fragments.gl_pathc; ++f)
+    {
+	suffix = fragments.gl_pathv[f] + prefix_len;
+	snprintf(path, PATH_MAX, "%s%s", matrix_stem, suffix);
+	len = strlen(suffix);
+	if ( (len >= 11) && (strcmp(suffix + len - 11, "columns.tsv") == 0) )
+	{
+	    if ( shard == 0 )
+		rename(fragments.gl_pathv[f], path);
+	    else
+		unlink(fragments.gl_pathv[f]);
+	    continue;
+	}
+    
+	if ( (out_fp = fopen(path, shard == 0 ? "w" : "a")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_CANTCREAT);
+	}
+	if ( (fragment_fp = fopen(fragments.gl_pathv[f], "r")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		    fragments.gl_pathv[f], strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	while ( (len = fread(buff, 1, sizeof(buff), fragment_fp)) > 0 )
+	    fwrite(buff, 1, len, out_fp);
+	fclose(fragment_fp);
+	if ( fclose(out_fp) != 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Error writing %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_IOERR);
+	}
+	unlink(fragments.gl_pathv[f]);
+    }
+    globfree(&fragments);
+    printf("Shard %zu written.\n", shard + 1);
+    fflush(stdout);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Terminate and reap the workers still running after a failure.
+ *      Their fragments are left for inspection.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    stop_workers(pid_t pids[], bool done[], size_t count)
+
+{
+    size_t  s;
+    
+    for (s = 0; s < count; ++s)
+	if ( ! done[s] )
+	    kill(pids[s], SIGTERM);
+    for (s = 0; s < count; ++s)
+	if ( ! done[s] )
+	    waitpid(pids[s], NULL, 0);
+}
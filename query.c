@@ -0,0 +1,448 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix query: extract a region x a sample subset from a matrix
+ *      set written with --index.  Only the blocks of the index that
+ *      overlap the region are decompressed, each from its own xz stream
+ *      (see index.c), so the cost is that of the region, not the matrix.
+ *
+ *      Rows can be filtered with --min-dp and --min-calls, e.g. sites
+ *      where at least 100 samples have ref+alt >= 20.  Blocks whose
+ *      zone map (see index.c) shows that no row can pass are skipped
+ *      without decompressing them.
+ *
+ *      Output is TSV as in the matrices, or for numeric tools, a 2-D
+ *      array of int64 with POS in column 0 and a column per sample,
+ *      -1 for missing: raw in host byte order (bin), or as a NumPy .npy
+ *      file (npy).
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     query_matrix(int argc, char *argv[])
+
+{
+    query_t         query;
+    index_block_t   block;
+    FILE            *index_fp;
+    char            *samples = NULL,
+		    *stem,
+		    filename[PATH_MAX + 1];
+    bool            *selected;
+    size_t          c;
+    int             arg;
+    
+    memset(&query, 0, sizeof(query));
+    query.which = "ref+alt";
+    query.min_calls = 1;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( (strcmp(argv[arg], "--samples") == 0) && (arg + 1 < argc) )
+	    samples = argv[++arg];
+	else if ( strcmp(argv[arg], "--min-calls") == 0 )
+	    query.min_calls = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-dp") == 0 )
+	    query.min_dp = depth_arg(argv, ++arg);
+	else if ( (strcmp(argv[arg], "--matrix") == 0) && (arg + 1 < argc) )
+	{
+	    query.which = argv[++arg];
+	    if ( (strcmp(query.which, "ref") != 0) &&
+		 (strcmp(query.which, "alt") != 0) &&
+		 (strcmp(query.which, "ref+alt") != 0) )
+		query_usage(argv);
+	}
+	else if ( (strcmp(argv[arg], "--format") == 0) && (arg + 1 < argc) )
+	{
+	    ++arg;
+	    if ( strcmp(argv[arg], "tsv") == 0 )
+		query.format = QUERY_TSV;
+	    else if ( strcmp(argv[arg], "bin") == 0 )
+		query.format = QUERY_BIN;
+	    else if ( strcmp(argv[arg], "npy") == 0 )
+		query.format = QUERY_NPY;
+	    else
+		query_usage(argv);
+	}
+	else
+	    query_usage(argv);
+    }
+    if ( argc - arg != 2 )
+	query_usage(argv);
+    stem = argv[arg];
+    if ( ! parse_region(argv[arg + 1], query.chrom, &query.start,
+			&query.end) )
+    {
+	fprintf(stderr, "ad-matrix: Invalid region %s.\n", argv[arg + 1]);
+	exit(EX_USAGE);
+    }
+    
+    /* Select columns by name or VCF list index, as in the columns file */
+    matrix_in_columns(&query.in, stem, NULL);
+    selected = (bool *)malloc(query.in.count * sizeof(bool));
+    query.column = (size_t *)malloc(query.in.count * sizeof(size_t));
+    query.in.ref = (depth_t *)malloc(query.in.count * sizeof(depth_t));
+    query.in.ref_alt = (depth_t *)malloc(query.in.count * sizeof(depth_t));
+    if ( (selected == NULL) || (query.column == NULL) ||
+	 (query.in.ref == NULL) || (query.in.ref_alt == NULL) )
+    {
+	fprintf(stderr, "query_matrix(): Could not allocate columns.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < query.in.count; ++c)
+	selected[c] = (samples == NULL);
+    if ( samples != NULL )
+	select_samples(samples, query.in.name, query.in.list_index,
+		       query.in.count, selected, true);
+    for (c = 0; c < query.in.count; ++c)
+	if ( selected[c] )
+	    query.column[query.count++] = c;
+    free(selected);
+    
+    query.values_max = 1;
+    query.values = (int64_t *)malloc((query.count + 1) * sizeof(int64_t));
+    if ( query.values == NULL )
+    {
+	fprintf(stderr, "query_matrix(): Could not allocate row.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    snprintf(filename, PATH_MAX, "%s-index.tsv", stem);
+    if ( (index_fp = fopen(filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n", filename,
+		strerror(errno));
+	fprintf(stderr, "Write matrices with --index to query them.\n");
+	exit(EX_NOINPUT);
+    }
+    while ( index_read(index_fp, filename, &block) )
+    {
+	if ( (strcmp(block.chrom, query.chrom) != 0) ||
+	     (block.last_pos < query.start) || (block.first_pos > query.end) )
+	    continue;
+	if ( zone_skip(&query, &block) )
+	    ++query.blocks_skipped;
+	else
+	{
+	    query_block(&query, &block);
+	    ++query.blocks_read;
+	}
+    }
+    fclose(index_fp);
+    fprintf(stderr, "%zu rows from %zu blocks, %zu blocks skipped.\n",
+	    query.rows, query.blocks_read, query.blocks_skipped);
+    
+    if ( query.format == QUERY_NPY )
+	write_npy(&query, stdout);
+    free(query.values);
+    free(query.column);
+    free(query.in.ref);
+    free(query.in.ref_alt);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return true if the zone map of block shows that none of its rows
+ *      has min_calls calls with ref+alt >= min_dp.  Calls among the
+ *      selected samples are at most those among all.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    zone_skip(query_t *query, index_block_t *block)
+
+{
+    if ( ! block->zone || (query->min_calls == 0) )
+	return false;
+    if ( block->max_row_calls < query->min_calls )
+	return true;
+    if ( query->min_dp == 0 )
+	return false;
+    return (block->max_depth < query->min_dp) ||
+	   (block->row_calls_ge[zone_level(query->min_dp)] < query->min_calls);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Decompress one block of the matrices needed and output its rows
+ *      in the region
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    query_block(query_t *query, index_block_t *block)
+
+{
+    FILE    *ref_fp = NULL,
+	    *ref_alt_fp = NULL;
+    char    chrom[CHROM_MAX_CHARS + 1],
+	    ref_alt_chrom[CHROM_MAX_CHARS + 1];
+    int64_t pos,
+	    ref_alt_pos;
+    size_t  r;
+    bool    ok = true;
+    
+    /* alt is ref+alt - ref, so it needs both, as does ref with --min-dp */
+    if ( strcmp(query->which, "ref+alt") != 0 )
+	ref_fp = open_block_reader(query->in.stem, "ref", block->offset[0]);
+    if ( (strcmp(query->which, "ref") != 0) || (query->min_dp != 0) )
+	ref_alt_fp = open_block_reader(query->in.stem, "ref+alt",
+				       block->offset[1]);
+    
+    for (r = 0; ok && (r < block->rows); ++r)
+    {
+	if ( ref_fp != NULL )
+	    ok = query_read_row(query, ref_fp, query->in.ref, chrom, &pos);
+	if ( ok && (ref_alt_fp != NULL) )
+	{
+	    ok = query_read_row(query, ref_alt_fp, query->in.ref_alt,
+				ref_alt_chrom, &ref_alt_pos);
+	    if ( ok && (ref_fp != NULL) && ((pos != ref_alt_pos) ||
+		 (strcmp(chrom, ref_alt_chrom) != 0)) )
+	    {
+		fprintf(stderr, "ad-matrix: %s ref and ref+alt matrices "
+			"differ at %s %" PRId64 ".\n", query->in.stem, chrom,
+			pos);
+		exit(EX_DATAERR);
+	    }
+	    pos = ref_alt_pos;
+	}
+	if ( ok && (pos > query->end) )
+	    break;
+	if ( ok && (pos >= query->start) )
+	    query_row(query, pos);
+    }
+    if ( ! ok )
+    {
+	fprintf(stderr, "ad-matrix: %s block at %s %" PRId64
+		" does not match the index.\n", query->in.stem,
+		block->chrom, block->first_pos);
+	exit(EX_DATAERR);
+    }
+    
+    /* xz may still be writing if the region ended in the block */
+    if ( ref_fp != NULL )
+	pclose(ref_fp);
+    if ( ref_alt_fp != NULL )
+	pclose(ref_alt_fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Open a pipe from xz reading the single xz stream at offset in
+ *      <stem>-<suffix>.tsv.xz
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+FILE    *open_block_reader(char *stem, char *suffix, off_t offset)
+
+{
+    char    cmd[PATH_MAX + 128];
+    FILE    *fp;
+    
+    snprintf(cmd, sizeof(cmd),
+	     "tail -c +%jd %s-%s.tsv.xz | xz -dc --single-stream",
+	     (intmax_t)offset + 1, stem, suffix);
+    if ( (fp = popen(cmd, "r")) == NULL )
+    {
+	fprintf(stderr, "Cannot open %s: %s\n", cmd, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    return fp;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read one row of a matrix into depths.  Returns false if the row
+ *      is missing or malformed.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    query_read_row(query_t *query, FILE *fp, depth_t *depths,
+		       char *chrom, int64_t *pos)
+
+{
+    size_t  c;
+    
+    if ( read_row_key(fp, chrom, pos) != BL_READ_OK )
+	return false;
+    for (c = 0; c < query->in.count; ++c)
+	if ( read_depth(fp, &depths[c]) != '\t' )
+	    return false;
+    return getc(fp) == '\n';
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Output the selected cells of the row just read, unless it has
+ *      fewer than min_calls of them
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    query_row(query_t *query, int64_t pos)
+
+{
+    int64_t *values;
+    depth_t ref,
+	    ref_alt,
+	    depth;
+    size_t  c,
+	    s,
+	    calls = 0;
+    
+    if ( query->format == QUERY_NPY )
+    {
+	if ( query->rows == query->values_max )
+	{
+	    query->values_max *= 2;
+	    query->values = (int64_t *)realloc(query->values,
+			    query->values_max * (query->count + 1) *
+			    sizeof(int64_t));
+	    if ( query->values == NULL )
+	    {
+		fprintf(stderr, "query_row(): Could not allocate rows.\n");
+		exit(EX_UNAVAILABLE);
+	    }
+	}
+	values = query->values + query->rows * (query->count + 1);
+    }
+    else
+	values = query->values;
+    
+    values[0] = pos;
+    for (s = 0; s < query->count; ++s)
+    {
+	c = query->column[s];
+	ref = query->in.ref[c];
+	ref_alt = query->in.ref_alt[c];
+	if ( (query->min_dp != 0) && ((ref_alt == DEPTH_MISSING) ||
+				      (ref_alt < query->min_dp)) )
+	    depth = DEPTH_MISSING;
+	else if ( strcmp(query->which, "ref") == 0 )
+	    depth = ref;
+	else if ( strcmp(query->which, "ref+alt") == 0 )
+	    depth = ref_alt;
+	else
+	    depth = (ref == DEPTH_MISSING) || (ref_alt == DEPTH_MISSING) ||
+		    (ref_alt < ref) ? DEPTH_MISSING : ref_alt - ref;
+	if ( depth == DEPTH_MISSING )
+	    values[s + 1] = -1;
+	else
+	{
+	    values[s + 1] = depth;
+	    ++calls;
+	}
+    }
+    if ( calls < query->min_calls )
+	return;
+    
+    switch(query->format)
+    {
+	case QUERY_TSV:
+	    printf("%s\t%" PRId64 "\t", query->chrom, pos);
+	    for (s = 0; s < query->count; ++s)
+	    {
+		put_depth(values[s + 1] == -1 ? DEPTH_MISSING : values[s + 1],
+			  stdout);
+		putchar('\t');
+	    }
+	    putchar('\n');
+	    break;
+	case QUERY_BIN:
+	    fwrite(values, sizeof(int64_t), query->count + 1, stdout);
+	    break;
+	case QUERY_NPY:
+	    break;
+    }
+    ++query->rows;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the buffered rows as a NumPy .npy file (format version 1.0)
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_npy(query_t *query, FILE *fp)
+
+{
+    char        header[128];
+    uint16_t    one = 1;
+    size_t      len;
+    
+    /* Magic, version, header length, and header padded to 64 bytes */
+    len = snprintf(header, sizeof(header),
+		   "{'descr': '%ci8', 'fortran_order': False, "
+		   "'shape': (%zu, %zu), }",
+		   *(char *)&one ? '<' : '>', query->rows, query->count + 1);
+    while ( (10 + len + 1) % 64 != 0 )
+	header[len++] = ' ';
+    header[len++] = '\n';
+    fwrite("\x93NUMPY\x01\x00", 1, 8, fp);
+    putc(len & 0xff, fp);
+    putc(len >> 8, fp);
+    fwrite(header, 1, len, fp);
+    fwrite(query->values, sizeof(int64_t), query->rows * (query->count + 1),
+	   fp);
+}
+
+
+void    query_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s query [options] matrix-stem CHROM[:START-END]\n", argv[0]);
+    fprintf(stderr, "Print the rows of a matrix set written with --index in a region, reading\n");
+    fprintf(stderr, "only the blocks of the index that overlap it.  START and END are 1-based\n");
+    fprintf(stderr, "and inclusive.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --samples LIST   Only the columns in LIST, as for ad-matrix --samples,\n");
+    fprintf(stderr, "                   with indexes into the VCF list, as in the columns file\n");
+    fprintf(stderr, "  --min-dp N       Mask cells with ref+alt < N\n");
+    fprintf(stderr, "  --min-calls N    Drop rows with fewer than N calls among them [1]\n");
+    fprintf(stderr, "Blocks whose zone map in the index shows that no row passes --min-dp and\n");
+    fprintf(stderr, "--min-calls are skipped without decompressing them.\n");
+    fprintf(stderr, "  --matrix ref|alt|ref+alt\n");
+    fprintf(stderr, "                   Matrix to print [ref+alt].  alt is ref+alt - ref.\n");
+    fprintf(stderr, "  --format tsv|bin|npy\n");
+    fprintf(stderr, "                   tsv [default]: rows as in the matrix.  bin: int64 rows of\n");
+    fprintf(stderr, "                   POS and one value per sample, -1 if missing, in host\n");
+    fprintf(stderr, "                   byte order.  npy: the same as a NumPy .npy array.\n");
+    exit(EX_USAGE);
+}
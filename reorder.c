@@ -0,0 +1,261 @@
+/***************************************************************************
+ *  Description:
+ *      --reorder-columns: order the sample columns of an output so that
+ *      samples with similar call presence are adjacent.  Neighboring
+ *      cells then tend to be "." together, which xz compresses much
+ *      better than presence in arbitrary list order.
+ *
+ *      Presence is sampled from up to REORDER_SAMPLE_ROWS rows spread
+ *      over the whole input matrix set, as one bitmap per column.  The
+ *      order is built greedily: starting from the first column, the
+ *      next column is the unplaced one with the fewest presence
+ *      differences from the last one placed.  Only the REORDER_NEIGHBORS
+ *      unplaced columns on each side of the last one in bitmap order
+ *      are compared, so the cost is linear in the number of columns
+ *      rather than quadratic.  With up to REORDER_NEIGHBORS columns,
+ *      all are compared.
+ *
+ *      The order is the permutation stored in <stem>-columns.tsv, which
+ *      lists the VCF list index and name of each output column, so
+ *      readers map columns back to samples as before.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Return the greedy similarity order of the columns of the matrix
+ *      set stem, as an array of its column numbers
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  *reorder_columns(char *stem)
+
+{
+    matrix_in_t     in;
+    presence_sig_t  *sigs;
+    uint64_t        *presence,
+		    *last;
+    size_t          *order,
+		    *rank,
+		    *prev,
+		    *next,
+		    count,
+		    c,
+		    p,
+		    r,
+		    n,
+		    left,
+		    right,
+		    best,
+		    best_diff,
+		    diff;
+    
+    matrix_in_open(&in, stem, NULL);
+    count = in.count;
+    presence = sample_presence(&in);
+    matrix_in_close(&in);
+    
+    order = (size_t *)malloc(count * sizeof(size_t));
+    sigs = (presence_sig_t *)malloc(count * sizeof(presence_sig_t));
+    rank = (size_t *)malloc(count * sizeof(size_t));
+    prev = (size_t *)malloc(count * sizeof(size_t));
+    next = (size_t *)malloc(count * sizeof(size_t));
+    if ( (order == NULL) || (sigs == NULL) || (rank == NULL) ||
+	 (prev == NULL) || (next == NULL) )
+    {
+	fprintf(stderr, "reorder_columns(): Could not allocate order.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    /*
+     *  Unplaced columns are a list in signature order.  Columns with
+     *  similar presence mostly sort near each other, so only the
+     *  REORDER_NEIGHBORS nearest unplaced ones on each side of the last
+     *  column placed are candidates.
+     */
+    for (c = 0; c < count; ++c)
+    {
+	sigs[c].bits = presence + c * REORDER_WORDS;
+	sigs[c].column = c;
+    }
+    qsort(sigs, count, sizeof(presence_sig_t), presence_cmp);
+    for (r = 0; r < count; ++r)
+    {
+	rank[sigs[r].column] = r;
+	prev[r] = r == 0 ? SIZE_MAX : r - 1;
+	next[r] = r + 1 == count ? SIZE_MAX : r + 1;
+    }
+    
+    order[0] = 0;
+    r = rank[0];
+    for (p = 1; p <= count; ++p)
+    {
+	/* Unlink the last column placed, keeping its own links */
+	if ( prev[r] != SIZE_MAX )
+	    next[prev[r]] = next[r];
+	if ( next[r] != SIZE_MAX )
+	    prev[next[r]] = prev[r];
+	if ( p == count )
+	    break;
+	
+	last = presence + order[p - 1] * REORDER_WORDS;
+	best = SIZE_MAX;
+	best_diff = SIZE_MAX;
+	left = prev[r];
+	right = next[r];
+	for (n = 0; n < 2 * REORDER_NEIGHBORS; ++n)
+	{
+	    /* Alternate sides, ties going to the lower column number */
+	    if ( n % 2 == 0 )
+	    {
+		if ( (c = left) == SIZE_MAX )
+		    continue;
+		left = prev[left];
+	    }
+	    else
+	    {
+		if ( (c = right) == SIZE_MAX )
+		    continue;
+		right = next[right];
+	    }
+	    diff = presence_diff(last, sigs[c].bits);
+	    if ( (diff < best_diff) || ((diff == best_diff) &&
+		 (sigs[c].column < sigs[best].column)) )
+	    {
+		best = c;
+		best_diff = diff;
+	    }
+	}
+	r = best;
+	order[p] = sigs[r].column;
+    }
+    free(sigs);
+    free(rank);
+    free(prev);
+    free(next);
+    free(presence);
+    return order;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Order presence bitmaps by their words, for qsort()
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     presence_cmp(const void *p1, const void *p2)
+
+{
+    presence_sig_t  *sig1 = (presence_sig_t *)p1,
+		    *sig2 = (presence_sig_t *)p2;
+    size_t          w;
+    
+    for (w = 0; w < REORDER_WORDS; ++w)
+	if ( sig1->bits[w] != sig2->bits[w] )
+	    return sig1->bits[w] < sig2->bits[w] ? -1 : 1;
+    return sig1->column < sig2->column ? -1 : (sig1->column > sig2->column);
+}
+
+
+/* Number of sampled rows where two columns differ in presence */
+size_t  presence_diff(uint64_t *bits1, uint64_t *bits2)
+
+{
+    size_t  w,
+	    diff = 0;
+    
+    for (w = 0; w < REORDER_WORDS; ++w)
+	diff += __builtin_popcountll(bits1[w] ^ bits2[w]);
+    return diff;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the rest of a matrix set, keeping the call presence of
+ *      every stride'th row in a bitmap per column, REORDER_WORDS words
+ *      each.  When the bitmaps fill up, every other sampled row is
+ *      dropped and the stride doubled, so the rows kept are spread
+ *      over the whole set however long it is.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+uint64_t    *sample_presence(matrix_in_t *in)
+
+{
+    uint64_t    *presence,
+		*bits,
+		bit;
+    size_t      stride = 1,
+		sampled = 0,
+		rows = 0,
+		c,
+		r;
+    
+    presence = (uint64_t *)calloc(in->count * REORDER_WORDS,
+				  sizeof(uint64_t));
+    if ( presence == NULL )
+    {
+	fprintf(stderr, "sample_presence(): Could not allocate bitmaps.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (; in->have_row; matrix_in_read(in))
+    {
+	if ( rows++ % stride != 0 )
+	    continue;
+	if ( sampled == REORDER_SAMPLE_ROWS )
+	{
+	    for (c = 0; c < in->count; ++c)
+	    {
+		bits = presence + c * REORDER_WORDS;
+		for (r = 0; r < REORDER_SAMPLE_ROWS / 2; ++r)
+		{
+		    bit = (bits[r * 2 / 64] >> (r * 2 % 64)) & 1;
+		    bits[r / 64] &= ~((uint64_t)1 << (r % 64));
+		    bits[r / 64] |= bit << (r % 64);
+		}
+		memset(bits + REORDER_WORDS / 2, 0,
+		       REORDER_WORDS / 2 * sizeof(uint64_t));
+	    }
+	    sampled = REORDER_SAMPLE_ROWS / 2;
+	    stride *= 2;
+	    /* This row is sampled only if still on the new stride */
+	    if ( (rows - 1) % stride != 0 )
+		continue;
+	}
+	for (c = 0; c < in->count; ++c)
+	    if ( (in->ref[c] != DEPTH_MISSING) ||
+		 (in->ref_alt[c] != DEPTH_MISSING) )
+		presence[c * REORDER_WORDS + sampled / 64] |=
+		    (uint64_t)1 << (sampled % 64);
+	++sampled;
+    }
+    fprintf(stderr, "%s: Presence sampled from %zu of %zu rows.\n",
+	    in->stem, sampled, rows);
+    return presence;
+}
@@ -0,0 +1,192 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix replace-column: replace one sample of an existing matrix
+ *      set with a new VCF, e.g. after it is re-sequenced or re-called.
+ *      The existing matrices are streamed through once with the new VCF,
+ *      so the other N - 1 VCFs are not read at all.
+ *
+ *      Sites only the new VCF has are added, and rows left with fewer
+ *      than --min-calls calls are dropped.  This is not a rebuild: rows
+ *      the input set dropped for --min-calls are not in it, so with
+ *      --min-calls > 1 a row that the new sample's call would bring up
+ *      to the minimum is still missing.  Rebuild from the VCFs for
+ *      exactly the rows of a full run.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     replace_column(int argc, char *argv[])
+
+{
+    file_list_t     file_list;
+    matrix_opts_t   opts;
+    char            *matrix_filename_stem;
+    int             arg;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.mask.max_ref_alt = DEPTH_MISSING;
+    opts.min_calls = 1;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--min-dp") == 0 )
+	    opts.mask.min_dp = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-gq") == 0 )
+	    opts.mask.min_gq = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-ref-alt") == 0 )
+	    opts.mask.min_ref_alt = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--max-ref-alt") == 0 )
+	    opts.mask.max_ref_alt = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-calls") == 0 )
+	    opts.min_calls = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--gvcf") == 0 )
+	    opts.gvcf = true;
+	else if ( strcmp(argv[arg], "--stats") == 0 )
+	    opts.stats = true;
+	else if ( (strcmp(argv[arg], "--annotate") == 0) && (arg + 1 < argc) )
+	    opts.annotate_filename = argv[++arg];
+	else
+	    replace_usage(argv);
+    }
+    
+    if ( argc - arg != 4 )
+	replace_usage(argv);
+    matrix_filename_stem = argv[arg];
+    opts.base_stems = &argv[arg + 1];
+    opts.base_count = 1;
+    opts.replace_sample = argv[arg + 2];
+    if ( strcmp(opts.base_stems[0], matrix_filename_stem) == 0 )
+    {
+	fprintf(stderr, "ad-matrix: Input matrix %s cannot be overwritten.\n",
+		matrix_filename_stem);
+	exit(EX_USAGE);
+    }
+    
+    open_vcf(&file_list, argv[arg + 3]);
+    build_matrix(&file_list, matrix_filename_stem, &opts);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Set up a file list holding a single VCF
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    open_vcf(file_list_t *file_list, char *filename)
+
+{
+    memset(file_list, 0, sizeof(*file_list));
+    file_list->filename = (char **)malloc(sizeof(char *));
+    file_list->group = (char **)calloc(1, sizeof(char *));
+    file_list->list_index = (size_t *)malloc(sizeof(size_t));
+    file_list->fp = (FILE **)malloc(sizeof(FILE *));
+    file_list->layout = (format_layout_t *)calloc(1, sizeof(format_layout_t));
+    if ( (file_list->filename == NULL) || (file_list->group == NULL) ||
+	 (file_list->list_index == NULL) || (file_list->fp == NULL) ||
+	 (file_list->layout == NULL) )
+    {
+	fprintf(stderr, "open_vcf(): Cannot allocate file list.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    if ( (file_list->fp[0] = fopen(filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    file_list->filename[0] = filename;
+    file_list->list_index[0] = 1;
+    file_list->count = 1;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Return the output columns for replacing sample in the existing
+ *      matrix with the VCF: the existing columns in order, with the
+ *      matching one taken from the VCF instead.  The VCF keeps the list
+ *      index of the column it replaces.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+size_t  *replace_columns(file_list_t *file_list, char *sample)
+
+{
+    matrix_in_t *base = &file_list->base[0];
+    bool        *selected;
+    size_t      *column,
+		c,
+		matches = 0,
+		replaced = 0;
+    
+    selected = (bool *)calloc(base->count, sizeof(bool));
+    column = (size_t *)malloc(base->count * sizeof(size_t));
+    if ( (selected == NULL) || (column == NULL) )
+    {
+	fprintf(stderr, "replace_columns(): Cannot allocate columns.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    select_sample(sample, base->name, NULL, base->count, selected, true);
+    for (c = 0; c < base->count; ++c)
+    {
+	if ( selected[c] )
+	{
+	    replaced = c;
+	    ++matches;
+	}
+	column[c] = selected[c] ? 0 : base->first + c;
+    }
+    if ( matches != 1 )
+    {
+	fprintf(stderr, "ad-matrix: \"%s\" matches %zu columns of %s.\n",
+		sample, matches, base->stem);
+	exit(EX_USAGE);
+    }
+    printf("Replacing column %zu, %s, with %s.\n", replaced + 1,
+	   base->name[replaced], file_list->filename[0]);
+    file_list->index_base = base->list_index[replaced] -
+			    file_list->list_index[0];
+    free(selected);
+    return column;
+}
+
+
+void    replace_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s replace-column [options] matrix-output-stem input-stem sample VCF\n", argv[0]);
+    fprintf(stderr, "Write a copy of matrix set input-stem-* with the column for sample taken\n");
+    fprintf(stderr, "from VCF.  sample is a 1-based column number or a name as in --samples.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --min-dp N, --min-gq N, --min-ref-alt N, --max-ref-alt N\n");
+    fprintf(stderr, "                   Mask calls in VCF (see ad-matrix)\n");
+    fprintf(stderr, "  --min-calls N    Drop rows with fewer than N calls [1].  Rows the input\n");
+    fprintf(stderr, "                   set dropped are not restored, so with N > 1 the output\n");
+    fprintf(stderr, "                   may lack rows that a rebuild from the VCFs would have.\n");
+    fprintf(stderr, "  --gvcf           VCF is a gVCF (see ad-matrix)\n");
+    fprintf(stderr, "  --stats          Also write QC statistics (see ad-matrix --stats)\n");
+    fprintf(stderr, "  --annotate FILE  Also write annotation IDs (see ad-matrix --annotate)\n");
+    exit(EX_USAGE);
+}
@@ -0,0 +1,878 @@
+/***************************************************************************
+ *  Description:
+ *      ad-matrix serve: a resident daemon answering ad hoc matrix
+ *      requests (a region x a sample subset) from memory, and
+ *      ad-matrix request, its command-line client.
+ *
+ *      The VCFs are merged once, at startup, and each sample's unmasked
+ *      calls are kept as a compact, block-indexed stream (see cache_t).
+ *      A request seeks each selected sample's stream to the start of
+ *      the region by bisection and merges only the calls in the region,
+ *      so no VCF is read again.
+ *
+ *      Requests arrive over a Unix socket, one per connection, as a
+ *      single line of tab-separated fields:
+ *
+ *          MATRIX  REGION  SAMPLES  MIN-CALLS
+ *
+ *      MATRIX is ref, alt, ref+alt, or columns.  REGION is CHROM or
+ *      CHROM:START-END (1-based, inclusive).  SAMPLES is a LIST as for
+ *      --samples, with indexes into the VCF list as in the columns
+ *      response, so they do not depend on the serve --samples, or -
+ *      for all.  The
+ *      response is "OK" and the matrix, rows as in the xz files, or
+ *      the lines of the columns file for columns.  Anything else is an
+ *      error message.  Each request is served by a forked child, so
+ *      requests run concurrently and share the cache copy-on-write.
+ *
+ *      The daemon never opens a file named by a request: --samples
+ *      @FILE is read by the client and sent as a list of names.  The
+ *      socket is created mode 0600, so only the daemon's user can
+ *      connect unless its mode is changed.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     serve_cache(int argc, char *argv[])
+
+{
+    cache_t         cache;
+    matrix_opts_t   opts;
+    char            *socket_path;
+    int             arg,
+		    listen_fd,
+		    fd;
+    pid_t           pid;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.mask.max_ref_alt = DEPTH_MISSING;
+    opts.min_calls = 1;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( strcmp(argv[arg], "--min-dp") == 0 )
+	    opts.mask.min_dp = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-gq") == 0 )
+	    opts.mask.min_gq = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--min-ref-alt") == 0 )
+	    opts.mask.min_ref_alt = depth_arg(argv, ++arg);
+	else if ( strcmp(argv[arg], "--max-ref-alt") == 0 )
+	    opts.mask.max_ref_alt = depth_arg(argv, ++arg);
+	else if ( (strcmp(argv[arg], "--samples") == 0) && (arg + 1 < argc) )
+	    opts.samples = argv[++arg];
+	else if ( (strcmp(argv[arg], "--exclude-samples") == 0) &&
+		  (arg + 1 < argc) )
+	    opts.exclude_samples = argv[++arg];
+	else if ( strcmp(argv[arg], "--gvcf") == 0 )
+	    opts.gvcf = true;
+	else
+	    serve_usage(argv);
+    }
+    
+    if ( argc - arg != 2 )
+	serve_usage(argv);
+    socket_path = argv[arg + 1];
+    
+    cache_load(&cache, argv[arg], &opts);
+    listen_fd = serve_listen(socket_path);
+    printf("Serving %zu samples, %zu calls in %zu bytes on %s.\n",
+	   cache.file_list.count, cache.calls, cache_bytes(&cache),
+	   socket_path);
+    fflush(stdout);
+    
+    /* Children are reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+    while ( true )
+    {
+	if ( (fd = accept(listen_fd, NULL, NULL)) == -1 )
+	{
+	    if ( errno == EINTR || errno == ECONNABORTED )
+		continue;
+	    fprintf(stderr, "ad-matrix: accept() failed: %s\n",
+		    strerror(errno));
+	    exit(EX_OSERR);
+	}
+	if ( (pid = fork()) == 0 )
+	{
+	    close(listen_fd);
+	    serve_request(&cache, fd);
+	    exit(EX_OK);
+	}
+	else if ( pid == -1 )
+	    fprintf(stderr, "ad-matrix: Cannot fork: %s\n", strerror(errno));
+	close(fd);
+    }
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge the VCFs in list_filename and keep every unmasked call
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    cache_load(cache_t *cache, char *list_filename, matrix_opts_t *opts)
+
+{
+    merge_t         merge;
+    row_t           *row = &merge.row;
+    cache_sample_t  *sample;
+    size_t          c;
+    
+    memset(cache, 0, sizeof(*cache));
+    open_files(list_filename, &cache->file_list, "r", opts);
+    cache->samples = (cache_sample_t *)calloc(cache->file_list.count,
+					      sizeof(cache_sample_t));
+    if ( cache->samples == NULL )
+    {
+	fprintf(stderr, "cache_load(): Cannot allocate samples.\n");
+	fatal(EX_UNAVAILABLE);
+    }
+    
+    merge_open(&merge, &cache->file_list, opts);
+    merge_start(&merge);
+    while ( merge_next(&merge) )
+    {
+	if ( (cache->contig_count == 0) ||
+	     (strcmp(row->chrom, cache->contigs[cache->contig_count - 1]) != 0) )
+	{
+	    if ( cache->contig_count == cache->max_contigs )
+	    {
+		cache->max_contigs = cache->max_contigs == 0 ? 64 :
+				     cache->max_contigs * 2;
+		cache->contigs = (char **)realloc(cache->contigs,
+				 cache->max_contigs * sizeof(char *));
+		if ( cache->contigs == NULL )
+		{
+		    fprintf(stderr, "cache_load(): Cannot allocate contigs.\n");
+		    fatal(EX_UNAVAILABLE);
+		}
+	    }
+	    if ( (cache->contigs[cache->contig_count++] =
+		  strdup(row->chrom)) == NULL )
+	    {
+		fprintf(stderr, "cache_load(): Cannot allocate contig.\n");
+		fatal(EX_UNAVAILABLE);
+	    }
+	}
+	for (c = 0; c < cache->file_list.count; ++c)
+	    if ( (row->ref[c] != DEPTH_MISSING) ||
+		 (row->ref_alt[c] != DEPTH_MISSING) )
+		cache_add_call(cache, c, row);
+    }
+    merge_close(&merge);
+    
+    /* The streams are final, release the slack */
+    for (c = 0; c < cache->file_list.count; ++c)
+    {
+	sample = &cache->samples[c];
+	if ( sample->len == 0 )
+	    continue;
+	sample->bytes = (unsigned char *)realloc(sample->bytes, sample->len);
+	sample->blocks = (cache_block_t *)realloc(sample->blocks,
+			 sample->block_count * sizeof(cache_block_t));
+	sample->max = sample->len;
+	sample->max_blocks = sample->block_count;
+    }
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Append sample c's call in row to its stream, starting a block
+ *      at a new contig or when the last is full
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    cache_add_call(cache_t *cache, size_t c, row_t *row)
+
+{
+    cache_sample_t  *sample = &cache->samples[c];
+    cache_block_t   *block;
+    uint32_t        contig = cache->contig_count - 1;
+    unsigned char   *p;
+    
+    if ( sample->len + CACHE_CALL_MAX > sample->max )
+    {
+	sample->max = sample->max == 0 ? 4096 : sample->max * 2;
+	sample->bytes = (unsigned char *)realloc(sample->bytes, sample->max);
+	if ( sample->bytes == NULL )
+	{
+	    fprintf(stderr, "cache_add_call(): Cannot allocate stream.\n");
+	    fatal(EX_UNAVAILABLE);
+	}
+    }
+    
+    if ( (sample->block_count == 0) ||
+	 (sample->block_calls == CACHE_BLOCK_CALLS) ||
+	 (sample->blocks[sample->block_count - 1].contig != contig) )
+    {
+	if ( sample->block_count == sample->max_blocks )
+	{
+	    sample->max_blocks = sample->max_blocks == 0 ? 64 :
+				 sample->max_blocks * 2;
+	    sample->blocks = (cache_block_t *)realloc(sample->blocks,
+			     sample->max_blocks * sizeof(cache_block_t));
+	    if ( sample->blocks == NULL )
+	    {
+		fprintf(stderr, "cache_add_call(): Cannot allocate index.\n");
+		fatal(EX_UNAVAILABLE);
+	    }
+	}
+	block = &sample->blocks[sample->block_count++];
+	block->contig = contig;
+	block->pos = row->pos;
+	block->offset = sample->len;
+	sample->block_calls = 0;
+	sample->last_pos = row->pos;
+    }
+    
+    p = sample->bytes + sample->len;
+    p = put_varint(p, row->pos - sample->last_pos);
+    p = put_varint(p, (depth_t)(row->ref[c] + 1));
+    p = put_varint(p, (depth_t)(row->alt[c] + 1));
+    p = put_varint(p, (depth_t)(row->ref_alt[c] + 1));
+    sample->len = p - sample->bytes;
+    sample->last_pos = row->pos;
+    ++sample->block_calls;
+    ++cache->calls;
+}
+
+
+size_t  cache_bytes(cache_t *cache)
+
+{
+    size_t  c,
+	    bytes = 0;
+    
+    for (c = 0; c < cache->file_list.count; ++c)
+	bytes += cache->samples[c].max +
+		 cache->samples[c].max_blocks * sizeof(cache_block_t);
+    return bytes;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Position cursor at the first call of sample at or after POS pos
+ *      of contig.  have_call is false if there is none.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    cache_seek(cache_cursor_t *cursor, cache_sample_t *sample,
+		   uint32_t contig, int64_t pos)
+
+{
+    cache_block_t   *blocks = sample->blocks;
+    size_t          low = 0,
+		    high = sample->block_count,
+		    mid;
+    
+    /* Last block starting at or before the position, if any */
+    while ( high - low > 1 )
+    {
+	mid = low + (high - low) / 2;
+	if ( (blocks[mid].contig < contig) ||
+	     ((blocks[mid].contig == contig) && (blocks[mid].pos <= pos)) )
+	    low = mid;
+	else
+	    high = mid;
+    }
+    
+    cursor->sample = sample;
+    if ( (cursor->have_call = (sample->block_count != 0)) == false )
+	return;
+    cursor->block = low;
+    cursor->offset = blocks[low].offset;
+    cursor->pos = blocks[low].pos;
+    do
+	cache_next(cursor);
+    while ( cursor->have_call && ((cursor->contig < contig) ||
+	    ((cursor->contig == contig) && (cursor->pos < pos))) );
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Decode the next call of a cursor's stream
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    cache_next(cache_cursor_t *cursor)
+
+{
+    cache_sample_t  *sample = cursor->sample;
+    unsigned char   *p;
+    
+    if ( cursor->offset == sample->len )
+    {
+	cursor->have_call = false;
+	return;
+    }
+    
+    /* POS deltas restart at each block */
+    if ( (cursor->block + 1 < sample->block_count) &&
+	 (cursor->offset == sample->blocks[cursor->block + 1].offset) )
+    {
+	++cursor->block;
+	cursor->pos = sample->blocks[cursor->block].pos;
+    }
+    cursor->contig = sample->blocks[cursor->block].contig;
+    
+    p = sample->bytes + cursor->offset;
+    cursor->pos += get_varint(&p);
+    cursor->ref = get_varint(&p) - 1;
+    cursor->alt = get_varint(&p) - 1;
+    cursor->ref_alt = get_varint(&p) - 1;
+    cursor->offset = p - sample->bytes;
+}
+
+
+/* LEB128: 7 bits per byte, low first, high bit set if more follow */
+unsigned char   *put_varint(unsigned char *p, uint64_t value)
+
+{
+    while ( value >= 0x80 )
+    {
+	*p++ = (value & 0x7f) | 0x80;
+	value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+
+uint64_t    get_varint(unsigned char **p)
+
+{
+    uint64_t    value = 0;
+    int         shift = 0;
+    
+    while ( **p & 0x80 )
+    {
+	value |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+	shift += 7;
+    }
+    value |= (uint64_t)*(*p)++ << shift;
+    return value;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Listen on a Unix socket at socket_path, replacing a socket left
+ *      by an earlier run
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     serve_listen(char *socket_path)
+
+{
+    struct sockaddr_un  addr;
+    struct stat         st;
+    mode_t              old_mask;
+    int                 fd;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if ( strlen(socket_path) >= sizeof(addr.sun_path) )
+    {
+	fprintf(stderr, "ad-matrix: Socket path %s is too long.\n",
+		socket_path);
+	exit(EX_USAGE);
+    }
+    strcpy(addr.sun_path, socket_path);
+    if ( (stat(socket_path, &st) == 0) && S_ISSOCK(st.st_mode) )
+	unlink(socket_path);
+    
+    /* Created 0600, not as the umask would have it */
+    if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1 )
+    {
+	old_mask = umask(0077);
+	if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 )
+	    fd = -1;
+	umask(old_mask);
+    }
+    if ( (fd == -1) || (chmod(socket_path, 0600) == -1) ||
+	 (listen(fd, SOMAXCONN) == -1) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot listen on %s: %s\n",
+		socket_path, strerror(errno));
+	exit(EX_OSERR);
+    }
+    return fd;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read and answer one request (see the top of this file).  Runs
+ *      in a child, with stderr going to the client, so that errors
+ *      reported by shared code reach it too.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    serve_request(cache_t *cache, int fd)
+
+{
+    FILE    *in_fp,
+	    *out_fp;
+    char    *line,
+	    chrom[CHROM_MAX_CHARS + 1],
+	    *p,
+	    *which,
+	    *region,
+	    *spec,
+	    *calls,
+	    *end;
+    bool    *selected;
+    size_t  c,
+	    min_calls;
+    int64_t start,
+	    stop;
+    
+    signal(SIGCHLD, SIG_DFL);
+    dup2(fd, STDERR_FILENO);
+    if ( ((in_fp = fdopen(fd, "r")) == NULL) ||
+	 ((out_fp = fdopen(dup(fd), "w")) == NULL) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open connection: %s\n",
+		strerror(errno));
+	exit(EX_OSERR);
+    }
+    
+    if ( (line = (char *)malloc(SERVE_REQUEST_MAX + 1)) == NULL )
+    {
+	fprintf(stderr, "serve_request(): Cannot allocate request.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    if ( fgets(line, SERVE_REQUEST_MAX + 1, in_fp) == NULL )
+	exit(EX_OK);
+    line[strcspn(line, "\r\n")] = '\0';
+    p = line;
+    which = strsep(&p, "\t");
+    region = strsep(&p, "\t");
+    spec = strsep(&p, "\t");
+    calls = strsep(&p, "\t");
+    if ( (calls == NULL) || (p != NULL) )
+    {
+	fprintf(stderr, "ad-matrix serve: Malformed request.\n");
+	exit(EX_DATAERR);
+    }
+    if ( (strcmp(which, "ref") != 0) && (strcmp(which, "alt") != 0) &&
+	 (strcmp(which, "ref+alt") != 0) && (strcmp(which, "columns") != 0) )
+    {
+	fprintf(stderr, "ad-matrix serve: Unknown matrix %s.\n", which);
+	exit(EX_DATAERR);
+    }
+    min_calls = strtoul(calls, &end, 10);
+    if ( (*end != '\0') || (min_calls == 0) )
+    {
+	fprintf(stderr, "ad-matrix serve: Invalid MIN-CALLS %s.\n", calls);
+	exit(EX_DATAERR);
+    }
+    if ( (strcmp(which, "columns") != 0) &&
+	 ! parse_region(region, chrom, &start, &stop) )
+    {
+	fprintf(stderr, "ad-matrix serve: Invalid region %s.\n", region);
+	exit(EX_DATAERR);
+    }
+    
+    /* @FILE would be opened with the daemon's permissions */
+    if ( *spec == '@' )
+    {
+	fprintf(stderr, "ad-matrix serve: SAMPLES cannot be @FILE.\n");
+	exit(EX_DATAERR);
+    }
+    
+    if ( (selected = (bool *)malloc(cache->file_list.count *
+				    sizeof(bool))) == NULL )
+    {
+	fprintf(stderr, "serve_request(): Cannot allocate array.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = 0; c < cache->file_list.count; ++c)
+	selected[c] = (strcmp(spec, "-") == 0);
+    if ( strcmp(spec, "-") != 0 )
+	select_samples(spec, cache->file_list.filename,
+		       cache->file_list.list_index, cache->file_list.count,
+		       selected, true);
+    
+    fputs("OK\n", out_fp);
+    if ( strcmp(which, "columns") == 0 )
+    {
+	for (c = 0; c < cache->file_list.count; ++c)
+	    if ( selected[c] )
+		fprintf(out_fp, "%zu\t%s\n",
+			column_index(&cache->file_list, c),
+			column_name(&cache->file_list, c));
+    }
+    else
+	serve_matrix(cache, out_fp, which, chrom, start, stop, selected,
+		     min_calls);
+    fclose(out_fp);
+    fclose(in_fp);
+    free(selected);
+    free(line);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Split CHROM or CHROM:START-END.  CHROM alone is the whole contig.
+ *      Contig names may themselves contain ':'.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    parse_region(char *spec, char *chrom, int64_t *start, int64_t *end)
+
+{
+    char    *colon,
+	    *p;
+    size_t  len = strlen(spec);
+    
+    *start = 1;
+    *end = INT64_MAX;
+    if ( (colon = strrchr(spec, ':')) != NULL )
+    {
+	*start = strtoll(colon + 1, &p, 10);
+	if ( (p != colon + 1) && (*p == '-') )
+	{
+	    *end = strtoll(p + 1, &p, 10);
+	    if ( (*p == '\0') && (*start >= 1) && (*end >= *start) )
+		len = colon - spec;
+	    else
+		return false;
+	}
+	else
+	    *start = 1;
+    }
+    if ( (len == 0) || (len > CHROM_MAX_CHARS) )
+	return false;
+    memcpy(chrom, spec, len);
+    chrom[len] = '\0';
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the rows of matrix which in a region for the selected
+ *      samples, dropping rows with fewer than min_calls calls among
+ *      them
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    serve_matrix(cache_t *cache, FILE *fp, char *which, char *chrom,
+		     int64_t start, int64_t end, bool selected[],
+		     size_t min_calls)
+
+{
+    cache_cursor_t  *cursors,
+		    *cursor;
+    depth_t         *depths;
+    size_t          c,
+		    count,
+		    calls;
+    uint32_t        contig;
+    int64_t         pos;
+    
+    for (contig = 0; contig < cache->contig_count; ++contig)
+	if ( strcmp(cache->contigs[contig], chrom) == 0 )
+	    break;
+    if ( contig == cache->contig_count )
+	return;     // No calls on chrom, so no rows
+    
+    cursors = (cache_cursor_t *)malloc(cache->file_list.count *
+				       sizeof(cache_cursor_t));
+    depths = (depth_t *)malloc(cache->file_list.count * sizeof(depth_t));
+    if ( (cursors == NULL) || (depths == NULL) )
+    {
+	fprintf(stderr, "serve_matrix(): Cannot allocate cursors.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (c = count = 0; c < cache->file_list.count; ++c)
+	if ( selected[c] )
+	    cache_seek(&cursors[count++], &cache->samples[c], contig, start);
+    
+    while ( true )
+    {
+	/* Low POS in the region among the selected samples */
+	pos = INT64_MAX;
+	for (c = 0; c < count; ++c)
+	{
+	    cursor = &cursors[c];
+	    if ( cursor->have_call && (cursor->contig == contig) &&
+		 (cursor->pos < pos) )
+		pos = cursor->pos;
+	}
+	if ( (pos == INT64_MAX) || (pos > end) )
+	    break;
+    
+	for (c = calls = 0; c < count; ++c)
+	{
+	    cursor = &cursors[c];
+	    if ( cursor->have_call && (cursor->contig == contig) &&
+		 (cursor->pos == pos) )
+	    {
+		depths[c] = strcmp(which, "ref") == 0 ? cursor->ref :
+			    strcmp(which, "alt") == 0 ? cursor->alt :
+			    cursor->ref_alt;
+		++calls;
+		cache_next(cursor);
+	    }
+	    else
+		depths[c] = DEPTH_MISSING;
+	}
+	if ( calls < min_calls )
+	    continue;
+    
+	fprintf(fp, "%s\t%" PRId64 "\t", chrom, pos);
+	for (c = 0; c < count; ++c)
+	{
+	    put_depth(depths[c], fp);
+	    putc('\t', fp);
+	}
+	putc('\n', fp);
+    }
+    free(cursors);
+    free(depths);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      ad-matrix request: send one request to ad-matrix serve and copy
+ *      the matrix to stdout
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     serve_client(int argc, char *argv[])
+
+{
+    struct sockaddr_un  addr;
+    FILE    *fp;
+    char    *samples = "-",
+	    *region = "-",
+	    *which,
+	    *line;
+    size_t  min_calls = 1,
+	    len;
+    int     arg,
+	    fd,
+	    ch;
+    
+    for (arg = 2; (arg < argc) && (*argv[arg] == '-'); ++arg)
+    {
+	if ( (strcmp(argv[arg], "--samples") == 0) && (arg + 1 < argc) )
+	    samples = argv[++arg];
+	else if ( strcmp(argv[arg], "--min-calls") == 0 )
+	    min_calls = depth_arg(argv, ++arg);
+	else
+	    client_usage(argv);
+    }
+    if ( (argc - arg != 2) && (argc - arg != 3) )
+	client_usage(argv);
+    which = argv[arg + 1];
+    if ( argc - arg == 3 )
+	region = argv[arg + 2];
+    else if ( strcmp(which, "columns") != 0 )
+	client_usage(argv);
+    
+    if ( *samples == '@' )
+	samples = read_sample_file(samples + 1);
+    if ( (line = (char *)malloc(SERVE_REQUEST_MAX + 1)) == NULL )
+    {
+	fprintf(stderr, "serve_client(): Cannot allocate request.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    len = snprintf(line, SERVE_REQUEST_MAX + 1, "%s\t%s\t%s\t%zu\n",
+		   which, region, samples, min_calls);
+    if ( len > SERVE_REQUEST_MAX )
+    {
+	fprintf(stderr, "ad-matrix: Request too long.\n");
+	exit(EX_USAGE);
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[arg]);
+    if ( ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) ||
+	 (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot connect to %s: %s\n",
+		argv[arg], strerror(errno));
+	exit(EX_UNAVAILABLE);
+    }
+    if ( (write(fd, line, len) != (ssize_t)len) ||
+	 (shutdown(fd, SHUT_WR) == -1) ||
+	 ((fp = fdopen(fd, "r")) == NULL) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot send request: %s\n",
+		strerror(errno));
+	exit(EX_IOERR);
+    }
+    
+    /* Anything but OK is an error message */
+    if ( fgets(line, SERVE_REQUEST_MAX + 1, fp) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: No response from %s.\n", argv[arg]);
+	exit(EX_PROTOCOL);
+    }
+    if ( strcmp(line, "OK\n") != 0 )
+    {
+	fputs(line, stderr);
+	while ( (ch = getc(fp)) != EOF )
+	    putc(ch, stderr);
+	exit(EX_DATAERR);
+    }
+    while ( (ch = getc(fp)) != EOF )
+	putchar(ch);
+    fclose(fp);
+    free(line);
+    return EX_OK;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read a --samples @FILE list on the client side, returning it as
+ *      a comma-separated list to send in place of @FILE
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+char    *read_sample_file(char *filename)
+
+{
+    FILE    *fp;
+    char    line[PATH_MAX + 1],
+	    *list;
+    size_t  len,
+	    list_len = 0;
+    
+    if ( (fp = fopen(filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    if ( (list = (char *)malloc(SERVE_REQUEST_MAX + 1)) == NULL )
+    {
+	fprintf(stderr, "read_sample_file(): Cannot allocate list.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    *list = '\0';
+    while ( fgets(line, PATH_MAX + 1, fp) != NULL )
+    {
+	len = strcspn(line, "\r\n");
+	line[len] = '\0';
+	if ( len == 0 )
+	    continue;
+	if ( strpbrk(line, ",\t") != NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Sample %s in %s cannot be sent.\n",
+		    line, filename);
+	    exit(EX_DATAERR);
+	}
+	if ( list_len + len + 1 > SERVE_REQUEST_MAX )
+	{
+	    fprintf(stderr, "ad-matrix: %s is too long.\n", filename);
+	    exit(EX_USAGE);
+	}
+	if ( list_len > 0 )
+	    list[list_len++] = ',';
+	strcpy(list + list_len, line);
+	list_len += len;
+    }
+    fclose(fp);
+    if ( list_len == 0 )
+    {
+	fprintf(stderr, "ad-matrix: %s lists no samples.\n", filename);
+	exit(EX_DATAERR);
+    }
+    return list;
+}
+
+
+void    serve_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s serve [options] filename-with-list-of-VCFs socket-path\n", argv[0]);
+    fprintf(stderr, "Merge the VCFs into memory once and answer matrix requests for a region and\n");
+    fprintf(stderr, "a subset of the samples on the Unix socket socket-path, e.g. from\n");
+    fprintf(stderr, "ad-matrix request.  Calls are held compressed, indexed by position.\n");
+    fprintf(stderr, "socket-path is created mode 0600, so only the same user can connect, unless\n");
+    fprintf(stderr, "its mode is changed after it is created.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --min-dp N, --min-gq N, --min-ref-alt N, --max-ref-alt N\n");
+    fprintf(stderr, "  --samples LIST, --exclude-samples LIST, --gvcf\n");
+    fprintf(stderr, "                   As for ad-matrix, applied when the VCFs are loaded\n");
+    exit(EX_USAGE);
+}
+
+
+void    client_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s request [options] socket-path ref|alt|ref+alt CHROM[:START-END]\n", argv[0]);
+    fprintf(stderr, "       %s request [options] socket-path columns\n", argv[0]);
+    fprintf(stderr, "Print a matrix, or its columns, from ad-matrix serve.  START and END are\n");
+    fprintf(stderr, "1-based and inclusive.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --samples LIST   Only the samples in LIST, as for ad-matrix --samples,\n");
+    fprintf(stderr, "                   with indexes into the VCF list, as in columns.  @FILE\n");
+    fprintf(stderr, "                   is read here and sent as a list of names.\n");
+    fprintf(stderr, "  --min-calls N    Drop rows with fewer than N calls among them [1]\n");
+    exit(EX_USAGE);
+}
@@ -0,0 +1,760 @@
+/***************************************************************************
+ *  Description:
+ *      Incremental re-runs.  With --incremental, each output is written
+ *      as one shard per contig under <stem>-shards/, and the final
+ *      outputs are assembled by concatenating the shards, which are
+ *      complete xz streams.
+ *
+ *      <stem>-manifest.tsv maps each contig to a fingerprint of its
+ *      inputs: a hash of the contig's lines in every VCF, combined with
+ *      a hash of the sample list and the options affecting the output.
+ *      A re-run reuses the shards whose fingerprint is unchanged,
+ *      seeking every VCF past the contig, and merges only the rest.
+ *
+ *      Hashing the VCFs is a sequential read with no parsing, much
+ *      cheaper than the merge it can save.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+#include <biolibc/biostring.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Fingerprint the contigs of every VCF, and decide which shards of
+ *      the previous run can be reused.  Must be called before the first
+ *      call is read, since the VCFs are read through and rewound.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shards_open(shards_t *shards, char *matrix_stem, file_list_t *file_list,
+		    matrix_out_t outs[], size_t out_count, matrix_opts_t *opts)
+
+{
+    char        path[PATH_MAX + 1];
+    size_t      c,
+		g,
+		o,
+		p,
+		old,
+		reused = 0;
+    uint64_t    params;
+    shard_t     *shard;
+    contig_t    *contig;
+    struct stat st;
+    
+    memset(shards, 0, sizeof(*shards));
+    snprintf(shards->manifest_filename, PATH_MAX, "%s-manifest.tsv",
+	     matrix_stem);
+    shards->out_count = out_count;
+    shards->sample_count = file_list->count;
+    for (o = 0; o < out_count; ++o)
+    {
+	snprintf(path, PATH_MAX, "%s-shards", outs[o].stem);
+	if ( (mkdir(path, 0777) != 0) && (errno != EEXIST) )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_CANTCREAT);
+	}
+    }
+    
+    shards->contigs = (contig_t **)calloc(file_list->count, sizeof(contig_t *));
+    shards->contig_count = (size_t *)calloc(file_list->count, sizeof(size_t));
+    shards->next = (size_t *)calloc(file_list->count, sizeof(size_t));
+    shards->start_rows = (size_t *)calloc(2 * out_count, sizeof(size_t));
+    if ( (shards->contigs == NULL) || (shards->contig_count == NULL) ||
+	 (shards->next == NULL) || (shards->start_rows == NULL) )
+    {
+	fprintf(stderr, "shards_open(): Could not allocate contigs.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    puts("Fingerprinting contigs...");
+    for (c = 0; c < file_list->count; ++c)
+    {
+	scan_contigs(shards, file_list, c);
+	add_contigs(shards, c);
+    }
+    
+    /* Shard fingerprint: options, sample list, and the contig in each VCF */
+    params = params_hash(file_list, opts);
+    for (g = 0; g < shards->shard_count; ++g)
+    {
+	shard = &shards->shards[g];
+	shard->fingerprint = fnv_hash(params, shard->chrom,
+				      strlen(shard->chrom) + 1);
+	for (c = 0; c < file_list->count; ++c)
+	{
+	    contig = shards->contigs[c];
+	    while ( (shards->next[c] < shards->contig_count[c]) &&
+		    (bl_chrom_name_cmp(contig[shards->next[c]].chrom,
+				       shard->chrom) < 0) )
+		++shards->next[c];
+	    if ( (shards->next[c] < shards->contig_count[c]) &&
+		 (strcmp(contig[shards->next[c]].chrom, shard->chrom) == 0) )
+	    {
+		shard->fingerprint = fnv_hash(shard->fingerprint, &c, sizeof(c));
+		shard->fingerprint = fnv_hash(shard->fingerprint,
+				&contig[shards->next[c]].hash, sizeof(uint64_t));
+	    }
+	}
+	if ( (shard->rows = (size_t *)calloc(2 * out_count, sizeof(size_t)))
+	     == NULL )
+	{
+	    fprintf(stderr, "shards_open(): Could not allocate shards.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+    }
+    memset(shards->next, 0, file_list->count * sizeof(size_t));
+    
+    /* Reuse shards with the same fingerprint if their files are intact */
+    read_manifest(shards);
+    for (g = old = 0; g < shards->shard_count; ++g)
+    {
+	shard = &shards->shards[g];
+	while ( (old < shards->old_count) &&
+		(bl_chrom_name_cmp(shards->old[old].chrom, shard->chrom) < 0) )
+	    ++old;
+	if ( (old == shards->old_count) ||
+	     (strcmp(shards->old[old].chrom, shard->chrom) != 0) ||
+	     (shards->old[old].fingerprint != shard->fingerprint) )
+	    continue;
+	shard->done = true;
+	for (o = 0; o < out_count; ++o)
+	{
+	    for (p = 0; p < outs[o].suffix_count; ++p)
+	    {
+		shard_path(path, &outs[o], shard->chrom, outs[o].suffixes[p]);
+		if ( stat(path, &st) != 0 )
+		    shard->done = false;
+	    }
+	}
+	if ( shard->done )
+	{
+	    memcpy(shard->rows, shards->old[old].rows,
+		   2 * out_count * sizeof(size_t));
+	    ++reused;
+	}
+    }
+    printf("%zu of %zu shards reused.\n", reused, shards->shard_count);
+    shards->current = shards->shard_count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Finish the last shard, record the shards in the manifest, and
+ *      assemble the final outputs
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shards_close(shards_t *shards, matrix_out_t outs[], size_t out_count)
+
+{
+    char    path[PATH_MAX + 1];
+    size_t  c,
+	    k,
+	    g,
+	    o,
+	    p,
+	    old;
+    
+    shard_end(shards, outs, out_count);
+    write_manifest(shards);
+    for (o = 0; o < out_count; ++o)
+	assemble_outputs(shards, &outs[o]);
+    
+    /* Remove shards of contigs no longer in the inputs */
+    for (old = g = 0; old < shards->old_count; ++old)
+    {
+	while ( (g < shards->shard_count) &&
+		(bl_chrom_name_cmp(shards->shards[g].chrom,
+				   shards->old[old].chrom) < 0) )
+	    ++g;
+	if ( (g < shards->shard_count) &&
+	     (strcmp(shards->shards[g].chrom, shards->old[old].chrom) == 0) )
+	    continue;
+	for (o = 0; o < out_count; ++o)
+	{
+	    for (p = 0; p < outs[o].suffix_count; ++p)
+	    {
+		shard_path(path, &outs[o], shards->old[old].chrom,
+			   outs[o].suffixes[p]);
+		unlink(path);
+	    }
+	}
+    }
+    
+    for (g = 0; g < shards->shard_count; ++g)
+	free(shards->shards[g].rows);
+    free(shards->shards);
+    for (old = 0; old < shards->old_count; ++old)
+    {
+	free(shards->old[old].chrom);
+	free(shards->old[old].rows);
+    }
+    free(shards->old);
+    for (c = 0; c < shards->sample_count; ++c)
+    {
+	for (k = 0; k < shards->contig_count[c]; ++k)
+	    free(shards->contigs[c][k].chrom);
+	free(shards->contigs[c]);
+    }
+    free(shards->contigs);
+    free(shards->contig_count);
+    free(shards->next);
+    free(shards->start_rows);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Called with the key of each row before it is merged.  When chrom
+ *      starts a new shard, finish the previous one, then either skip
+ *      the contig in every VCF if the shard is reused, or open the
+ *      shard's pipes.  Returns true if the contig was skipped.
+ *      Installed as merge->skip_contig by build_matrix().
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    shard_skip(merge_t *merge, char *chrom)
+
+{
+    shards_t    *shards = merge->shards;
+    file_list_t *file_list = merge->file_list;
+    matrix_out_t    *outs = merge->outs;
+    size_t      out_count = merge->out_count;
+    char        stem[PATH_MAX + 1];
+    size_t      c,
+		g,
+		o;
+    shard_t     *shard;
+    contig_t    *contig;
+    
+    if ( (shards->current < shards->shard_count) &&
+	 (strcmp(shards->shards[shards->current].chrom, chrom) == 0) )
+	return false;
+    
+    shard_end(shards, outs, out_count);
+    g = shards->current == shards->shard_count ? 0 : shards->current + 1;
+    while ( (g < shards->shard_count) &&
+	    (strcmp(shards->shards[g].chrom, chrom) != 0) )
+	++g;
+    if ( g == shards->shard_count )
+    {
+	fprintf(stderr, "ad-matrix: %s changed since it was fingerprinted.\n",
+		chrom);
+	exit(EX_DATAERR);
+    }
+    shards->current = g;
+    shard = &shards->shards[g];
+    
+    if ( shard->done )
+    {
+	for (o = 0; o < out_count; ++o)
+	{
+	    outs[o].rows += shard->rows[2 * o];
+	    outs[o].dropped_rows += shard->rows[2 * o + 1];
+	}
+	for (c = 0; c < file_list->count; ++c)
+	{
+	    if ( (file_list->fp[c] == NULL) ||
+		 (strcmp(BL_VCF_CHROM(&file_list->call[c]), chrom) != 0) )
+		continue;
+	    contig = shards->contigs[c];
+	    while ( strcmp(contig[shards->next[c]].chrom, chrom) != 0 )
+		++shards->next[c];
+	    fseeko(file_list->fp[c], contig[shards->next[c]].end, SEEK_SET);
+	    next_call(file_list, c);
+	}
+	return true;
+    }
+    
+    for (o = 0; o < out_count; ++o)
+    {
+	shard_stem(stem, &outs[o], chrom);
+	open_out_pipes(&outs[o], stem, false);
+	shards->start_rows[2 * o] = outs[o].rows;
+	shards->start_rows[2 * o + 1] = outs[o].dropped_rows;
+    }
+    return false;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Close the pipes of the shard being written and note its rows
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shard_end(shards_t *shards, matrix_out_t outs[], size_t out_count)
+
+{
+    shard_t *shard;
+    size_t  o;
+    
+    if ( shards->current == shards->shard_count )
+	return;
+    shard = &shards->shards[shards->current];
+    if ( shard->done )
+	return;
+    for (o = 0; o < out_count; ++o)
+    {
+	close_out_pipes(&outs[o]);
+	shard->rows[2 * o] = outs[o].rows - shards->start_rows[2 * o];
+	shard->rows[2 * o + 1] = outs[o].dropped_rows -
+				 shards->start_rows[2 * o + 1];
+    }
+    
+    shard->done = true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Stem of an output's shard for chrom, <stem>-shards/<chrom>, and
+ *      the path of one of its files
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shard_stem(char *stem, matrix_out_t *out, char *chrom)
+
+{
+    snprintf(stem, PATH_MAX, "%s-shards/%s", out->stem, chrom);
+}
+
+
+void    shard_path(char *path, matrix_out_t *out, char *chrom, char *suffix)
+
+{
+    snprintf(path, PATH_MAX, "%s-shards/%s-%s.tsv.xz", out->stem, chrom,
+	     suffix);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read VCF c through, recording the end offset and a hash of the
+ *      data lines of each contig, then rewind it
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    scan_contigs(shards_t *shards, file_list_t *file_list, size_t c)
+
+{
+    FILE        *fp = file_list->fp[c];
+    char        *line = NULL;
+    size_t      line_max = 0,
+		chrom_len,
+		count = 0,
+		max = 16;
+    ssize_t     len;
+    off_t       offset = 0;
+    contig_t    *contigs,
+		*contig = NULL;
+    
+    if ( ftello(fp) == -1 )
+    {
+	fprintf(stderr, "ad-matrix: --incremental: %s is not seekable.\n",
+		file_list->filename[c]);
+	exit(EX_USAGE);
+    }
+    if ( (contigs = (contig_t *)malloc(max * sizeof(contig_t))) == NULL )
+    {
+	fprintf(stderr, "scan_contigs(): Could not allocate contigs.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    while ( (len = getline(&line, &line_max, fp)) != -1 )
+    {
+	if ( *line != '#' )
+	{
+	    chrom_len = strcspn(line, "\t\n");
+	    if ( (contig == NULL) || (strncmp(contig->chrom, line, chrom_len)
+				      != 0) || (contig->chrom[chrom_len] != '\0') )
+	    {
+		if ( count == max )
+		{
+		    max *= 2;
+		    if ( (contigs = (contig_t *)realloc(contigs,
+				    max * sizeof(contig_t))) == NULL )
+		    {
+			fprintf(stderr, "scan_contigs(): Could not allocate contigs.\n");
+			exit(EX_UNAVAILABLE);
+		    }
+		}
+		contig = &contigs[count++];
+		if ( (contig->chrom = strndup(line, chrom_len)) == NULL )
+		{
+		    fprintf(stderr, "scan_contigs(): Could not allocate chrom.\n");
+		    exit(EX_UNAVAILABLE);
+		}
+		if ( (count > 1) &&
+		     (bl_chrom_name_cmp(contig->chrom, contig[-1].chrom) <= 0) )
+		{
+		    fprintf(stderr, "ad-matrix: %s is not sorted: %s follows %s.\n",
+			    file_list->filename[c], contig->chrom,
+			    contig[-1].chrom);
+		    exit(EX_DATAERR);
+		}
+		contig->hash = FNV_OFFSET;
+	    }
+	    contig->hash = fnv_hash(contig->hash, line, len);
+	    contig->end = offset + len;
+	}
+	offset += len;
+    }
+    free(line);
+    rewind(fp);
+    shards->contigs[c] = contigs;
+    shards->contig_count[c] = count;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Merge the contigs of VCF c into the shard list.  Both are in VCF
+ *      sort order.  Shards share the chrom strings of the contigs.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    add_contigs(shards_t *shards, size_t c)
+
+{
+    contig_t    *contigs = shards->contigs[c];
+    size_t      count = shards->contig_count[c],
+		s,
+		k,
+		n;
+    shard_t     *merged;
+    int         cmp;
+    
+    merged = (shard_t *)calloc(shards->shard_count + count, sizeof(shard_t));
+    if ( merged == NULL )
+    {
+	fprintf(stderr, "add_contigs(): Could not allocate shards.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    for (s = k = n = 0; (s < shards->shard_count) || (k < count); ++n)
+    {
+	if ( s == shards->shard_count )
+	    cmp = 1;
+	else if ( k == count )
+	    cmp = -1;
+	else
+	    cmp = bl_chrom_name_cmp(shards->shards[s].chrom, contigs[k].chrom);
+	if ( cmp <= 0 )
+	{
+	    merged[n] = shards->shards[s++];
+	    if ( cmp == 0 )
+		++k;
+	}
+	else
+	    merged[n].chrom = contigs[k++].chrom;
+    }
+    free(shards->shards);
+    shards->shards = merged;
+    shards->shard_count = n;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Hash of everything other than the VCF contents that affects the
+ *      output rows: the sample list and the merge options
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+uint64_t    params_hash(file_list_t *file_list, matrix_opts_t *opts)
+
+{
+    uint64_t    hash = FNV_OFFSET,
+		annot_hash;
+    size_t      c,
+		k;
+    char        *group;
+    
+    hash = fnv_hash(hash, MANIFEST_VERSION, strlen(MANIFEST_VERSION));
+    hash = fnv_hash(hash, &opts->mask, sizeof(opts->mask));
+    hash = fnv_hash(hash, &opts->min_calls, sizeof(opts->min_calls));
+    hash = fnv_hash(hash, &opts->gvcf, sizeof(opts->gvcf));
+    hash = fnv_hash(hash, &opts->aggregate, sizeof(opts->aggregate));
+    for (k = 0; k < opts->cohort_count; ++k)
+    {
+	hash = fnv_hash(hash, opts->cohorts[k].name,
+			strlen(opts->cohorts[k].name) + 1);
+	hash = fnv_hash(hash, opts->cohorts[k].spec,
+			strlen(opts->cohorts[k].spec) + 1);
+    }
+    if ( opts->annotate_filename != NULL )
+    {
+	annot_hash = file_hash(opts->annotate_filename);
+	hash = fnv_hash(hash, &annot_hash, sizeof(annot_hash));
+    }
+    for (c = 0; c < file_list->count; ++c)
+    {
+	group = file_list->group[c] == NULL ? "" : file_list->group[c];
+	hash = fnv_hash(hash, &file_list->list_index[c], sizeof(size_t));
+	hash = fnv_hash(hash, file_list->filename[c],
+			strlen(file_list->filename[c]) + 1);
+	hash = fnv_hash(hash, group, strlen(group) + 1);
+    }
+    return hash;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      64-bit FNV-1a hash of data, continuing from hash
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+uint64_t    fnv_hash(uint64_t hash, void *data, size_t len)
+
+{
+    unsigned char   *p = data,
+		    *end = p + len;
+    
+    while ( p < end )
+	hash = (hash ^ *p++) * FNV_PRIME;
+    return hash;
+}
+
+
+uint64_t    file_hash(char *filename)
+
+{
+    FILE        *fp;
+    char        buff[65536];
+    size_t      len;
+    uint64_t    hash = FNV_OFFSET;
+    
+    if ( (fp = fopen(filename, "r")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_NOINPUT);
+    }
+    while ( (len = fread(buff, 1, sizeof(buff), fp)) > 0 )
+	hash = fnv_hash(hash, buff, len);
+    fclose(fp);
+    return hash;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Read the shards of the previous run.  Lines that do not have
+ *      the current number of outputs are ignored, since their shards
+ *      cannot be reused anyway.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    read_manifest(shards_t *shards)
+
+{
+    FILE    *fp;
+    char    field[CHROM_MAX_CHARS + 1],
+	    *end;
+    size_t  len,
+	    max = 64,
+	    fields;
+    int     delim;
+    shard_t *old;
+    
+    if ( (fp = fopen(shards->manifest_filename, "r")) == NULL )
+	return;
+    if ( (shards->old = (shard_t *)malloc(max * sizeof(shard_t))) == NULL )
+    {
+	fprintf(stderr, "read_manifest(): Could not allocate shards.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    
+    while ( (delim = xt_tsv_read_field(fp, field, CHROM_MAX_CHARS, &len))
+	    != EOF )
+    {
+	if ( *field == '#' )
+	{
+	    while ( (delim != '\n') && (delim != EOF) )
+		delim = getc(fp);
+	    continue;
+	}
+	if ( shards->old_count == max )
+	{
+	    max *= 2;
+	    if ( (shards->old = (shard_t *)realloc(shards->old,
+				max * sizeof(shard_t))) == NULL )
+	    {
+		fprintf(stderr, "read_manifest(): Could not allocate shards.\n");
+		exit(EX_UNAVAILABLE);
+	    }
+	}
+	old = &shards->old[shards->old_count];
+	old->chrom = strdup(field);
+	old->rows = (size_t *)calloc(2 * shards->out_count, sizeof(size_t));
+	if ( (old->chrom == NULL) || (old->rows == NULL) )
+	{
+	    fprintf(stderr, "read_manifest(): Could not allocate shard.\n");
+	    exit(EX_UNAVAILABLE);
+	}
+	for (fields = 1; delim == '\t'; ++fields)
+	{
+	    delim = xt_tsv_read_field(fp, field, CHROM_MAX_CHARS, &len);
+	    if ( fields == 1 )
+		old->fingerprint = strtoull(field, &end, 16);
+	    else if ( fields - 2 < 2 * shards->out_count )
+		old->rows[fields - 2] = strtoul(field, &end, 10);
+	}
+	if ( fields == 2 + 2 * shards->out_count )
+	    ++shards->old_count;
+	else
+	{
+	    free(old->chrom);
+	    free(old->rows);
+	}
+    }
+    fclose(fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the manifest: CHROM, FINGERPRINT, then ROWS and FILTERED
+ *      for each output
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    write_manifest(shards_t *shards)
+
+{
+    FILE    *fp;
+    size_t  g,
+	    o;
+    shard_t *shard;
+    
+    if ( (fp = fopen(shards->manifest_filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		shards->manifest_filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    fprintf(fp, "#CHROM\tFINGERPRINT");
+    for (o = 0; o < shards->out_count; ++o)
+	fprintf(fp, "\tROWS\tFILTERED");
+    putc('\n', fp);
+    for (g = 0; g < shards->shard_count; ++g)
+    {
+	shard = &shards->shards[g];
+	if ( ! shard->done )
+	    continue;
+	fprintf(fp, "%s\t%016" PRIx64, shard->chrom, shard->fingerprint);
+	for (o = 0; o < 2 * shards->out_count; ++o)
+	    fprintf(fp, "\t%zu", shard->rows[o]);
+	putc('\n', fp);
+    }
+    fclose(fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Concatenate an output's shards into <stem>-<suffix>.tsv.xz
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    assemble_outputs(shards_t *shards, matrix_out_t *out)
+
+{
+    char    path[PATH_MAX + 1],
+	    buff[65536];
+    FILE    *out_fp,
+	    *shard_fp;
+    size_t  g,
+	    p,
+	    len;
+    
+    for (p = 0; p < out->suffix_count; ++p)
+    {
+	snprintf(path, PATH_MAX, "%s-%s.tsv.xz", out->stem, out->suffixes[p]);
+	if ( (out_fp = fopen(path, "w")) == NULL )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		    path, strerror(errno));
+	    exit(EX_CANTCREAT);
+	}
+	for (g = 0; g < shards->shard_count; ++g)
+	{
+	    if ( ! shards->shards[g].done )
+		continue;
+	    shard_path(path, out, shards->shards[g].chrom, out->suffixes[p]);
+	    if ( (shard_fp = fopen(path, "r")) == NULL )
+	    {
+		fprintf(stderr, "ad-matrix: Cannot open %s: %s\n",
+			path, strerror(errno));
+		exit(EX_NOINPUT);
+	    }
+	    while ( (len = fread(buff, 1, sizeof(buff), shard_fp)) > 0 )
+		fwrite(buff, 1, len, out_fp);
+	    fclose(shard_fp);
+	}
+	if ( fclose(out_fp) != 0 )
+	{
+	    fprintf(stderr, "ad-matrix: Error writing %s-%s.tsv.xz: %s\n",
+		    out->stem, out->suffixes[p], strerror(errno));
+	    exit(EX_IOERR);
+	}
+    }
+}
@@ -0,0 +1,435 @@
+/***************************************************************************
+ *  Description:
+ *      --shm NAME: also publish the ref and ref+alt matrices in blocks
+ *      of rows through a POSIX shared-memory ring, so that a local
+ *      consumer can read the depths as they are merged, without waiting
+ *      for the xz files or parsing them.
+ *
+ *      The ring is a fixed number of slots (see shm_header_t).  The
+ *      writer fills a block in place, in the next free slot, and
+ *      publishes it by incrementing the header's written count.  The
+ *      reader maps the same segment, uses the block where it lies, and
+ *      releases it by incrementing read.  When all slots are in use,
+ *      the writer waits, so a slow reader slows the merge instead of
+ *      losing rows.  A block holds rows of one contig, so its CHROM is
+ *      stored once.  There is one reader per segment.
+ *
+ *      A merge must not hang on a reader that never attaches or has
+ *      died, so the writer stops waiting once the PID the reader stored
+ *      in the header no longer exists, or after --shm-timeout seconds
+ *      with no block released.  It then removes the segment and stops
+ *      publishing, and the merge finishes the xz outputs as usual.
+ *
+ *      ad-matrix shm-cat is a reference reader, printing one matrix of
+ *      the segment as the TSV in the xz file.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+#define SHM_ROUND(n)    (((n) + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN)
+#define SHM_SLOT(shm, n) \
+    ((shm_block_t *)((char *)(shm)->header + \
+		     SHM_ROUND(sizeof(shm_header_t)) + \
+		     (n) % (shm)->header->slots * (shm)->header->slot_bytes))
+
+/***************************************************************************
+ *  Description:
+ *      Create the segment /NAME for an output, replacing any left by an
+ *      earlier run.  Blocks are sized to about SHM_BLOCK_BYTES.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shm_out_open(matrix_out_t *out, char *name, time_t timeout)
+
+{
+    shm_out_t   *shm;
+    uint64_t    block_rows;
+    int         fd;
+    
+    if ( (shm = (shm_out_t *)calloc(1, sizeof(shm_out_t))) == NULL )
+    {
+	fprintf(stderr, "shm_out_open(): Could not allocate ring.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    snprintf(shm->name, PATH_MAX, "%s%s", *name == '/' ? "" : "/", name);
+    block_rows = SHM_BLOCK_BYTES / (sizeof(int64_t) +
+				    2 * out->count * sizeof(depth_t));
+    if ( block_rows == 0 )
+	block_rows = 1;
+    shm_layout(shm, out->count, block_rows);
+    
+    shm_unlink(shm->name);
+    if ( ((fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1)
+	 || (ftruncate(fd, shm->map_bytes) != 0) )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create shared memory %s: %s\n",
+		shm->name, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    shm->header = (shm_header_t *)mmap(NULL, shm->map_bytes,
+				       PROT_READ | PROT_WRITE, MAP_SHARED,
+				       fd, 0);
+    close(fd);
+    if ( shm->header == MAP_FAILED )
+    {
+	fprintf(stderr, "ad-matrix: Cannot map shared memory %s: %s\n",
+		shm->name, strerror(errno));
+	exit(EX_OSERR);
+    }
+    
+    /* The magic goes last, since the reader polls for it */
+    shm->header->columns = out->count;
+    shm->header->slots = SHM_SLOTS;
+    shm->header->block_rows = block_rows;
+    shm->header->slot_bytes = (shm->map_bytes -
+			       SHM_ROUND(sizeof(shm_header_t))) / SHM_SLOTS;
+    atomic_init(&shm->header->written, 0);
+    atomic_init(&shm->header->read, 0);
+    atomic_init(&shm->header->done, 0);
+    atomic_init(&shm->header->reader_pid, 0);
+    atomic_thread_fence(memory_order_release);
+    memcpy(shm->header->magic, SHM_MAGIC, sizeof(shm->header->magic));
+    shm->block = NULL;
+    shm->timeout = timeout;
+    shm->detached = false;
+    out->shm = shm;
+    printf("Publishing %" PRIu64 "-row blocks to shared memory %s.\n",
+	   shm->header->block_rows, shm->name);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Compute the offsets of the arrays in a slot and the size of the
+ *      segment, the same way for the writer and the reader
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shm_layout(shm_out_t *shm, uint64_t columns, uint64_t block_rows)
+
+{
+    size_t  matrix_bytes = SHM_ROUND(block_rows * columns * sizeof(depth_t));
+    
+    shm->pos_offset = SHM_ROUND(sizeof(shm_block_t));
+    shm->ref_offset = shm->pos_offset + SHM_ROUND(block_rows * sizeof(int64_t));
+    shm->ref_alt_offset = shm->ref_offset + matrix_bytes;
+    shm->map_bytes = SHM_ROUND(sizeof(shm_header_t)) +
+		     SHM_SLOTS * (shm->ref_alt_offset + matrix_bytes);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Publish the remaining rows, then wait for the reader to release
+ *      every block before removing the segment, unless it is gone
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shm_out_close(matrix_out_t *out)
+
+{
+    shm_out_t   *shm = out->shm;
+    uint64_t    written;
+    
+    if ( ! shm->detached )
+    {
+	if ( shm->block != NULL )
+	    shm_publish(shm);
+	atomic_store_explicit(&shm->header->done, 1, memory_order_release);
+	written = atomic_load_explicit(&shm->header->written,
+				       memory_order_relaxed);
+	if ( atomic_load_explicit(&shm->header->read, memory_order_acquire) <
+	     written )
+	    fprintf(stderr, "Waiting for the reader of %s...\n", shm->name);
+	if ( shm_wait_read(shm, written) )
+	    shm_unlink(shm->name);
+    }
+    munmap(shm->header, shm->map_bytes);
+    free(shm);
+    out->shm = NULL;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Add a row to the block being filled, publishing it first if it
+ *      is full or the row starts a new contig.  Starting a block waits
+ *      for a free slot.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shm_row(matrix_out_t *out, row_t *row)
+
+{
+    shm_out_t   *shm = out->shm;
+    shm_block_t *block;
+    uint64_t    written;
+    depth_t     *ref,
+		*ref_alt;
+    size_t      c;
+    
+    if ( shm->detached )
+	return;
+    if ( (shm->block != NULL) &&
+	 ((shm->block->rows == shm->header->block_rows) ||
+	  (strcmp(shm->block->chrom, row->chrom) != 0)) )
+	shm_publish(shm);
+    
+    if ( shm->block == NULL )
+    {
+	written = atomic_load_explicit(&shm->header->written,
+				       memory_order_relaxed);
+	if ( (written >= shm->header->slots) &&
+	     ! shm_wait_read(shm, written - shm->header->slots + 1) )
+	    return;
+	shm->block = SHM_SLOT(shm, written);
+	shm->block->rows = 0;
+	strcpy(shm->block->chrom, row->chrom);
+    }
+    
+    block = shm->block;
+    ((int64_t *)((char *)block + shm->pos_offset))[block->rows] = row->pos;
+    ref = (depth_t *)((char *)block + shm->ref_offset) +
+	  block->rows * shm->header->columns;
+    ref_alt = (depth_t *)((char *)block + shm->ref_alt_offset) +
+	      block->rows * shm->header->columns;
+    for (c = 0; c < out->count; ++c)
+    {
+	ref[c] = row->ref[out->column[c]];
+	ref_alt[c] = row->ref_alt[out->column[c]];
+    }
+    ++block->rows;
+}
+
+
+void    shm_publish(shm_out_t *shm)
+
+{
+    atomic_fetch_add_explicit(&shm->header->written, 1, memory_order_release);
+    shm->block = NULL;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Wait until the reader has released read blocks.  If it has died,
+ *      or released nothing for timeout seconds, detach from the segment
+ *      and return false.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+bool    shm_wait_read(shm_out_t *shm, uint64_t read)
+
+{
+    uint64_t    last_read,
+		now_read;
+    time_t      last_progress = time(NULL);
+    pid_t       pid;
+    
+    last_read = atomic_load_explicit(&shm->header->read, memory_order_acquire);
+    while ( last_read < read )
+    {
+	pid = atomic_load_explicit(&shm->header->reader_pid,
+				   memory_order_relaxed);
+	if ( (pid != 0) && (kill(pid, 0) == -1) && (errno == ESRCH) )
+	{
+	    shm_detach(shm, "exited");
+	    return false;
+	}
+	if ( (shm->timeout != 0) &&
+	     (time(NULL) - last_progress >= shm->timeout) )
+	{
+	    shm_detach(shm, pid == 0 ? "did not attach" : "stopped reading");
+	    return false;
+	}
+	shm_wait();
+	now_read = atomic_load_explicit(&shm->header->read,
+					memory_order_acquire);
+	if ( now_read != last_read )
+	{
+	    last_read = now_read;
+	    last_progress = time(NULL);
+	}
+    }
+    return true;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Stop publishing to a segment whose reader is gone.  The segment
+ *      is removed, and marked done for a reader that is only slow.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    shm_detach(shm_out_t *shm, char *reason)
+
+{
+    fprintf(stderr, "ad-matrix: The reader of %s %s, no longer "
+	    "publishing to it.\n", shm->name, reason);
+    shm->block = NULL;
+    shm->detached = true;
+    atomic_store_explicit(&shm->header->done, 1, memory_order_release);
+    shm_unlink(shm->name);
+}
+
+
+void    shm_wait(void)
+
+{
+    struct timespec delay = { 0, SHM_POLL_NS };
+    
+    nanosleep(&delay, NULL);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      ad-matrix shm-cat: attach to the segment of a running ad-matrix
+ *      --shm, waiting for it to be created, and print its ref or
+ *      ref+alt matrix as it is published
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     shm_cat(int argc, char *argv[])
+
+{
+    shm_out_t       shm;
+    shm_header_t    header;
+    shm_block_t     *block;
+    char            *which = "ref+alt";
+    depth_t         *depths;
+    int64_t         *pos;
+    uint64_t        read,
+		    r,
+		    c;
+    int             fd;
+    void            *map;
+    
+    if ( (argc < 3) || (argc > 4) )
+	shm_cat_usage(argv);
+    if ( argc == 4 )
+	which = argv[3];
+    if ( (strcmp(which, "ref") != 0) && (strcmp(which, "ref+alt") != 0) )
+	shm_cat_usage(argv);
+    snprintf(shm.name, PATH_MAX, "%s%s", *argv[2] == '/' ? "" : "/", argv[2]);
+    
+    while ( (fd = shm_open(shm.name, O_RDWR, 0)) == -1 )
+    {
+	if ( errno != ENOENT )
+	{
+	    fprintf(stderr, "ad-matrix: Cannot open shared memory %s: %s\n",
+		    shm.name, strerror(errno));
+	    exit(EX_NOINPUT);
+	}
+	shm_wait();
+    }
+    
+    /* The header is complete once the magic is set */
+    do
+    {
+	shm_wait();
+	if ( pread(fd, &header, sizeof(header), 0) != sizeof(header) )
+	    continue;
+	atomic_thread_fence(memory_order_acquire);
+    }   while ( memcmp(header.magic, SHM_MAGIC, sizeof(header.magic)) != 0 );
+    shm_layout(&shm, header.columns, header.block_rows);
+    map = mmap(NULL, shm.map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( map == MAP_FAILED )
+    {
+	fprintf(stderr, "ad-matrix: Cannot map shared memory %s: %s\n",
+		shm.name, strerror(errno));
+	exit(EX_OSERR);
+    }
+    shm.header = (shm_header_t *)map;
+    atomic_store_explicit(&shm.header->reader_pid, getpid(),
+			  memory_order_relaxed);
+    
+    read = atomic_load_explicit(&shm.header->read, memory_order_relaxed);
+    while ( true )
+    {
+	if ( read == atomic_load_explicit(&shm.header->written,
+					  memory_order_acquire) )
+	{
+	    /* written is final once done is set */
+	    if ( atomic_load_explicit(&shm.header->done, memory_order_acquire) &&
+		 (read == atomic_load_explicit(&shm.header->written,
+					       memory_order_acquire)) )
+		break;
+	    shm_wait();
+	    continue;
+	}
+    
+	block = SHM_SLOT(&shm, read);
+	pos = (int64_t *)((char *)block + shm.pos_offset);
+	depths = (depth_t *)((char *)block + (strcmp(which, "ref") == 0 ?
+		 shm.ref_offset : shm.ref_alt_offset));
+	for (r = 0; r < block->rows; ++r)
+	{
+	    printf("%s\t%" PRId64 "\t", block->chrom, pos[r]);
+	    for (c = 0; c < shm.header->columns; ++c)
+	    {
+		put_depth(depths[r * shm.header->columns + c], stdout);
+		putchar('\t');
+	    }
+	    putchar('\n');
+	}
+	atomic_store_explicit(&shm.header->read, ++read, memory_order_release);
+    }
+    munmap(map, shm.map_bytes);
+    return EX_OK;
+}
+
+
+void    shm_cat_usage(char *argv[])
+
+{
+    fprintf(stderr, "Usage: %s shm-cat NAME [ref|ref+alt]\n", argv[0]);
+    fprintf(stderr, "Print the ref or ref+alt [default] matrix published by ad-matrix --shm NAME\n");
+    fprintf(stderr, "while it runs.  Starts before or after ad-matrix, which waits for it to\n");
+    fprintf(stderr, "read every row before exiting, unless it dies or exceeds --shm-timeout.\n");
+    exit(EX_USAGE);
+}
@@ -0,0 +1,241 @@
+/***************************************************************************
+ *  Description:
+ *      QC statistics collected while the matrices are written, so that
+ *      no second pass over the output is needed.
+ *
+ *      <stem>-site-stats.tsv.xz has one line per matrix row:
+ *      CHROM POS CALLS CALL_RATE MEAN_DEPTH MEAN_AB
+ *
+ *      <stem>-sample-stats.tsv has one line per sample with call counts,
+ *      mean depth, mean allele balance, and a log2 depth histogram.
+ *
+ *      Allele balance is alt / (ref + alt) from AD.  Depth is the value
+ *      in the ref+alt matrix.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+/***************************************************************************
+ *  Description:
+ *      Allocate counters for an output and open its per-site pipe.
+ *      When resuming, the pipe is opened by checkpoint_restore() once
+ *      it has truncated the output.
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    stats_open(matrix_out_t *out, bool resume)
+
+{
+    stats_t *stats;
+    
+    if ( (stats = (stats_t *)calloc(1, sizeof(stats_t))) == NULL )
+    {
+	fprintf(stderr, "stats_open(): Could not allocate stats.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    stats->calls = (uint64_t *)calloc(out->count, sizeof(uint64_t));
+    stats->depth_calls = (uint64_t *)calloc(out->count, sizeof(uint64_t));
+    stats->depth_sum = (uint64_t *)calloc(out->count, sizeof(uint64_t));
+    stats->depth_hist = (uint64_t *)calloc(out->count * STATS_DEPTH_BINS,
+					   sizeof(uint64_t));
+    stats->ab_calls = (uint64_t *)calloc(out->count, sizeof(uint64_t));
+    stats->ab_sum = (double *)calloc(out->count, sizeof(double));
+    if ( (stats->calls == NULL) || (stats->depth_calls == NULL) ||
+	 (stats->depth_sum == NULL) || (stats->depth_hist == NULL) ||
+	 (stats->ab_calls == NULL) || (stats->ab_sum == NULL) )
+    {
+	fprintf(stderr, "stats_open(): Could not allocate counters.\n");
+	exit(EX_UNAVAILABLE);
+    }
+    stats->site_fp = resume ? NULL : open_xz_pipe(out->stem, "site-stats",
+							  false);
+    out->stats = stats;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write the per-sample table, close the per-site pipe, and free
+ *      the counters
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    stats_close(matrix_out_t *out, file_list_t *file_list)
+
+{
+    stats_t *stats = out->stats;
+    char    filename[PATH_MAX + 1];
+    FILE    *fp;
+    size_t  c,
+	    s;
+    int     bin;
+    
+    pclose(stats->site_fp);
+    
+    snprintf(filename, PATH_MAX, "%s-sample-stats.tsv", out->stem);
+    if ( (fp = fopen(filename, "w")) == NULL )
+    {
+	fprintf(stderr, "ad-matrix: Cannot create %s: %s\n",
+		filename, strerror(errno));
+	exit(EX_CANTCREAT);
+    }
+    fprintf(fp, "INDEX\tSAMPLE\tCALLS\tCALL_RATE\tMEAN_DEPTH\tMEAN_AB");
+    fprintf(fp, "\tDP_0\tDP_1");
+    for (bin = 2; bin < STATS_DEPTH_BINS - 1; ++bin)
+	fprintf(fp, "\tDP_%u-%u", 1u << (bin - 1), (1u << bin) - 1);
+    fprintf(fp, "\tDP_%u+\n", 1u << (STATS_DEPTH_BINS - 2));
+    
+    for (c = 0; c < out->count; ++c)
+    {
+	s = out->column[c];
+	fprintf(fp, "%zu\t%s\t%" PRIu64 "\t", column_index(file_list, s),
+		column_name(file_list, s), stats->calls[c]);
+	put_ratio(stats->sites, stats->calls[c], fp);
+	putc('\t', fp);
+	put_ratio(stats->depth_calls[c], stats->depth_sum[c], fp);
+	putc('\t', fp);
+	put_ratio(stats->ab_calls[c], stats->ab_sum[c], fp);
+	for (bin = 0; bin < STATS_DEPTH_BINS; ++bin)
+	    fprintf(fp, "\t%" PRIu64, stats->depth_hist[c * STATS_DEPTH_BINS + bin]);
+	putc('\n', fp);
+    }
+    fclose(fp);
+    
+    free(stats->calls);
+    free(stats->depth_calls);
+    free(stats->depth_sum);
+    free(stats->depth_hist);
+    free(stats->ab_calls);
+    free(stats->ab_sum);
+    free(stats);
+    out->stats = NULL;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Add one output row to the per-sample counters and write its
+ *      per-site line
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    stats_row(matrix_out_t *out, row_t *row)
+
+{
+    stats_t     *stats = out->stats;
+    size_t      c,
+		s;
+    depth_t     ref,
+		alt,
+		ref_alt;
+    uint64_t    calls = 0,
+		depth_calls = 0,
+		depth_sum = 0,
+		ab_calls = 0;
+    double      ab,
+		ab_sum = 0.0;
+    
+    for (c = 0; c < out->count; ++c)
+    {
+	s = out->column[c];
+	ref = row->ref[s];
+	alt = row->alt[s];
+	ref_alt = row->ref_alt[s];
+	if ( (ref == DEPTH_MISSING) && (ref_alt == DEPTH_MISSING) )
+	    continue;
+    
+	++stats->calls[c];
+	++calls;
+	if ( ref_alt != DEPTH_MISSING )
+	{
+	    ++stats->depth_calls[c];
+	    stats->depth_sum[c] += ref_alt;
+	    ++stats->depth_hist[c * STATS_DEPTH_BINS + stats_depth_bin(ref_alt)];
+	    ++depth_calls;
+	    depth_sum += ref_alt;
+	}
+	if ( (ref != DEPTH_MISSING) && (alt != DEPTH_MISSING) &&
+	     ((uint64_t)ref + alt != 0) )
+	{
+	    ab = (double)alt / ((uint64_t)ref + alt);
+	    ++stats->ab_calls[c];
+	    stats->ab_sum[c] += ab;
+	    ++ab_calls;
+	    ab_sum += ab;
+	}
+    }
+    ++stats->sites;
+    
+    fprintf(stats->site_fp, "%s\t%" PRId64 "\t%" PRIu64 "\t",
+	    row->chrom, row->pos, calls);
+    put_ratio(out->count, calls, stats->site_fp);
+    putc('\t', stats->site_fp);
+    put_ratio(depth_calls, depth_sum, stats->site_fp);
+    putc('\t', stats->site_fp);
+    put_ratio(ab_calls, ab_sum, stats->site_fp);
+    putc('\n', stats->site_fp);
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Histogram bin for a depth: 0 for 0, otherwise 1 + floor(log2),
+ *      with everything from 2^(STATS_DEPTH_BINS - 2) up in the last bin
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+int     stats_depth_bin(depth_t depth)
+
+{
+    int     bin;
+    
+    for (bin = 0; (depth != 0) && (bin < STATS_DEPTH_BINS - 1); ++bin)
+	depth >>= 1;
+    return bin;
+}
+
+
+/***************************************************************************
+ *  Description:
+ *      Write sum / count to 4 decimal places, or "." if count is 0
+ *
+ *  History: 
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+void    put_ratio(uint64_t count, double sum, FILE *fp)
+
+{
+    if ( count == 0 )
+	putc('.', fp);
+    else
+	fprintf(fp, "%.4f", sum / count);
+}
@@ -0,0 +1,94 @@
+#!/bin/sh -e
+
+##########################################################################
+#
+#   Build a small matrix set from the fixture VCFs in this directory and
+#   check query and import against the plain xz -dc output.  Run by
+#   "make test" from the top directory.
+#
+#   History:
+#   Date        Name        Modification
+#   2026-10-17  agent       Begin
+##########################################################################
+
+if [ $# != 1 ]; then
+    printf "Usage: $0 ad-matrix-binary\n" >&2
+    exit 64
+fi
+ad_matrix=$(realpath $1)
+
+cd $(dirname $0)
+out=output
+rm -rf $out
+mkdir $out
+
+fail()
+{
+    printf "FAIL: $1\n" >&2
+    exit 1
+}
+
+##########################################################################
+#   query --min-dp/--min-calls must print exactly the rows of the full
+#   ref+alt matrix that pass the same filters, with or without the
+#   zone map skipping blocks.
+##########################################################################
+
+$ad_matrix --index list.txt $out/fx > /dev/null 2>&1
+xz -dc $out/fx-ref+alt.tsv.xz > $out/fx-ref+alt.tsv
+
+for filter in "0 1" "10 1" "10 2" "20 3" "3 4"; do
+    set -- $filter
+    awk -v min_dp=$1 -v min_calls=$2 'BEGIN { FS = OFS = "\t" }
+	{
+	    calls = 0;
+	    for (c = 3; c < NF; ++c)
+	    {
+		if ( (min_dp != 0) && (($c == ".") || ($c + 0 < min_dp)) )
+		    $c = ".";
+		if ( $c != "." )
+		    ++calls;
+	    }
+	    if ( calls >= min_calls )
+		print;
+	}' $out/fx-ref+alt.tsv > $out/expected.tsv
+    : > $out/query.tsv
+    for chrom in $(cut -f 1 $out/fx-ref+alt.tsv | uniq); do
+	$ad_matrix query --min-dp $1 --min-calls $2 $out/fx $chrom \
+	    >> $out/query.tsv 2> /dev/null
+    done
+    cmp -s $out/expected.tsv $out/query.tsv || \
+	fail "query --min-dp $1 --min-calls $2 differs from xz -dc"
+    printf "query --min-dp $1 --min-calls $2: OK\n"
+done
+
+# chr2 has no depth above 5, so its block is skipped by the zone map
+$ad_matrix query --min-dp 10 $out/fx chr2 2>&1 > /dev/null | \
+    grep -q '1 blocks skipped' || fail "query did not skip chr2 with --min-dp 10"
+printf "zone map skip: OK\n"
+
+##########################################################################
+#   import --reorder-columns must write a permutation of the columns,
+#   each with the values of the input column it names.
+##########################################################################
+
+$ad_matrix import --reorder-columns $out/fx $out/ro > /dev/null 2>&1
+cut -f 1 $out/ro-columns.tsv | sort -n | tr '\n' ' ' > $out/order
+[ "$(cat $out/order)" = "1 2 3 4 " ] || \
+    fail "import --reorder-columns columns are not a permutation"
+for matrix in ref ref+alt; do
+    xz -dc $out/fx-$matrix.tsv.xz | \
+	awk -v order="$(cut -f 1 $out/ro-columns.tsv | tr '\n' ' ')" \
+	'BEGIN { FS = OFS = "\t"; count = split(order, column, " ") }
+	{
+	    printf("%s\t%s\t", $1, $2);
+	    for (c = 1; c <= count; ++c)
+		printf("%s\t", $(column[c] + 2));
+	    printf("\n");
+	}' > $out/expected.tsv
+    xz -dc $out/ro-$matrix.tsv.xz | cmp -s $out/expected.tsv - || \
+	fail "import --reorder-columns $matrix values differ"
+done
+printf "import --reorder-columns: OK\n"
+
+rm -rf $out
@@ -0,0 +1,58 @@
+/***************************************************************************
+ *  Description:
+ *      Check that put_varint() and get_varint() round-trip values at
+ *      each LEB128 length boundary.  Run by "make test".
+ *
+ *  History:
+ *  Date        Name        Modification
+ *  2026-10-17  agent       Begin
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <xtend/dsv.h>
+#include <biolibc/vcf.h>
+
+#include "ad-matrix.h"
+
+int     main(int argc,char *argv[])
+
+{
+    unsigned char   bytes[16],
+		    *end,
+		    *p;
+    uint64_t        value;
+    size_t          len;
+    int             shift,
+		    delta,
+		    errors = 0;
+    
+    /* 0, 2^k - 1 and 2^k for every k up to 63, and UINT64_MAX */
+    for (shift = -1; shift < 64; ++shift)
+    {
+	value = shift < 0 ? 0 : (uint64_t)1 << shift;
+	for (delta = -1; delta <= 0; ++delta)
+	{
+	    end = put_varint(bytes, value + delta);
+	    len = end - bytes;
+	    p = bytes;
+	    if ( (get_varint(&p) != value + delta) || (p != end) ||
+		 (len != ((value + delta == 0) ? 1 :
+			  (64 - __builtin_clzll(value + delta) + 6) / 7)) )
+	    {
+		fprintf(stderr, "varint-test: %" PRIu64 " does not round-trip.\n",
+			value + delta);
+		++errors;
+	    }
+	}
+    }
+    if ( errors != 0 )
+	return EX_SOFTWARE;
+    printf("varint round-trip: OK\n");
+    return EX_OK;
+}